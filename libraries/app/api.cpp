@@ -155,8 +155,9 @@ namespace graphene { namespace app {
 
     void network_broadcast_api::broadcast_transaction(const signed_transaction& trx)
     {
-       trx.validate();
-       _app.chain_database()->push_transaction(trx);
+       precomputed_transaction ptrx( trx, _app.chain_database()->get_chain_id() );
+       ptrx.validate();
+       _app.chain_database()->push_transaction(ptrx);
        _app.p2p_node()->broadcast_transaction(trx);
     }
 
@@ -178,9 +179,10 @@ namespace graphene { namespace app {
 
     void network_broadcast_api::broadcast_transaction_with_callback(confirmation_callback cb, const signed_transaction& trx)
     {
-       trx.validate();
-       _callbacks[trx.id()] = cb;
-       _app.chain_database()->push_transaction(trx);
+       precomputed_transaction ptrx( trx, _app.chain_database()->get_chain_id() );
+       ptrx.validate();
+       _callbacks[ptrx.id()] = cb;
+       _app.chain_database()->push_transaction(ptrx);
        _app.p2p_node()->broadcast_transaction(trx);
     }
 
@@ -372,6 +372,22 @@ namespace detail {
          if( _options->count("replay-blockchain") )
             _chain_db->wipe( _data_dir / "blockchain", false );
 
+         async_log_options log_options;
+         log_options.enabled = !_options->count("disable-chain-logs");
+         if( _options->count("chain-log-dir") )
+            log_options.directory = _options->at("chain-log-dir").as<boost::filesystem::path>();
+         if( _options->count("chain-log-format") )
+         {
+            auto format = _options->at("chain-log-format").as<string>();
+            FC_ASSERT( format == "csv" || format == "binary", "Unknown chain log format ${f}", ("f", format) );
+            log_options.format = format == "csv" ? async_log_format::csv : async_log_format::binary;
+         }
+         if( _options->count("chain-log-max-size") )
+            log_options.max_file_size = _options->at("chain-log-max-size").as<uint64_t>() * 1024 * 1024;
+         _chain_db->configure_logs( log_options );
+         if( _options->count("checkpoint-interval") )
+            _chain_db->set_checkpoint_interval( _options->at("checkpoint-interval").as<uint32_t>() );
+
          try
          {
             _chain_db->open( _data_dir / "blockchain", initial_state, GRAPHENE_CURRENT_DB_VERSION );
@@ -535,7 +551,7 @@ namespace detail {
             trx_count = 0;
          }
 
-         _chain_db->push_transaction( transaction_message.trx );
+         _chain_db->push_transaction( precomputed_transaction( transaction_message.trx, _chain_db->get_chain_id() ) );
       } FC_CAPTURE_AND_RETHROW( (transaction_message) ) }
 
       virtual void handle_message(const message& message_to_process) override
@@ -916,6 +932,11 @@ void application::set_program_options(boost::program_options::options_descriptio
          ("dbg-init-key", bpo::value<string>(), "Block signing key to use for init witnesses, overrides genesis file")
          ("api-access", bpo::value<boost::filesystem::path>(), "JSON file specifying API permissions")
          ("plugins", bpo::value<string>(), "Space-separated list of plugins to activate")
+         ("chain-log-dir", bpo::value<boost::filesystem::path>(), "Directory of the block info, activity and emission logs, the working directory by default")
+         ("chain-log-format", bpo::value<string>()->default_value("csv"), "Format of the block info, activity and emission logs: csv or binary")
+         ("chain-log-max-size", bpo::value<uint64_t>()->default_value(64), "Size in MB at which a block info, activity or emission log is rotated, 0 never rotates")
+         ("disable-chain-logs", "Do not write the block info, activity and emission logs")
+         ("checkpoint-interval", bpo::value<uint32_t>()->default_value(1000), "Irreversible blocks between saves of the object database changes, 0 saves it only on shutdown")
          ;
    command_line_options.add(configuration_file_options);
    command_line_options.add_options()
@@ -84,6 +84,9 @@ class database_api_impl : public std::enable_shared_from_this<database_api_impl>
       fc::variant_object get_config()const;
       chain_id_type get_chain_id()const;
       dynamic_global_property_object get_dynamic_global_properties()const;
+      vector<allocation_statistics> get_allocation_statistics()const;
+      signature_cache_statistics get_signature_cache_statistics()const;
+      maintenance_statistics get_maintenance_statistics()const;
 
       // Keys
       vector<vector<account_id_type>> get_key_references( vector<public_key_type> key )const;
@@ -484,6 +487,36 @@ dynamic_global_property_object database_api_impl::get_dynamic_global_properties(
    return _db.get(dynamic_global_property_id_type());
 }
 
+vector<allocation_statistics> database_api::get_allocation_statistics()const
+{
+   return my->get_allocation_statistics();
+}
+
+vector<allocation_statistics> database_api_impl::get_allocation_statistics()const
+{
+   return _db.get_allocation_statistics();
+}
+
+signature_cache_statistics database_api::get_signature_cache_statistics()const
+{
+   return my->get_signature_cache_statistics();
+}
+
+signature_cache_statistics database_api_impl::get_signature_cache_statistics()const
+{
+   return signature_cache::instance().statistics();
+}
+
+maintenance_statistics database_api::get_maintenance_statistics()const
+{
+   return my->get_maintenance_statistics();
+}
+
+maintenance_statistics database_api_impl::get_maintenance_statistics()const
+{
+   return _db.get_last_maintenance_statistics();
+}
+
 //////////////////////////////////////////////////////////////////////
 //                                                                  //
 // Keys                                                             //
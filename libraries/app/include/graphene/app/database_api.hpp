@@ -26,6 +26,7 @@
 #include <graphene/app/full_account.hpp>
 
 #include <graphene/chain/protocol/types.hpp>
+#include <graphene/chain/protocol/signature_cache.hpp>
 
 #include <graphene/chain/database.hpp>
 
@@ -227,6 +228,21 @@ class database_api
        */
       dynamic_global_property_object get_dynamic_global_properties()const;
 
+      /**
+       * @brief Retrieve the node pool counters of the object indexes which pool their objects
+       */
+      vector<allocation_statistics> get_allocation_statistics()const;
+
+      /**
+       * @brief Retrieve the hit and miss counters of the signature recovery cache
+       */
+      signature_cache_statistics get_signature_cache_statistics()const;
+
+      /**
+       * @brief Retrieve the timings of the last chain maintenance
+       */
+      maintenance_statistics get_maintenance_statistics()const;
+
       //////////
       // Keys //
       //////////
@@ -664,6 +680,9 @@ FC_API(graphene::app::database_api,
    (get_config)
    (get_chain_id)
    (get_dynamic_global_properties)
+   (get_allocation_statistics)
+   (get_signature_cache_statistics)
+   (get_maintenance_statistics)
 
    // Keys
    (get_key_references)
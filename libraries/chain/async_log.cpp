@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/async_log.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <chrono>
+
+namespace graphene { namespace chain {
+
+namespace {
+   struct producer_guard
+   {
+      explicit producer_guard( std::atomic<uint32_t>& count ):count(count) { count.fetch_add( 1 ); }
+      ~producer_guard() { count.fetch_sub( 1 ); }
+      std::atomic<uint32_t>& count;
+   };
+}
+
+async_log::~async_log()
+{
+   close();
+}
+
+void async_log::open( const async_log_options& options )
+{
+   close();
+   _options = options;
+   if( !_options.enabled )
+      return;
+
+   size_t capacity = 2;
+   while( capacity < _options.capacity )
+      capacity <<= 1;
+   _cells.reset( new cell[capacity] );
+   for( size_t i = 0; i < capacity; ++i )
+      _cells[i].sequence.store( i, std::memory_order_relaxed );
+   _mask = capacity - 1;
+   _enqueue_pos.store( 0 );
+   _dequeue_pos = 0;
+   _pushed.store( 0 );
+   _written.store( 0 );
+
+   if( _options.directory != fc::path() )
+      fc::create_directories( _options.directory );
+
+   _stopping.store( false );
+   _enabled.store( true );
+   _writer = std::thread( [this]() { work(); } );
+}
+
+void async_log::close()
+{
+   if( !_writer.joinable() )
+      return;
+   // a producer either sees the log disabled or is waited for, its record is then written below
+   _enabled.store( false );
+   while( _producers.load() != 0 )
+      std::this_thread::yield();
+   _stopping.store( true );
+   {
+      std::lock_guard<std::mutex> guard( _lock );
+      _wake.notify_all();
+   }
+   _writer.join();
+   _files.clear();
+   _cells.reset();
+   report_dropped();
+}
+
+void async_log::flush()
+{
+   uint64_t target = _pushed.load();
+   {
+      std::unique_lock<std::mutex> lock( _lock );
+      _wake.notify_all();
+      _flushed.wait( lock, [&]() { return _written.load() >= target || !_writer.joinable() || _stopping.load(); } );
+   }
+   report_dropped();
+}
+
+void async_log::report_dropped()
+{
+   const uint64_t dropped = _dropped.load();
+   const uint64_t reported = _reported_dropped.exchange( dropped );
+   if( dropped > reported )
+      wlog( "${n} chain log records were dropped as the ring of ${c} records was full, ${t} in total",
+            ("n", dropped - reported)("c", _mask + 1)("t", dropped) );
+}
+
+void async_log::push( const char* file, std::vector<std::string>&& fields )
+{
+   producer_guard guard( _producers );
+   if( _enabled.load() )
+      enqueue( file, std::move( fields ) );
+}
+
+void async_log::enqueue( const char* file, std::vector<std::string>&& fields )
+{
+   // bounded multi-producer ring, a cell is free for position pos when its sequence is pos
+   // and holds a record for the writer when its sequence is pos + 1
+   const bool lossless = _options.lossless_files.count( file ) != 0;
+   cell* target;
+   size_t pos = _enqueue_pos.load( std::memory_order_relaxed );
+   while( true )
+   {
+      target = &_cells[pos & _mask];
+      size_t sequence = target->sequence.load( std::memory_order_acquire );
+      intptr_t diff = intptr_t( sequence ) - intptr_t( pos );
+      if( diff == 0 )
+      {
+         if( _enqueue_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+            break;
+      }
+      else if( diff < 0 )
+      {
+         if( !lossless )
+         {
+            _dropped.fetch_add( 1, std::memory_order_relaxed );
+            return;
+         }
+         // the writer frees the ring a batch at a time and tells the waiting producers
+         std::unique_lock<std::mutex> lock( _lock );
+         _wake.notify_all();
+         _flushed.wait_for( lock, std::chrono::milliseconds( 1 ) );
+         pos = _enqueue_pos.load( std::memory_order_relaxed );
+      }
+      else
+         pos = _enqueue_pos.load( std::memory_order_relaxed );
+   }
+
+   target->value.file = file;
+   target->value.time = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::system_clock::now().time_since_epoch() ).count();
+   target->value.fields = std::move( fields );
+   target->sequence.store( pos + 1, std::memory_order_release );
+   _pushed.fetch_add( 1, std::memory_order_release );
+   // a burst wakes the writer every half ring, before the ring fills up
+   if( ( pos & ( _mask >> 1 ) ) == 0 )
+      _wake.notify_one();
+}
+
+bool async_log::pop( record& r )
+{
+   cell& source = _cells[_dequeue_pos & _mask];
+   if( source.sequence.load( std::memory_order_acquire ) != _dequeue_pos + 1 )
+      return false;
+   r = std::move( source.value );
+   source.sequence.store( _dequeue_pos + _mask + 1, std::memory_order_release );
+   ++_dequeue_pos;
+   return true;
+}
+
+void async_log::work()
+{
+   record r;
+   while( true )
+   {
+      uint64_t count = 0;
+      while( pop( r ) )
+      {
+         try
+         {
+            write_record( r );
+         }
+         catch( const fc::exception& e )
+         {
+            wlog( "Failed to write ${f}: ${e}", ("f", r.file)("e", e.to_detail_string()) );
+         }
+         catch( const std::exception& e )
+         {
+            wlog( "Failed to write ${f}: ${e}", ("f", r.file)("e", e.what()) );
+         }
+         ++count;
+      }
+      if( count > 0 )
+      {
+         for( auto& file : _files )
+            file.second.out.flush();
+         _written.fetch_add( count );
+      }
+
+      std::unique_lock<std::mutex> lock( _lock );
+      _flushed.notify_all();
+      // a record pushed before the writer was told to stop is still written
+      if( _stopping.load() && _written.load() >= _pushed.load() )
+         return;
+      // producers only signal bursts, the writer collects what they queued every few milliseconds otherwise
+      _wake.wait_for( lock, std::chrono::milliseconds( 20 ) );
+   }
+}
+
+void async_log::write_record( const record& r )
+{
+   auto itr = _files.find( r.file );
+   if( itr == _files.end() )
+   {
+      fc::path path = _options.directory / r.file;
+      log_file opened;
+      opened.out.open( path.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::app );
+      FC_ASSERT( opened.out.good(), "Unable to open log file ${path}", ("path", path) );
+      opened.size = fc::file_size( path );
+      itr = _files.emplace( r.file, std::move( opened ) ).first;
+   }
+   log_file& file = itr->second;
+
+   std::string data;
+   if( _options.format == async_log_format::csv )
+   {
+      for( size_t i = 0; i < r.fields.size(); ++i )
+      {
+         if( i > 0 )
+            data += ';';
+         data += r.fields[i];
+      }
+      data += '\n';
+   }
+   else
+   {
+      auto append = [&]( const void* value, size_t size ) { data.append( static_cast<const char*>( value ), size ); };
+      uint32_t field_count = r.fields.size();
+      append( &r.time, sizeof(r.time) );
+      append( &field_count, sizeof(field_count) );
+      for( const auto& field : r.fields )
+      {
+         uint32_t size = field.size();
+         append( &size, sizeof(size) );
+         append( field.data(), field.size() );
+      }
+   }
+
+   if( _options.max_file_size > 0 && file.size > 0 && file.size + data.size() > _options.max_file_size )
+      rotate( r.file, file );
+   file.out.write( data.data(), data.size() );
+   file.size += data.size();
+}
+
+void async_log::rotate( const std::string& name, log_file& file )
+{
+   file.out.close();
+   fc::path path = _options.directory / name;
+   auto rotated = [&]( uint32_t n ) { return fc::path( path.generic_string() + "." + std::to_string( n ) ); };
+   if( _options.max_rotated_files > 0 )
+   {
+      if( fc::exists( rotated( _options.max_rotated_files ) ) )
+         fc::remove( rotated( _options.max_rotated_files ) );
+      for( uint32_t n = _options.max_rotated_files; n > 1; --n )
+         if( fc::exists( rotated( n - 1 ) ) )
+            fc::rename( rotated( n - 1 ), rotated( n ) );
+      fc::rename( path, rotated( 1 ) );
+   }
+   else
+      fc::remove( path );
+   file.out.open( path.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+   FC_ASSERT( file.out.good(), "Unable to open log file ${path}", ("path", path) );
+   file.size = 0;
+}
+
+} }
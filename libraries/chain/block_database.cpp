@@ -25,19 +25,105 @@
 #include <graphene/chain/protocol/fee_schedule.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/smart_ref_impl.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <fcntl.h>
+#include <zlib.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace graphene { namespace chain { namespace detail {
+   /** Precedes the compressed blocks of a batch in an archive segment */
+   struct archive_batch_header
+   {
+      uint32_t         first_block_num = 0;
+      uint32_t         compressed_size = 0;
+      vector<uint32_t> block_ends;
+   };
+} } }
+
+FC_REFLECT( graphene::chain::index_entry, (block_pos)(block_size)(block_id) );
+FC_REFLECT( graphene::chain::detail::archive_batch_header, (first_block_num)(compressed_size)(block_ends) );
 
 namespace graphene { namespace chain {
 
-struct index_entry
+namespace bip = boost::interprocess;
+
+namespace {
+   const uint64_t segment_size = 64 * 1024 * 1024;
+   /// every segment is mapped this far into the next one, so a block rarely crosses a mapping
+   const uint64_t segment_overlap = 4 * GRAPHENE_DEFAULT_MAX_BLOCK_SIZE;
+   /// most segments kept mapped, the least recently used one is unmapped first
+   const size_t   max_segments = 16;
+
+   const uint64_t archive_segment_size = 64 * 1024 * 1024;
+   /// the block_pos of an archived block is the position of its batch in the archive
+   const uint64_t archived_flag = uint64_t(1) << 63;
+   const uint32_t blocks_per_batch = 256;
+   /// a batch is closed early once its blocks reach this size
+   const uint64_t max_batch_size = 4 * 1024 * 1024;
+   const size_t   max_batches = 8;
+
+   bool is_archived( const index_entry& e )
+   {
+      return ( e.block_pos & archived_flag ) != 0;
+   }
+
+   /** Writes a file, or the names in a directory, to the disk */
+   void sync_path( const fc::path& p )
+   {
+#ifdef _WIN32
+      // the names in a directory reach the disk with the files
+      if( fc::is_directory( p ) )
+         return;
+      int fd = _open( p.generic_string().c_str(), _O_RDWR | _O_BINARY );
+      FC_ASSERT( fd >= 0, "Can not open ${p}", ("p", p) );
+      int status = _commit( fd );
+      _close( fd );
+#else
+      int fd = ::open( p.generic_string().c_str(), O_RDONLY );
+      FC_ASSERT( fd >= 0, "Can not open ${p}", ("p", p) );
+      int status = ::fsync( fd );
+      ::close( fd );
+#endif
+      FC_ASSERT( status == 0, "Can not write ${p} to the disk", ("p", p) );
+   }
+
+   /** Drops the least recently used entries of a cache until it has max_size, keep stays */
+   template<typename Cache, typename LastUse>
+   void evict( Cache& cache, size_t max_size, uint64_t keep, LastUse last_use )
+   {
+      while( cache.size() > max_size )
+      {
+         auto oldest = cache.begin();
+         for( auto i = cache.begin(); i != cache.end(); ++i )
+            if( last_use( i->second ) < last_use( oldest->second ) )
+               oldest = i;
+         if( oldest->first == keep )
+            break;
+         cache.erase( oldest );
+      }
+   }
+}
+
+struct block_database::mapped_segment
 {
-   uint64_t      block_pos = 0;
-   uint32_t      block_size = 0;
-   block_id_type block_id;
-};
- }}
-FC_REFLECT( graphene::chain::index_entry, (block_pos)(block_size)(block_id) );
+   mapped_segment( const bip::file_mapping& file, uint64_t start, uint64_t size )
+   :region( file, bip::read_only, start, size ), start(start), end(start + size) {}
 
-namespace graphene { namespace chain {
+   const char* data( uint64_t pos )const { return (const char*)region.get_address() + ( pos - start ); }
+
+   bip::mapped_region region;
+   uint64_t           start;
+   uint64_t           end;
+   mutable uint64_t   last_use = 0;
+};
 
 void block_database::open( const fc::path& dbdir )
 { try {
@@ -46,18 +132,139 @@ void block_database::open( const fc::path& dbdir )
    _blocks.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 
    _index_filename = dbdir / "index";
+   _blocks_filename = dbdir / "blocks";
+   _archive_dir = dbdir / "archive";
+   fc::create_directories( _archive_dir );
+   replace_compacted_files();
    if( !fc::exists( _index_filename ) )
    {
      _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
+     _blocks.open( _blocks_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out | std::fstream::trunc);
    }
    else
    {
      _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
-     _blocks.open( (dbdir/"blocks").generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+     _blocks.open( _blocks_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+   }
+
+   _segments.clear();
+   _archives.clear();
+   _batches.clear();
+   _blocks_size = fc::file_size( _blocks_filename );
+   _flushed_size = _blocks_size;
+   _blocks_at_end = false;
+   _index.resize( fc::file_size( _index_filename ) / sizeof(index_entry) );
+   if( !_index.empty() )
+   {
+      bip::file_mapping file( _index_filename.generic_string().c_str(), bip::read_only );
+      bip::mapped_region region( file, bip::read_only, 0, _index.size() * sizeof(index_entry) );
+      memcpy( _index.data(), region.get_address(), _index.size() * sizeof(index_entry) );
    }
+
+   _first_unarchived = 1;
+   while( _first_unarchived < _index.size() && is_archived( _index[_first_unarchived] ) )
+      ++_first_unarchived;
+   // batches written after the last archived block are left over from an interrupted compact()
+   uint64_t last_segment = 0;
+   while( fc::exists( archive_filename( last_segment + 1 ) ) )
+      ++last_segment;
+   _archive_end = last_segment * archive_segment_size;
+   if( fc::exists( archive_filename( last_segment ) ) )
+      _archive_end += fc::file_size( archive_filename( last_segment ) );
+
+   // a block in the blocks file reads back only if the index and the blocks file belong together,
+   // blocks past the end of the file were lost in a crash
+   for( uint32_t num = _first_unarchived; num < _index.size(); ++num )
+   {
+      const index_entry& e = _index[num];
+      if( e.block_size == 0 || is_archived( e ) || e.block_pos + e.block_size > _blocks_size )
+         continue;
+      bool matches = false;
+      try
+      {
+         read_block( e );
+         matches = true;
+      }
+      catch (const fc::exception&)
+      {
+      }
+      catch (const std::exception&)
+      {
+      }
+      FC_ASSERT( matches, "The block index does not match the blocks file", ("block_num", num) );
+      break;
+   }
+
+   // blocks lost in a crash leave entries at the end of the index which do not read back, they are dropped
+   // once the index is known to belong to the blocks file
+   size_t index_size = _index.size();
+   while( index_size > 0 )
+   {
+      const index_entry& e = _index[index_size - 1];
+      if( e.block_size > 0 && ( is_archived( e ) || e.block_pos + e.block_size <= _blocks_size ) )
+         try
+         {
+            read_block( e );
+            break;
+         }
+         catch (const fc::exception&)
+         {
+         }
+         catch (const std::exception&)
+         {
+         }
+      --index_size;
+   }
+   if( index_size < _index.size() )
+   {
+      _index.resize( index_size );
+      _block_num_to_pos.close();
+      fc::resize_file( _index_filename, index_size * sizeof(index_entry) );
+      _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+   }
+   _live_size = 0;
+   for( uint32_t num = _first_unarchived; num < _index.size(); ++num )
+      _live_size += live_size( _index[num] );
 } FC_CAPTURE_AND_RETHROW( (dbdir) ) }
 
+void block_database::replace_compacted_files()
+{
+   const fc::path dbdir = _index_filename.parent_path();
+   const fc::path new_blocks_filename = dbdir / "blocks.new";
+   const fc::path commit_filename = dbdir / "compact.commit";
+   if( fc::exists( commit_filename ) )
+   {
+      // the new blocks file was on the disk before the marker, a rename done before a crash is not
+      // repeated, writing the moved entries again does no harm
+      if( fc::exists( new_blocks_filename ) )
+         fc::rename( new_blocks_filename, _blocks_filename );
+      vector<index_entry> moved( fc::file_size( commit_filename ) / sizeof(index_entry) );
+      if( !moved.empty() )
+      {
+         std::ifstream in( commit_filename.generic_string().c_str(), std::ios::in | std::ios::binary );
+         in.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+         in.read( (char*)moved.data(), moved.size() * sizeof(index_entry) );
+
+         std::fstream index( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+         index.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+         for( const index_entry& e : moved )
+         {
+            index.seekp( sizeof(index_entry) * int64_t( block_header::num_from_id( e.block_id ) ) );
+            index.write( (const char*)&e, sizeof(e) );
+         }
+      }
+      sync_path( _index_filename );
+      sync_path( dbdir );
+      fc::remove( commit_filename );
+      sync_path( dbdir );
+   }
+   else if( fc::exists( new_blocks_filename ) )
+   {
+      // an interrupted compaction, the old files are still complete
+      fc::remove( new_blocks_filename );
+   }
+}
+
 bool block_database::is_open()const
 {
   return _blocks.is_open();
@@ -65,17 +272,41 @@ bool block_database::is_open()const
 
 void block_database::close()
 {
+  std::lock_guard<std::mutex> lock( _segments_lock );
+  _segments.clear();
+  _archives.clear();
+  _batches.clear();
+  _index.clear();
   _blocks.close();
   _block_num_to_pos.close();
 }
 
 void block_database::flush()
 {
-  _blocks.flush();
+  std::lock_guard<std::mutex> lock( _segments_lock );
+  flush_blocks( _blocks_size );
   _block_num_to_pos.flush();
 }
 
-void block_database::store( const block_id_type& _id, const signed_block& b )
+void block_database::flush_blocks( uint64_t end )const
+{
+   if( end > _flushed_size )
+   {
+      _blocks.flush();
+      _flushed_size = _blocks_size;
+   }
+}
+
+void block_database::write_entry( uint32_t block_num, const index_entry& e )
+{
+   if( _index.size() <= block_num )
+      _index.resize( block_num + 1 );
+   _index[block_num] = e;
+   _block_num_to_pos.seekp( sizeof( index_entry ) * int64_t(block_num) );
+   _block_num_to_pos.write( (char*)&e, sizeof(e) );
+}
+
+index_entry block_database::store( const block_id_type& _id, const signed_block& b )
 {
    block_id_type id = _id;
    if( id == block_id_type() )
@@ -83,90 +314,389 @@ void block_database::store( const block_id_type& _id, const signed_block& b )
       id = b.id();
       elog( "id argument of block_database::store() was not initialized for block ${id}", ("id", id) );
    }
-   _block_num_to_pos.seekp( sizeof( index_entry ) * int64_t(block_header::num_from_id(id)) );
    index_entry e;
-   _blocks.seekp( 0, _blocks.end );
    auto vec = fc::raw::pack( b );
-   e.block_pos  = _blocks.tellp();
+   e.block_pos  = _blocks_size;
    e.block_size = vec.size();
    e.block_id   = id;
+   // seeking would flush the stream, the blocks reach the file once they are read or the buffer is full
+   if( !_blocks_at_end )
+   {
+      _blocks.seekp( 0, _blocks.end );
+      _blocks_at_end = true;
+   }
    _blocks.write( vec.data(), vec.size() );
-   _block_num_to_pos.write( (char*)&e, sizeof(e) );
+   _blocks_size += vec.size();
+   const uint32_t block_num = block_header::num_from_id(id);
+   if( block_num < _index.size() )
+      _live_size -= live_size( _index[block_num] );
+   _live_size += e.block_size;
+   write_entry( block_num, e );
+   _first_unarchived = std::min( _first_unarchived, block_num );
+   return e;
 }
 
 void block_database::remove( const block_id_type& id )
 { try {
-   index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   uint32_t block_num = block_header::num_from_id(id);
+   if ( _index.size() <= block_num )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block ${id} not contained in block database", ("id", id));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
+   index_entry e = _index[block_num];
    if( e.block_id == id )
    {
+      _live_size -= live_size( e );
       e.block_size = 0;
-      _block_num_to_pos.seekp( sizeof(e) * int64_t(block_header::num_from_id(id)) );
-      _block_num_to_pos.write( (char*)&e, sizeof(e) );
+      write_entry( block_num, e );
    }
 } FC_CAPTURE_AND_RETHROW( (id) ) }
 
+void block_database::compact( uint32_t last_block_num, uint32_t max_batch_count )
+{ try {
+   struct archived_range
+   {
+      uint32_t first;
+      uint32_t count;
+      uint64_t batch_pos;
+   };
+   vector<archived_range> ranges;
+   std::set<uint64_t> archive_segments;
+
+   // only complete batches are archived, the rest waits for later blocks
+   uint32_t first = _first_unarchived;
+   bool caught_up = false;
+   while( true )
+   {
+      // blocks stored again after being archived leave unarchived blocks among the archived ones
+      while( first < _index.size() && is_archived( _index[first] ) )
+         ++first;
+      if( ranges.size() >= max_batch_count )
+         break;
+
+      uint32_t count = 0;
+      uint64_t raw_size = 0;
+      bool complete = false;
+      while( !complete && first + count <= last_block_num && first + count < _index.size() )
+      {
+         const index_entry& e = _index[first + count];
+         if( e.block_size == 0 )
+            break;
+         if( is_archived( e ) )
+         {
+            complete = true;
+            break;
+         }
+         if( count > 0 && raw_size + e.block_size > max_batch_size )
+         {
+            complete = true;
+            break;
+         }
+         raw_size += e.block_size;
+         ++count;
+         complete = count == blocks_per_batch;
+      }
+      if( !complete )
+      {
+         caught_up = true;
+         break;
+      }
+
+      vector<char> raw;
+      raw.reserve( raw_size );
+      detail::archive_batch_header header;
+      header.first_block_num = first;
+      for( uint32_t num = first; num < first + count; ++num )
+      {
+         // unpacking checks the block id, packing gives back the stored bytes
+         auto packed = fc::raw::pack( read_block( _index[num] ) );
+         raw.insert( raw.end(), packed.begin(), packed.end() );
+         header.block_ends.push_back( raw.size() );
+      }
+
+      vector<char> compressed( compressBound( raw.size() ) );
+      uLongf compressed_size = compressed.size();
+      int status = compress2( (Bytef*)compressed.data(), &compressed_size, (const Bytef*)raw.data(), raw.size(),
+                              Z_DEFAULT_COMPRESSION );
+      FC_ASSERT( status == Z_OK, "Compressing a batch of blocks failed", ("status", status) );
+      header.compressed_size = compressed_size;
+
+      // a batch does not cross archive segments
+      const uint64_t batch_size = fc::raw::pack_size( header ) + compressed_size;
+      if( _archive_end % archive_segment_size != 0 && _archive_end % archive_segment_size + batch_size > archive_segment_size )
+         _archive_end += archive_segment_size - _archive_end % archive_segment_size;
+      const uint64_t batch_pos = _archive_end;
+      archive_segments.insert( batch_pos / archive_segment_size );
+      {
+         std::ofstream out( archive_filename( batch_pos / archive_segment_size ).generic_string().c_str(),
+                            std::ios::out | std::ios::binary | std::ios::app );
+         out.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+         auto packed_header = fc::raw::pack( header );
+         out.write( packed_header.data(), packed_header.size() );
+         out.write( compressed.data(), compressed_size );
+      }
+      _archive_end += batch_size;
+
+      ranges.push_back( archived_range{ first, count, batch_pos } );
+      first += count;
+   }
+
+   if( !ranges.empty() )
+   {
+      // the batches are on the disk before the entries pointing to them, after a crash in between
+      // the blocks are still read from the blocks file
+      for( uint64_t segment : archive_segments )
+         sync_path( archive_filename( segment ) );
+      sync_path( _archive_dir );
+      {
+         std::lock_guard<std::mutex> lock( _segments_lock );
+         for( uint64_t segment : archive_segments )
+            _archives.erase( segment );
+      }
+      for( const archived_range& r : ranges )
+         for( uint32_t num = r.first; num < r.first + r.count; ++num )
+         {
+            index_entry e = _index[num];
+            _live_size -= live_size( e );
+            e.block_pos = archived_flag | r.batch_pos;
+            write_entry( num, e );
+         }
+      _block_num_to_pos.flush();
+   }
+   _first_unarchived = first;
+
+   // the blocks file is only rewritten once everything up to last_block_num is archived, then it
+   // holds little more than the blocks which are not irreversible yet, which are all that is copied
+   if( !caught_up || _live_size * 2 >= _blocks_size )
+      return;
+
+   flush();
+   const fc::path dbdir = _index_filename.parent_path();
+   const fc::path new_blocks_filename = dbdir / "blocks.new";
+   vector<index_entry> moved;
+   {
+      std::ofstream out( new_blocks_filename.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+      out.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+      vector<char> block;
+      uint64_t pos = 0;
+      for( uint32_t num = _first_unarchived; num < _index.size(); ++num )
+      {
+         index_entry e = _index[num];
+         if( is_archived( e ) || e.block_size == 0 )
+            continue;
+         if( e.block_pos + e.block_size > _blocks_size )
+         {
+            // never fully written, fetching it fails already
+            e.block_size = 0;
+         }
+         else
+         {
+            block.resize( e.block_size );
+            _blocks_at_end = false;
+            _blocks.seekg( e.block_pos );
+            _blocks.read( block.data(), block.size() );
+            out.write( block.data(), block.size() );
+            e.block_pos = pos;
+            pos += e.block_size;
+         }
+         moved.push_back( e );
+      }
+   }
+
+   // the marker holds the entries of the moved blocks, it is written once the new blocks file is on
+   // the disk, with it the new file replaces the old one, without it the new file is dropped
+   const fc::path commit_filename = dbdir / "compact.commit";
+   {
+      std::ofstream out( commit_filename.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+      out.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+      out.write( (const char*)moved.data(), moved.size() * sizeof(index_entry) );
+   }
+   sync_path( new_blocks_filename );
+   sync_path( commit_filename );
+   sync_path( dbdir );
+
+   {
+      std::lock_guard<std::mutex> lock( _segments_lock );
+      _segments.clear();
+   }
+   _blocks.close();
+   _block_num_to_pos.close();
+   replace_compacted_files();
+   _block_num_to_pos.open( _index_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+   _blocks.open( _blocks_filename.generic_string().c_str(), std::fstream::binary | std::fstream::in | std::fstream::out );
+   _blocks_size = fc::file_size( _blocks_filename );
+   _flushed_size = _blocks_size;
+   _blocks_at_end = false;
+   for( const index_entry& e : moved )
+      _index[ block_header::num_from_id( e.block_id ) ] = e;
+   _live_size = _blocks_size;
+} FC_CAPTURE_AND_RETHROW( (last_block_num)(max_batch_count) ) }
+
+uint64_t block_database::live_size( const index_entry& e )const
+{
+   return is_archived( e ) || e.block_pos + e.block_size > _blocks_size ? 0 : e.block_size;
+}
+
+const index_entry* block_database::find_entry( uint32_t block_num )const
+{
+   return block_num < _index.size() ? &_index[block_num] : nullptr;
+}
+
+std::shared_ptr<block_database::mapped_segment> block_database::map_segment( uint64_t segment, uint64_t min_end )const
+{
+   std::lock_guard<std::mutex> lock( _segments_lock );
+   auto itr = _segments.find( segment );
+   if( itr == _segments.end() || itr->second->end < min_end )
+   {
+      // the file has grown past the old mapping, or the segment was not mapped yet
+      uint64_t start = segment * segment_size;
+      uint64_t end = std::min( start + segment_size + segment_overlap, _blocks_size );
+      FC_ASSERT( min_end <= end, "Block is outside of the blocks file" );
+      // the mappings only see what has reached the file
+      flush_blocks( end );
+      bip::file_mapping file( _blocks_filename.generic_string().c_str(), bip::read_only );
+      _segments[segment] = std::make_shared<mapped_segment>( file, start, end - start );
+
+      // readers still holding an evicted segment keep it mapped until they are done
+      evict( _segments, max_segments, segment,
+             []( const std::shared_ptr<mapped_segment>& s ) { return s->last_use; } );
+      itr = _segments.find( segment );
+   }
+   itr->second->last_use = ++_segment_uses;
+   return itr->second;
+}
+
+fc::path block_database::archive_filename( uint64_t segment )const
+{
+   char name[32];
+   snprintf( name, sizeof(name), "blocks-%06llu", (unsigned long long)segment );
+   return _archive_dir / name;
+}
+
+std::shared_ptr<block_database::mapped_segment> block_database::map_archive( uint64_t segment )const
+{
+   std::lock_guard<std::mutex> lock( _segments_lock );
+   auto itr = _archives.find( segment );
+   if( itr == _archives.end() )
+   {
+      // archive segments only grow in compact(), which reopens the database
+      fc::path filename = archive_filename( segment );
+      FC_ASSERT( fc::exists( filename ), "Archive segment ${s} is missing", ("s", segment) );
+      bip::file_mapping file( filename.generic_string().c_str(), bip::read_only );
+      itr = _archives.emplace( segment, std::make_shared<mapped_segment>( file, 0, fc::file_size( filename ) ) ).first;
+      evict( _archives, max_segments, segment,
+             []( const std::shared_ptr<mapped_segment>& s ) { return s->last_use; } );
+   }
+   itr->second->last_use = ++_segment_uses;
+   return itr->second;
+}
+
+std::shared_ptr<const block_database::archived_batch> block_database::read_batch( uint64_t archive_pos )const
+{
+   {
+      std::lock_guard<std::mutex> lock( _segments_lock );
+      auto itr = _batches.find( archive_pos );
+      if( itr != _batches.end() )
+      {
+         itr->second.first = ++_segment_uses;
+         return itr->second.second;
+      }
+   }
+
+   auto file = map_archive( archive_pos / archive_segment_size );
+   const uint64_t offset = archive_pos % archive_segment_size;
+   FC_ASSERT( offset < file->end, "Batch is outside of the archive segment" );
+   fc::datastream<const char*> ds( file->data( offset ), file->end - offset );
+   detail::archive_batch_header header;
+   fc::raw::unpack( ds, header );
+   FC_ASSERT( header.compressed_size <= ds.remaining() && !header.block_ends.empty() );
+
+   auto batch = std::make_shared<archived_batch>();
+   batch->first_block_num = header.first_block_num;
+   batch->data.resize( header.block_ends.back() );
+   uLongf raw_size = batch->data.size();
+   int status = uncompress( (Bytef*)batch->data.data(), &raw_size, (const Bytef*)ds.pos(), header.compressed_size );
+   FC_ASSERT( status == Z_OK && raw_size == batch->data.size(), "Archived batch is corrupt",
+              ("archive_pos", archive_pos)("status", status) );
+   batch->block_ends = std::move( header.block_ends );
+
+   std::lock_guard<std::mutex> lock( _segments_lock );
+   _batches[archive_pos] = std::make_pair( ++_segment_uses, std::shared_ptr<const archived_batch>( batch ) );
+   evict( _batches, max_batches, archive_pos,
+          []( const std::pair< uint64_t, std::shared_ptr<const archived_batch> >& b ) { return b.first; } );
+   return batch;
+}
+
+signed_block block_database::read_block( const index_entry& e )const
+{
+   FC_ASSERT( e.block_size > 0 );
+   signed_block result;
+   if( is_archived( e ) )
+   {
+      auto batch = read_batch( e.block_pos & ~archived_flag );
+      const uint32_t block_num = block_header::num_from_id( e.block_id );
+      FC_ASSERT( block_num >= batch->first_block_num && block_num - batch->first_block_num < batch->block_ends.size(),
+                 "Block is not in its archived batch", ("block_num", block_num) );
+      const uint32_t i = block_num - batch->first_block_num;
+      const uint32_t begin = i == 0 ? 0 : batch->block_ends[i-1];
+      FC_ASSERT( begin + e.block_size == batch->block_ends[i] );
+      fc::datastream<const char*> ds( batch->data.data() + begin, e.block_size );
+      fc::raw::unpack( ds, result );
+      FC_ASSERT( result.id() == e.block_id );
+      return result;
+   }
+
+   FC_ASSERT( e.block_pos + e.block_size <= _blocks_size );
+   const uint64_t end = e.block_pos + e.block_size;
+   const uint64_t segment = e.block_pos / segment_size;
+   if( end <= segment * segment_size + segment_size + segment_overlap )
+   {
+      auto mapping = map_segment( segment, end );
+      fc::datastream<const char*> ds( mapping->data( e.block_pos ), e.block_size );
+      fc::raw::unpack( ds, result );
+   }
+   else
+   {
+      // larger than the overlap, map just this block
+      {
+         std::lock_guard<std::mutex> lock( _segments_lock );
+         flush_blocks( end );
+      }
+      bip::file_mapping file( _blocks_filename.generic_string().c_str(), bip::read_only );
+      bip::mapped_region region( file, bip::read_only, e.block_pos, e.block_size );
+      fc::datastream<const char*> ds( (const char*)region.get_address(), e.block_size );
+      fc::raw::unpack( ds, result );
+   }
+   FC_ASSERT( result.id() == e.block_id );
+   return result;
+}
+
 bool block_database::contains( const block_id_type& id )const
 {
    if( id == block_id_type() )
       return false;
 
-   index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() < int64_t(index_pos + sizeof(e)) )
-      return false;
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-   return e.block_id == id && e.block_size > 0;
+   const index_entry* e = find_entry( block_header::num_from_id(id) );
+   return e != nullptr && e->block_id == id && e->block_size > 0;
 }
 
 block_id_type block_database::fetch_block_id( uint32_t block_num )const
 {
    assert( block_num != 0 );
-   index_entry e;
-   int64_t index_pos = sizeof(e) * int64_t(block_num);
-   _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-   if ( _block_num_to_pos.tellg() <= index_pos )
+   const index_entry* e = find_entry( block_num );
+   if ( e == nullptr )
       FC_THROW_EXCEPTION(fc::key_not_found_exception, "Block number ${block_num} not contained in block database", ("block_num", block_num));
 
-   _block_num_to_pos.seekg( index_pos );
-   _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-   FC_ASSERT( e.block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
-   return e.block_id;
+   FC_ASSERT( e->block_id != block_id_type(), "Empty block_id in block_database (maybe corrupt on disk?)" );
+   return e->block_id;
 }
 
 optional<signed_block> block_database::fetch_optional( const block_id_type& id )const
 {
    try
    {
-      index_entry e;
-      int64_t index_pos = sizeof(e) * int64_t(block_header::num_from_id(id));
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
-         return {};
-
-      _block_num_to_pos.seekg( index_pos );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      if( e.block_id != id ) return optional<signed_block>();
-
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      if (e.block_size)
-         _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      const index_entry* e = find_entry( block_header::num_from_id(id) );
+      if( e == nullptr || e->block_id != id ) return optional<signed_block>();
+      return read_block( *e );
    }
    catch (const fc::exception&)
    {
@@ -181,21 +711,10 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
 {
    try
    {
-      index_entry e;
-      int64_t index_pos = sizeof(e) * int64_t(block_num);
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      if ( _block_num_to_pos.tellg() <= index_pos )
+      const index_entry* e = find_entry( block_num );
+      if( e == nullptr )
          return {};
-
-      _block_num_to_pos.seekg( index_pos, _block_num_to_pos.beg );
-      _block_num_to_pos.read( (char*)&e, sizeof(e) );
-
-      vector<char> data( e.block_size );
-      _blocks.seekg( e.block_pos );
-      _blocks.read( data.data(), e.block_size );
-      auto result = fc::raw::unpack<signed_block>(data);
-      FC_ASSERT( result.id() == e.block_id );
-      return result;
+      return read_block( *e );
    }
    catch (const fc::exception&)
    {
@@ -206,47 +725,15 @@ optional<signed_block> block_database::fetch_by_number( uint32_t block_num )cons
    return optional<signed_block>();
 }
 
-optional<index_entry> block_database::last_index_entry()const {
+optional<signed_block> block_database::fetch_stored( const index_entry& e )const
+{
    try
    {
-      index_entry e;
-
-      _block_num_to_pos.seekg( 0, _block_num_to_pos.end );
-      std::streampos pos = _block_num_to_pos.tellg();
-      if( pos < long(sizeof(index_entry)) )
-         return optional<index_entry>();
-
-      pos -= pos % sizeof(index_entry);
-
-      _blocks.seekg( 0, _block_num_to_pos.end );
-      const std::streampos blocks_size = _blocks.tellg();
-      while( pos > 0 )
-      {
-         pos -= sizeof(index_entry);
-         _block_num_to_pos.seekg( pos );
-         _block_num_to_pos.read( (char*)&e, sizeof(e) );
-         if( _block_num_to_pos.gcount() == sizeof(e) && e.block_size > 0
-                && int64_t(e.block_pos + e.block_size) <= blocks_size )
-            try
-            {
-               vector<char> data( e.block_size );
-               _blocks.seekg( e.block_pos );
-               _blocks.read( data.data(), e.block_size );
-               if( _blocks.gcount() == long(e.block_size) )
-               {
-                  const signed_block block = fc::raw::unpack<signed_block>(data);
-                  if( block.id() == e.block_id )
-                     return e;
-               }
-            }
-            catch (const fc::exception&)
-            {
-            }
-            catch (const std::exception&)
-            {
-            }
-         fc::resize_file( _index_filename, pos );
-      }
+      // compact() moves the blocks of the index, the bytes of a replaced block stay in the blocks file until then
+      const index_entry* current = find_entry( block_header::num_from_id( e.block_id ) );
+      if( current != nullptr && current->block_id == e.block_id && current->block_size > 0 )
+         return read_block( *current );
+      return read_block( e );
    }
    catch (const fc::exception&)
    {
@@ -254,6 +741,15 @@ optional<index_entry> block_database::last_index_entry()const {
    catch (const std::exception&)
    {
    }
+   return optional<signed_block>();
+}
+
+optional<index_entry> block_database::last_index_entry()const
+{
+   // open() dropped the entries lost in a crash, the blocks removed since may still be at the end
+   for( auto itr = _index.rbegin(); itr != _index.rend(); ++itr )
+      if( itr->block_size > 0 )
+         return *itr;
    return optional<index_entry>();
 }
 
@@ -271,4 +767,35 @@ optional<block_id_type> block_database::last_id()const
    return optional<block_id_type>();
 }
 
+optional<signed_block> block_database::replay_reader::next()
+{
+   const index_entry* e = _db.find_entry( _next );
+   if( e == nullptr || e->block_size == 0 )
+      return optional<signed_block>();
+
+   // entering a segment maps the following one and asks the kernel to read it ahead,
+   // archived blocks are read a batch at a time anyway
+   uint64_t segment = e->block_pos / segment_size;
+   if( !is_archived( *e ) && segment != _prefetched_segment && ( segment + 1 ) * segment_size < _db._blocks_size )
+   {
+      try
+      {
+         _db.map_segment( segment, e->block_pos )->region.advise( bip::mapped_region::advice_sequential );
+         auto ahead = _db.map_segment( segment + 1, ( segment + 1 ) * segment_size + 1 );
+         ahead->region.advise( bip::mapped_region::advice_sequential );
+         ahead->region.advise( bip::mapped_region::advice_willneed );
+      }
+      catch (const std::exception&)
+      {
+         // prefetching is only a hint
+      }
+      _prefetched_segment = segment;
+   }
+
+   optional<signed_block> result = _db.fetch_by_number( _next );
+   if( result.valid() )
+      ++_next;
+   return result;
+}
+
 } }
@@ -0,0 +1,422 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/block_history_database.hpp>
+#include <fc/interprocess/file_mapping.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+namespace graphene { namespace chain {
+
+struct block_history_index_entry
+{
+   uint64_t first_transfer = 0;
+   double   token_usd_rate = 0;
+   uint32_t transfer_count = 0;
+   uint32_t transaction_amount_threshold = 0;
+   uint32_t account_amount_threshold = 0;
+   uint32_t block_num = 0;
+};
+
+namespace {
+
+const char* const column_names[] = {
+   "source_account",
+   "target_account",
+   "amount",
+   "comission",
+   "source_account_balance",
+   "target_account_balance",
+   "timestamp"
+};
+
+const size_t column_sizes[] = {
+   sizeof( block_history_transfer().source_account ),
+   sizeof( block_history_transfer().target_account ),
+   sizeof( block_history_transfer().amount ),
+   sizeof( block_history_transfer().comission ),
+   sizeof( block_history_transfer().source_account_balance ),
+   sizeof( block_history_transfer().target_account_balance ),
+   sizeof( block_history_transfer().timestamp )
+};
+
+/// read only mapping of the beginning of a file, nothing is mapped for an empty range
+class mapped_file
+{
+   public:
+      mapped_file( const fc::path& p, uint64_t size )
+      {
+         if( size > 0 )
+         {
+            _mapping.reset( new fc::file_mapping( p.generic_string().c_str(), fc::read_only ) );
+            _region.reset( new fc::mapped_region( *_mapping, fc::read_only, 0, size ) );
+         }
+      }
+
+      const char* data()const { return _region ? (const char*)_region->get_address() : nullptr; }
+
+   private:
+      std::unique_ptr<fc::file_mapping>  _mapping;
+      std::unique_ptr<fc::mapped_region> _region;
+};
+
+template<typename T>
+void read_value( T& value, const char* column, uint64_t position )
+{
+   std::memcpy( &value, column + position * sizeof(T), sizeof(T) );
+}
+
+template<typename T>
+void write_value( std::ofstream& column, const T& value )
+{
+   column.write( (const char*)&value, sizeof(T) );
+}
+
+}
+
+void block_history_database::open( const fc::path& dbdir )
+{ try {
+   std::lock_guard<std::mutex> lock( _lock );
+   fc::create_directories( dbdir );
+   _dbdir = dbdir;
+   open_files();
+
+   // drop whatever was written only partially before a crash
+   uint64_t complete_transfers = std::numeric_limits<uint64_t>::max();
+   for( int c = 0; c < column_count; ++c )
+      complete_transfers = std::min<uint64_t>( complete_transfers, fc::file_size( column_path(c) ) / column_sizes[c] );
+
+   uint32_t block_count = fc::file_size( _dbdir / "index" ) / sizeof(block_history_index_entry);
+   uint64_t transfer_count = 0;
+   while( block_count > 0 )
+   {
+      block_history_index_entry last = read_index_entry( block_count - 1 );
+      transfer_count = last.first_transfer + last.transfer_count;
+      if( transfer_count <= complete_transfers )
+         break;
+      --block_count;
+      transfer_count = 0;
+   }
+
+   _file_first_block = block_count > 0 ? read_index_entry( 0 ).block_num : 0;
+   _first_block = _file_first_block;
+   truncate( block_count, transfer_count );
+} FC_CAPTURE_AND_RETHROW( (dbdir) ) }
+
+bool block_history_database::is_open()const
+{
+   return _index.is_open();
+}
+
+void block_history_database::flush()
+{
+   std::lock_guard<std::mutex> lock( _lock );
+   flush_files();
+}
+
+void block_history_database::close()
+{
+   std::lock_guard<std::mutex> lock( _lock );
+   close_files();
+}
+
+void block_history_database::store( uint32_t block_num, const block_history_info& info )
+{ try {
+   std::lock_guard<std::mutex> lock( _lock );
+   FC_ASSERT( block_num > 0 );
+
+   if( _block_count > 0 && block_num < _first_block )
+      truncate( 0, 0 );
+   else if( _block_count > 0 && block_num < _file_first_block + _block_count )
+   {
+      // the block is applied again, forget it and everything after it
+      uint32_t position = block_num - _file_first_block;
+      truncate( position, read_index_entry( position ).first_transfer );
+   }
+
+   if( _block_count == 0 )
+   {
+      _file_first_block = block_num;
+      _first_block = block_num;
+   }
+
+   block_history_index_entry entry;
+   entry.first_transfer = _transfer_count;
+
+   // blocks which were lost in a crash are kept as empty ones
+   while( _file_first_block + _block_count < block_num )
+   {
+      entry.block_num = _file_first_block + _block_count;
+      write_value( _index, entry );
+      ++_block_count;
+   }
+
+   entry.block_num = block_num;
+   entry.transfer_count = info.transfers.size();
+   entry.transaction_amount_threshold = info.transaction_amount_threshold;
+   entry.account_amount_threshold = info.account_amount_threshold;
+   entry.token_usd_rate = info.token_usd_rate;
+   write_value( _index, entry );
+
+   for( const auto& t : info.transfers )
+   {
+      write_value( _columns[source_account_column], t.source_account );
+      write_value( _columns[target_account_column], t.target_account );
+      write_value( _columns[amount_column], t.amount );
+      write_value( _columns[comission_column], t.comission );
+      write_value( _columns[source_account_balance_column], t.source_account_balance );
+      write_value( _columns[target_account_balance_column], t.target_account_balance );
+      write_value( _columns[timestamp_column], t.timestamp );
+   }
+
+   ++_block_count;
+   _transfer_count += info.transfers.size();
+} FC_CAPTURE_AND_RETHROW( (block_num) ) }
+
+optional<block_history_info> block_history_database::fetch( uint32_t block_num )const
+{
+   optional<block_history_info> result;
+   for_each_block( block_num, block_num, [&]( uint32_t, const block_history_info& info ) {
+      result = info;
+   });
+   return result;
+}
+
+void block_history_database::for_each_block( uint32_t first_block_num, uint32_t last_block_num,
+                                             const block_visitor& visitor )const
+{ try {
+   // the blocks are copied out under the lock a chunk at a time and visited without it, a fork or a
+   // compaction between two chunks only makes the next one map the files again
+   const uint32_t chunk_size = 256;
+   std::unique_ptr<mapped_file> index;
+   std::vector<std::unique_ptr<mapped_file>> columns;
+   uint64_t generation = 0;
+   uint32_t mapped_blocks = 0;
+   std::vector<block_history_info> chunk;
+
+   {
+      std::lock_guard<std::mutex> lock( _lock );
+      if( _block_count == 0 )
+         return;
+      last_block_num = std::min( last_block_num, _file_first_block + _block_count - 1 );
+   }
+
+   uint32_t block_num = first_block_num;
+   while( block_num <= last_block_num )
+   {
+      uint32_t chunk_first;
+      uint32_t chunk_last;
+      {
+         std::lock_guard<std::mutex> lock( _lock );
+         if( _block_count == 0 )
+            return;
+
+         // pruned blocks are skipped, the ones dropped by a fork are not there any more
+         chunk_first = std::max( block_num, _first_block );
+         chunk_last = std::min( last_block_num, _file_first_block + _block_count - 1 );
+         if( chunk_first > chunk_last )
+            return;
+         chunk_last = chunk_first + std::min( chunk_size - 1, chunk_last - chunk_first );
+
+         if( generation != _generation || chunk_last - _file_first_block >= mapped_blocks )
+         {
+            flush_files();
+            generation = _generation;
+            mapped_blocks = _block_count;
+            index.reset( new mapped_file( _dbdir / "index", uint64_t(_block_count) * sizeof(block_history_index_entry) ) );
+            columns.clear();
+            for( int c = 0; c < column_count; ++c )
+               columns.emplace_back( new mapped_file( column_path(c), _transfer_count * column_sizes[c] ) );
+         }
+
+         chunk.resize( chunk_last - chunk_first + 1 );
+         for( uint32_t i = 0; i < chunk.size(); ++i )
+         {
+            block_history_index_entry entry;
+            read_value( entry, index->data(), chunk_first + i - _file_first_block );
+
+            block_history_info& info = chunk[i];
+            info.transaction_amount_threshold = entry.transaction_amount_threshold;
+            info.account_amount_threshold = entry.account_amount_threshold;
+            info.token_usd_rate = entry.token_usd_rate;
+            info.transfers.resize( entry.transfer_count );
+
+            for( uint32_t t = 0; t < entry.transfer_count; ++t )
+            {
+               uint64_t position = entry.first_transfer + t;
+               block_history_transfer& transfer = info.transfers[t];
+               read_value( transfer.source_account, columns[source_account_column]->data(), position );
+               read_value( transfer.target_account, columns[target_account_column]->data(), position );
+               read_value( transfer.amount, columns[amount_column]->data(), position );
+               read_value( transfer.comission, columns[comission_column]->data(), position );
+               read_value( transfer.source_account_balance, columns[source_account_balance_column]->data(), position );
+               read_value( transfer.target_account_balance, columns[target_account_balance_column]->data(), position );
+               read_value( transfer.timestamp, columns[timestamp_column]->data(), position );
+            }
+         }
+      }
+
+      for( uint32_t i = 0; i < chunk.size(); ++i )
+         visitor( chunk_first + i, chunk[i] );
+
+      block_num = chunk_last + 1;
+   }
+} FC_CAPTURE_AND_RETHROW( (first_block_num)(last_block_num) ) }
+
+void block_history_database::prune( uint32_t first_block_num )
+{ try {
+   std::lock_guard<std::mutex> lock( _lock );
+   if( _block_count == 0 || first_block_num <= _first_block )
+      return;
+
+   if( first_block_num >= _file_first_block + _block_count )
+   {
+      truncate( 0, 0 );
+      return;
+   }
+
+   _first_block = first_block_num;
+   uint32_t dead_blocks = _first_block - _file_first_block;
+   if( dead_blocks >= _block_count - dead_blocks )
+      compact();
+} FC_CAPTURE_AND_RETHROW( (first_block_num) ) }
+
+uint32_t block_history_database::first_block_num()const
+{
+   std::lock_guard<std::mutex> lock( _lock );
+   return _block_count > 0 ? _first_block : 0;
+}
+
+uint32_t block_history_database::last_block_num()const
+{
+   std::lock_guard<std::mutex> lock( _lock );
+   return _block_count > 0 ? _file_first_block + _block_count - 1 : 0;
+}
+
+fc::path block_history_database::column_path( int column )const
+{
+   return _dbdir / column_names[column];
+}
+
+void block_history_database::open_files()
+{
+   _index.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+   _index.open( (_dbdir / "index").generic_string().c_str(), std::ofstream::binary | std::ofstream::app );
+   for( int c = 0; c < column_count; ++c )
+   {
+      _columns[c].exceptions( std::ios_base::failbit | std::ios_base::badbit );
+      _columns[c].open( column_path(c).generic_string().c_str(), std::ofstream::binary | std::ofstream::app );
+   }
+}
+
+void block_history_database::close_files()
+{
+   if( _index.is_open() )
+      _index.close();
+   for( int c = 0; c < column_count; ++c )
+      if( _columns[c].is_open() )
+         _columns[c].close();
+}
+
+void block_history_database::flush_files()const
+{
+   _index.flush();
+   for( int c = 0; c < column_count; ++c )
+      _columns[c].flush();
+}
+
+void block_history_database::truncate( uint32_t block_count, uint64_t transfer_count )
+{
+   close_files();
+   boost::filesystem::resize_file( (_dbdir / "index").generic_string(),
+                                   uint64_t(block_count) * sizeof(block_history_index_entry) );
+   for( int c = 0; c < column_count; ++c )
+      boost::filesystem::resize_file( column_path(c).generic_string(), transfer_count * column_sizes[c] );
+   open_files();
+
+   _block_count = block_count;
+   _transfer_count = transfer_count;
+   ++_generation;
+   if( _block_count == 0 )
+   {
+      _file_first_block = 0;
+      _first_block = 0;
+   }
+}
+
+void block_history_database::compact()
+{
+   flush_files();
+   uint32_t dead_blocks = _first_block - _file_first_block;
+   uint32_t block_count = _block_count - dead_blocks;
+   uint64_t dead_transfers = read_index_entry( dead_blocks ).first_transfer;
+   uint64_t transfer_count = _transfer_count - dead_transfers;
+
+   {
+      mapped_file index( _dbdir / "index", uint64_t(_block_count) * sizeof(block_history_index_entry) );
+      std::ofstream out( (_dbdir / "index.tmp").generic_string().c_str(), std::ofstream::binary | std::ofstream::trunc );
+      for( uint32_t i = dead_blocks; i < _block_count; ++i )
+      {
+         block_history_index_entry entry;
+         read_value( entry, index.data(), i );
+         entry.first_transfer -= dead_transfers;
+         write_value( out, entry );
+      }
+   }
+   for( int c = 0; c < column_count; ++c )
+   {
+      mapped_file column( column_path(c), _transfer_count * column_sizes[c] );
+      std::ofstream out( (column_path(c).generic_string() + ".tmp").c_str(), std::ofstream::binary | std::ofstream::trunc );
+      if( transfer_count > 0 )
+         out.write( column.data() + dead_transfers * column_sizes[c], transfer_count * column_sizes[c] );
+   }
+
+   close_files();
+   fc::rename( _dbdir / "index.tmp", _dbdir / "index" );
+   for( int c = 0; c < column_count; ++c )
+      fc::rename( column_path(c).generic_string() + ".tmp", column_path(c) );
+   open_files();
+
+   _file_first_block = _first_block;
+   _block_count = block_count;
+   _transfer_count = transfer_count;
+   ++_generation;
+}
+
+block_history_index_entry block_history_database::read_index_entry( uint32_t position )const
+{
+   if( _index.is_open() )
+      _index.flush();
+
+   block_history_index_entry entry;
+   std::ifstream index( (_dbdir / "index").generic_string().c_str(), std::ifstream::binary );
+   index.exceptions( std::ios_base::failbit | std::ios_base::badbit );
+   index.seekg( uint64_t(position) * sizeof(block_history_index_entry) );
+   index.read( (char*)&entry, sizeof(entry) );
+   return entry;
+}
+
+} }
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/block_prefetcher.hpp>
+
+namespace graphene { namespace chain {
+
+block_prefetcher::block_prefetcher( const block_database& blocks, uint32_t first, uint32_t last,
+                                    size_t num_threads, size_t window )
+:_blocks(blocks),_last(last),_slots(window),_errors(window),_ready(window, false),_next_claim(first),_next_take(first)
+{
+   FC_ASSERT( window > 0 );
+   if( last < first )
+      return;
+   num_threads = std::min<size_t>( num_threads, last - first + 1 );
+   for( size_t i = 0; i < num_threads; ++i )
+      _workers.emplace_back( [this]() { work(); } );
+}
+
+block_prefetcher::~block_prefetcher()
+{
+   stop();
+}
+
+void block_prefetcher::stop()
+{
+   {
+      std::lock_guard<std::mutex> lock( _lock );
+      _stopped = true;
+   }
+   _changed.notify_all();
+   for( auto& worker : _workers )
+      worker.join();
+   _workers.clear();
+}
+
+void block_prefetcher::work()
+{
+   while( true )
+   {
+      uint32_t block_num;
+      {
+         std::unique_lock<std::mutex> lock( _lock );
+         // stay within the window, the slot of a block is free once the block before it is taken
+         _changed.wait( lock, [&]() {
+            return _stopped || _next_claim > _last || _next_claim < _next_take + _slots.size();
+         });
+         if( _stopped || _next_claim > _last )
+            return;
+         block_num = _next_claim++;
+      }
+
+      prefetched_block result;
+      std::exception_ptr error;
+      try
+      {
+         result.block = _blocks.fetch_by_number( block_num );
+         if( result.block.valid() )
+            result.merkle_checked = result.block->transaction_merkle_root == result.block->calculate_merkle_root();
+      }
+      catch( ... )
+      {
+         // handed to the apply loop, which fails the same way a read on its own thread would
+         error = std::current_exception();
+      }
+
+      {
+         std::lock_guard<std::mutex> lock( _lock );
+         size_t slot = block_num % _slots.size();
+         _slots[slot] = std::move( result );
+         _errors[slot] = error;
+         _ready[slot] = true;
+      }
+      _changed.notify_all();
+   }
+}
+
+block_prefetcher::prefetched_block block_prefetcher::take( uint32_t block_num )
+{
+   FC_ASSERT( block_num == _next_take && block_num <= _last, "Blocks are taken in order", ("block_num", block_num)("next", _next_take) );
+   size_t slot = block_num % _slots.size();
+
+   std::unique_lock<std::mutex> lock( _lock );
+   _changed.wait( lock, [&]() { return _ready[slot] || _stopped; } );
+   FC_ASSERT( _ready[slot], "Prefetcher was stopped" );
+
+   prefetched_block result = std::move( _slots[slot] );
+   std::exception_ptr error = _errors[slot];
+   _slots[slot] = prefetched_block();
+   _errors[slot] = nullptr;
+   _ready[slot] = false;
+   ++_next_take;
+   lock.unlock();
+   _changed.notify_all();
+   if( error )
+      std::rethrow_exception( error );
+   return result;
+}
+
+} }
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/block_prevalidation.hpp>
+
+#include <atomic>
+
+namespace graphene { namespace chain {
+
+namespace {
+   /// waking the pool costs about as much as checking a few transactions
+   const size_t min_transactions_per_thread = 4;
+}
+
+prevalidated_transaction prevalidate_transaction( const precomputed_transaction& trx, bool recover_keys )
+{
+   prevalidated_transaction result;
+   try
+   {
+      trx.validate();
+   }
+   catch( ... )
+   {
+      result.validate_error = std::current_exception();
+   }
+   result.id = trx.id();
+   if( recover_keys )
+   {
+      try
+      {
+         result.signature_keys = trx.get().recover_signature_keys( trx.sig_digest() );
+      }
+      catch( ... )
+      {
+         result.keys_error = std::current_exception();
+      }
+      result.keys_recovered = true;
+   }
+   return result;
+}
+
+prevalidated_block prevalidate_block( const signed_block& block, const chain_id_type& chain_id,
+                                      bool recover_keys, bool check_merkle_root, thread_pool* pool )
+{
+   const auto& transactions = block.transactions;
+   prevalidated_block result;
+   result.transactions.resize( transactions.size() );
+   vector<digest_type> merkle_digests( check_merkle_root ? transactions.size() : 0 );
+
+   std::atomic<size_t> next( 0 );
+   auto work = [&]() {
+      // transactions are claimed one at a time, their cost varies with the operations and signatures
+      for( size_t i = next++; i < transactions.size(); i = next++ )
+      {
+         const processed_transaction& trx = transactions[i];
+         prevalidated_transaction& pre = result.transactions[i];
+         try
+         {
+            trx.validate();
+         }
+         catch( ... )
+         {
+            pre.validate_error = std::current_exception();
+         }
+         pre.id = trx.id();
+         if( recover_keys )
+         {
+            try
+            {
+               pre.signature_keys = trx.get_signature_keys( chain_id );
+            }
+            catch( ... )
+            {
+               pre.keys_error = std::current_exception();
+            }
+            pre.keys_recovered = true;
+         }
+         if( check_merkle_root )
+            merkle_digests[i] = trx.merkle_digest();
+      }
+   };
+
+   const size_t num_tasks = pool ? std::min( pool->size(), transactions.size() / min_transactions_per_thread ) : 0;
+   if( num_tasks > 1 )
+      pool->run( num_tasks, [&]( size_t ) { work(); } );
+   else
+      work();
+
+   if( check_merkle_root )
+      result.merkle_checked = block.transaction_merkle_root == signed_block::merkle_root( std::move( merkle_digests ) );
+   return result;
+}
+
+} }
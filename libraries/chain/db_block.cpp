@@ -67,19 +67,66 @@ optional<signed_block> database::fetch_block_by_id( const block_id_type& id )con
    auto b = _fork_db.fetch_block( id );
    if( !b )
       return _block_id_to_block.fetch_optional(id);
-   return b->data;
+   if( b->data )
+      return *b->data;
+   return _block_id_to_block.fetch_stored( b->stored );
 }
 
 optional<signed_block> database::fetch_block_by_number( uint32_t num )const
 {
    auto results = _fork_db.fetch_block_by_number(num);
-   if( results.size() == 1 )
-      return results[0]->data;
+   if( results.size() == 1 && results[0]->data )
+      return *results[0]->data;
+   else if( results.size() == 1 )
+      return _block_id_to_block.fetch_stored( results[0]->stored );
    else
       return _block_id_to_block.fetch_by_number(num);
    return optional<signed_block>();
 }
 
+signed_block database::fetch_fork_block( const fork_item& item )const
+{
+   if( item.data )
+      return *item.data;
+   optional<signed_block> b = _block_id_to_block.fetch_stored( item.stored );
+   FC_ASSERT( b.valid(), "Block ${id} of the fork database can not be read", ("id", item.id) );
+   return *b;
+}
+
+void database::checkpoint_if_due()
+{
+   // a replay saves its state itself, it tracks no changes
+   if( _checkpoint_interval == 0 || !tracks_changes() )
+      return;
+   const uint32_t last_irreversible = get_dynamic_global_properties().last_irreversible_block_num;
+   if( last_irreversible < _last_checkpoint_block + _checkpoint_interval )
+      return;
+   // the saved state must not be ahead of the blocks on the disk
+   _block_id_to_block.flush();
+   object_database::checkpoint();
+   _last_checkpoint_block = last_irreversible;
+}
+
+thread_pool& database::worker_pool()
+{
+   if( !_worker_pool )
+      _worker_pool.reset( new thread_pool() );
+   return *_worker_pool;
+}
+
+void database::compact_blocks()
+{
+   // a replaced block is dropped from the blocks file, the others are found through the index afterwards
+   for( const item_ptr& item : _fork_db.fetch_stored_blocks() )
+      if( !_block_id_to_block.contains( item->id ) )
+      {
+         item->data = std::make_shared<const signed_block>( fetch_fork_block( *item ) );
+         item->stored = index_entry();
+      }
+   // a few batches at a time, so archiving a long chain for the first time does not hold up a block
+   _block_id_to_block.compact( get_dynamic_global_properties().last_irreversible_block_num, 2 );
+}
+
 const signed_transaction& database::get_recent_transaction(const transaction_id_type& trx_id) const
 {
    auto& index = get_index_type<transaction_index>().indices().get<by_trx_id>();
@@ -138,28 +185,29 @@ bool database::_push_block(const signed_block& new_block)
 
       shared_ptr<fork_item> new_head = _fork_db.push_block(new_block);
       //If the head block from the longest chain does not build off of the current head, we need to switch forks.
-      if( new_head->data.previous != head_block_id() )
+      if( new_head->previous_id() != head_block_id() )
       {
          //If the newly pushed block is the same height as head, we get head back in new_head
          //Only switch forks if new_head is actually higher than head
-         if( new_head->data.block_num() > head_block_num() )
+         if( new_head->num > head_block_num() )
          {
-            wlog( "Switching to fork: ${id}", ("id",new_head->data.id()) );
-            auto branches = _fork_db.fetch_branch_from(new_head->data.id(), head_block_id());
+            wlog( "Switching to fork: ${id}", ("id",new_head->id) );
+            auto branches = _fork_db.fetch_branch_from(new_head->id, head_block_id());
 
             // pop blocks until we hit the forked block
-            while( head_block_id() != branches.second.back()->data.previous )
+            while( head_block_id() != branches.second.back()->previous_id() )
                pop_block();
 
             // push all blocks on the new fork
             for( auto ritr = branches.first.rbegin(); ritr != branches.first.rend(); ++ritr )
             {
-                ilog( "pushing blocks from fork ${n} ${id}", ("n",(*ritr)->data.block_num())("id",(*ritr)->data.id()) );
+                ilog( "pushing blocks from fork ${n} ${id}", ("n",(*ritr)->num)("id",(*ritr)->id) );
                 optional<fc::exception> except;
                 try {
                    undo_database::session session = _undo_db.start_undo_session();
-                   apply_block( (*ritr)->data, skip );
-                   _block_id_to_block.store( (*ritr)->id, (*ritr)->data );
+                   signed_block fork_block = fetch_fork_block( **ritr );
+                   apply_block( fork_block, skip );
+                   _fork_db.set_stored( (*ritr)->id, _block_id_to_block.store( (*ritr)->id, fork_block ) );
                    session.commit();
                 }
                 catch ( const fc::exception& e ) { except = e; }
@@ -169,21 +217,22 @@ bool database::_push_block(const signed_block& new_block)
                    // remove the rest of branches.first from the fork_db, those blocks are invalid
                    while( ritr != branches.first.rend() )
                    {
-                      _fork_db.remove( (*ritr)->data.id() );
+                      _fork_db.remove( (*ritr)->id );
                       ++ritr;
                    }
                    _fork_db.set_head( branches.second.front() );
 
                    // pop all blocks from the bad fork
-                   while( head_block_id() != branches.second.back()->data.previous )
+                   while( head_block_id() != branches.second.back()->previous_id() )
                       pop_block();
 
                    // restore all blocks from the good fork
                    for( auto ritr = branches.second.rbegin(); ritr != branches.second.rend(); ++ritr )
                    {
                       auto session = _undo_db.start_undo_session();
-                      apply_block( (*ritr)->data, skip );
-                      _block_id_to_block.store( new_block.id(), (*ritr)->data );
+                      signed_block good_block = fetch_fork_block( **ritr );
+                      apply_block( good_block, skip );
+                      _fork_db.set_stored( (*ritr)->id, _block_id_to_block.store( (*ritr)->id, good_block ) );
                       session.commit();
                    }
                    throw *except;
@@ -198,13 +247,25 @@ bool database::_push_block(const signed_block& new_block)
    try {
       auto session = _undo_db.start_undo_session();
       apply_block(new_block, skip);
-      _block_id_to_block.store(new_block.id(), new_block);
+      index_entry stored = _block_id_to_block.store(new_block.id(), new_block);
+      // the fork database reads the block back from here from now on
+      if( !(skip&skip_fork_db) )
+         _fork_db.set_stored( stored.block_id, stored );
       session.commit();
    } catch ( const fc::exception& e ) {
       elog("Failed to push new block:\n${e}", ("e", e.to_detail_string()));
       _fork_db.remove(new_block.id());
       throw;
    }
+   try
+   {
+      compact_blocks();
+   }
+   catch ( const fc::exception& e )
+   {
+      wlog( "Archiving blocks failed: ${e}", ("e", e) );
+   }
+   checkpoint_if_due();
 
    return false;
 } FC_CAPTURE_AND_RETHROW( (new_block) ) }
@@ -228,7 +289,20 @@ processed_transaction database::push_transaction( const signed_transaction& trx,
    return result;
 } FC_CAPTURE_AND_RETHROW( (trx) ) }
 
-processed_transaction database::_push_transaction( const signed_transaction& trx )
+processed_transaction database::push_transaction( const precomputed_transaction& trx, uint32_t skip )
+{ try {
+   processed_transaction result;
+   detail::with_skip_flags( *this, skip, [&]()
+   {
+      FC_ASSERT( trx.chain_id() == get_chain_id() );
+      prevalidated_transaction prevalidated = prevalidate_transaction( trx,
+         !(get_node_properties().skip_flags & (skip_transaction_signatures | skip_authority_check)) );
+      result = _push_transaction( trx.get(), &prevalidated );
+   } );
+   return result;
+} FC_CAPTURE_AND_RETHROW( (trx.get()) ) }
+
+processed_transaction database::_push_transaction( const signed_transaction& trx, const prevalidated_transaction* prevalidated )
 {
    // If this is the first transaction pushed after applying a block, start a new undo session.
    // This allows us to quickly rewind to the clean state of the head block, in case a new block arrives.
@@ -241,7 +315,7 @@ processed_transaction database::_push_transaction( const signed_transaction& trx
    // apply the changes.
 
    auto temp_session = _undo_db.start_undo_session();
-   auto processed_trx = _apply_transaction( trx );
+   auto processed_trx = _apply_transaction( trx, prevalidated );
    _pending_tx.push_back(processed_trx);
 
    // notify_changed_objects();
@@ -488,16 +562,21 @@ void database::apply_block( const signed_block& next_block, uint32_t skip )
 
 void database::_apply_block( const signed_block& next_block )
 {
-   std::cout << "apply_block " << next_block.block_num() << std::endl;
+   _log.write_text( "chain.log", "apply_block ", next_block.block_num() );
 
    try {
    uint32_t next_block_num = next_block.block_num();
    uint32_t skip = get_node_properties().skip_flags;
   _applied_ops.clear();
 
-   FC_ASSERT( (skip & skip_merkle_check) || next_block.transaction_merkle_root == next_block.calculate_merkle_root(), "", ("next_block.transaction_merkle_root",next_block.transaction_merkle_root)("calc",next_block.calculate_merkle_root())("next_block",next_block)("id",next_block.id()) );
-
    const witness_object& signing_witness = validate_block_header(skip, next_block);
+
+   // the checks which do not depend on the chain state run ahead of the apply loop, the signatures
+   // are recovered on the pool, replays skip them and leave the cores to the block prefetcher
+   const bool recover_keys = !(skip & (skip_transaction_signatures | skip_authority_check));
+   prevalidated_block prevalidated = prevalidate_block( next_block, get_chain_id(), recover_keys, !(skip & skip_merkle_check),
+                                                        recover_keys ? &worker_pool() : nullptr );
+   FC_ASSERT( (skip & skip_merkle_check) || prevalidated.merkle_checked, "", ("next_block.transaction_merkle_root",next_block.transaction_merkle_root)("calc",next_block.calculate_merkle_root())("next_block",next_block)("id",next_block.id()) );
    const auto& global_props = get_global_properties();
    const auto& dynamic_global_props = get<dynamic_global_property_object>(dynamic_global_property_id_type());
    bool maint_needed = (dynamic_global_props.next_maintenance_time <= next_block.timestamp);
@@ -513,7 +592,7 @@ void database::_apply_block( const signed_block& next_block )
        * for transactions when validating broadcast transactions or
        * when building a block.
        */
-      apply_transaction( trx, skip );
+      _apply_transaction( trx, &prevalidated.transactions[_current_trx_in_block] );
       ++_current_trx_in_block;
    }
 
@@ -564,6 +643,7 @@ void database::_apply_block( const signed_block& next_block )
        activity_save_results();
 
         _last_activity_processing_block = _current_activity_processing_block;
+        clear_old_block_history();
     }
 
     //emission triggers
@@ -594,6 +674,7 @@ void database::_apply_block( const signed_block& next_block )
        emission_save_results();
 
        _last_emission_processing_block = _current_emission_processing_block;
+       clear_old_block_history();
     }
    
    // n.b., update_maintenance_flag() happens this late
@@ -623,16 +704,21 @@ processed_transaction database::apply_transaction(const signed_transaction& trx,
    return result;
 }
 
-processed_transaction database::_apply_transaction(const signed_transaction& trx)
+processed_transaction database::_apply_transaction(const signed_transaction& trx, const prevalidated_transaction* prevalidated)
 { try {
    uint32_t skip = get_node_properties().skip_flags;
 
-   if( true || !(skip&skip_validate) )   /* issue #505 explains why this skip_flag is disabled */
+   if( prevalidated )
+   {
+      if( prevalidated->validate_error )
+         std::rethrow_exception( prevalidated->validate_error );
+   }
+   else if( true || !(skip&skip_validate) )   /* issue #505 explains why this skip_flag is disabled */
       trx.validate();
 
    auto& trx_idx = get_mutable_index_type<transaction_index>();
    const chain_id_type& chain_id = get_chain_id();
-   auto trx_id = trx.id();
+   auto trx_id = prevalidated ? prevalidated->id : trx.id();
    FC_ASSERT( (skip & skip_transaction_dupe_check) ||
               trx_idx.indices().get<by_trx_id>().find(trx_id) == trx_idx.indices().get<by_trx_id>().end() );
    transaction_evaluation_state eval_state(this);
@@ -643,7 +729,17 @@ processed_transaction database::_apply_transaction(const signed_transaction& trx
    {
       auto get_active = [&]( account_id_type id ) { return &id(*this).active; };
       auto get_owner  = [&]( account_id_type id ) { return &id(*this).owner;  };
-      trx.verify_authority( chain_id, get_active, get_owner, get_global_properties().parameters.max_authority_depth );
+      if( prevalidated && prevalidated->keys_recovered )
+      {
+         if( prevalidated->keys_error )
+            std::rethrow_exception( prevalidated->keys_error );
+         try {
+            graphene::chain::verify_authority( trx.operations, prevalidated->signature_keys, get_active, get_owner,
+                                              get_global_properties().parameters.max_authority_depth );
+         } FC_CAPTURE_AND_RETHROW( (trx) )
+      }
+      else
+         trx.verify_authority( chain_id, get_active, get_owner, get_global_properties().parameters.max_authority_depth );
    }
 
    //Skip all manner of expiration and TaPoS checking if we're on block 1; It's impossible that the transaction is
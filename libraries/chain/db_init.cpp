@@ -226,9 +226,9 @@ void database::initialize_indexes()
    add_index< primary_index<asset_bitasset_data_index                     > >();
    add_index< primary_index<simple_index<global_property_object          >> >();
    add_index< primary_index<simple_index<dynamic_global_property_object  >> >();
-   add_index< primary_index<simple_index<account_statistics_object       >> >();
-   add_index< primary_index<simple_index<asset_dynamic_data_object       >> >();
-   add_index< primary_index<simple_index<block_summary_object            >> >();
+   add_index< primary_index<dense_index<account_statistics_object        >> >();
+   add_index< primary_index<dense_index<asset_dynamic_data_object        >> >();
+   add_index< primary_index<dense_index<block_summary_object             >> >();
    add_index< primary_index<simple_index<chain_property_object          > > >();
    add_index< primary_index<simple_index<witness_schedule_object        > > >();
    add_index< primary_index<simple_index<budget_record_object           > > >();
@@ -49,6 +49,9 @@
 #include <graphene/chain/gravity_transfer_object.hpp>
 #include <graphene/chain/gravity_activity_object.hpp>
 
+#include <exception>
+#include <thread>
+
 namespace graphene { namespace chain {
 
 template<class Index>
@@ -75,12 +78,174 @@ vector<std::reference_wrapper<const typename Index::object_type>> database::sort
    return refs;
 }
 
-template<class... Types>
-void database::perform_account_maintenance(std::tuple<Types...> helpers)
+namespace detail {
+
+   /// The vote tally of the accounts of one tally thread
+   struct vote_tally
+   {
+      explicit vote_tally( const global_property_object& props )
+         : votes( props.next_available_vote_id ),
+           witness_counts( props.parameters.maximum_witness_count / 2 + 1 ),
+           committee_counts( props.parameters.maximum_committee_count / 2 + 1 ) {}
+
+      void add( const global_property_object& props, const account_object& opinion_account, uint64_t voting_stake )
+      {
+         for( vote_id_type id : opinion_account.options.votes )
+         {
+            uint32_t offset = id.instance();
+            // if they somehow managed to specify an illegal offset, ignore it.
+            if( offset < votes.size() )
+               votes[offset] += voting_stake;
+         }
+
+         if( opinion_account.options.num_witness <= props.parameters.maximum_witness_count )
+         {
+            uint16_t offset = std::min(size_t(opinion_account.options.num_witness/2),
+                                       witness_counts.size() - 1);
+            // votes for a number greater than maximum_witness_count
+            // are turned into votes for maximum_witness_count.
+            //
+            // in particular, this takes care of the case where a
+            // member was voting for a high number, then the
+            // parameter was lowered.
+            witness_counts[offset] += voting_stake;
+         }
+         if( opinion_account.options.num_committee <= props.parameters.maximum_committee_count )
+         {
+            uint16_t offset = std::min(size_t(opinion_account.options.num_committee/2),
+                                       committee_counts.size() - 1);
+            // votes for a number greater than maximum_committee_count
+            // are turned into votes for maximum_committee_count.
+            //
+            // same rationale as for witnesses
+            committee_counts[offset] += voting_stake;
+         }
+
+         total_stake += voting_stake;
+      }
+
+      void merge( const vote_tally& other )
+      {
+         for( size_t i = 0; i < votes.size(); ++i )
+            votes[i] += other.votes[i];
+         for( size_t i = 0; i < witness_counts.size(); ++i )
+            witness_counts[i] += other.witness_counts[i];
+         for( size_t i = 0; i < committee_counts.size(); ++i )
+            committee_counts[i] += other.committee_counts[i];
+         total_stake += other.total_stake;
+      }
+
+      vector<uint64_t> votes;
+      vector<uint64_t> witness_counts;
+      vector<uint64_t> committee_counts;
+      uint64_t         total_stake = 0;
+   };
+
+} // detail
+
+void database::set_maintenance_tally_threads( size_t max_threads, size_t min_accounts_per_thread )
+{
+   FC_ASSERT( min_accounts_per_thread > 0 );
+   _tally_max_threads = max_threads;
+   _tally_min_accounts_per_thread = min_accounts_per_thread;
+}
+
+void database::perform_account_maintenance( const global_property_object& props, maintenance_statistics& stats )
 {
    const auto& idx = get_index_type<account_index>().indices().get<by_name>();
+   vector<const account_object*> accounts;
+   accounts.reserve( idx.size() );
    for( const account_object& a : idx )
-      detail::for_each(helpers, a, detail::gen_seq<sizeof...(Types)>());
+      accounts.push_back( &a );
+   stats.accounts = accounts.size();
+
+   const auto now = head_block_time();
+   auto counts_votes = [&]( const account_object& stake_account ) {
+      return props.parameters.count_non_member_votes || stake_account.is_member( now );
+   };
+   // There may be a difference between the account whose stake is voting and the one specifying opinions.
+   // Usually they're the same, but if the stake account has specified a voting_account, that account is the one
+   // specifying the opinions.
+   auto opinion_account_of = [&]( const account_object& stake_account ) -> const account_object& {
+      return stake_account.options.voting_account == GRAPHENE_PROXY_TO_SELF_ACCOUNT ? stake_account
+                                                                                    : get( stake_account.options.voting_account );
+   };
+   auto voting_stake_of = [&]( const account_object& stake_account ) -> uint64_t {
+      const auto& account_stats = stake_account.statistics( *this );
+      return account_stats.total_core_in_orders.value
+             + (stake_account.cashback_vb.valid() ? (*stake_account.cashback_vb)(*this).balance.amount.value: 0)
+             + get_balance( stake_account.get_id(), asset_id_type() ).amount.value;
+   };
+
+   // The tally only reads the database, the accounts are split into ranges tallied on the worker pool.
+   // The sums wrap the same way in any order, so the merged tally is the one of a single thread.
+   auto tally_start = fc::time_point::now();
+   // below _tally_min_accounts_per_thread accounts a range costs more than it saves
+   const size_t max_threads = _tally_max_threads > 0 ? _tally_max_threads : std::thread::hardware_concurrency();
+   size_t num_threads = std::max<size_t>( 1, std::min<size_t>( max_threads, accounts.size() / _tally_min_accounts_per_thread ) );
+   vector<detail::vote_tally> tallies( num_threads, detail::vote_tally( props ) );
+   vector<uint64_t> voting_stakes( accounts.size(), 0 );
+   vector<std::exception_ptr> errors( num_threads );
+   auto tally_range = [&]( size_t t ) {
+      try
+      {
+         size_t end = accounts.size() * (t + 1) / num_threads;
+         for( size_t i = accounts.size() * t / num_threads; i < end; ++i )
+         {
+            const account_object& stake_account = *accounts[i];
+            if( !counts_votes( stake_account ) )
+               continue;
+            voting_stakes[i] = voting_stake_of( stake_account );
+            tallies[t].add( props, opinion_account_of( stake_account ), voting_stakes[i] );
+         }
+      }
+      catch( ... )
+      {
+         errors[t] = std::current_exception();
+      }
+   };
+   if( num_threads > 1 )
+      worker_pool().run( num_threads, tally_range );
+   else
+      tally_range( 0 );
+   for( const auto& error : errors )
+      if( error )
+         std::rethrow_exception( error );
+   for( size_t t = 1; t < num_threads; ++t )
+      tallies[0].merge( tallies[t] );
+   detail::vote_tally& tally = tallies[0];
+   stats.tally_threads = num_threads;
+   stats.tally_time = (fc::time_point::now() - tally_start).count();
+
+   // The fees are paid out in name order. A cashback changes the stake of the account it is paid to, which
+   // used to be tallied right before its own fees, so the stake of a paid account still to come is tallied again.
+   auto fees_start = fc::time_point::now();
+   std::set<account_id_type> paid_accounts;
+   for( size_t i = 0; i < accounts.size(); ++i )
+   {
+      const account_object& a = *accounts[i];
+      if( paid_accounts.count( a.id ) && counts_votes( a ) )
+      {
+         uint64_t voting_stake = voting_stake_of( a );
+         if( voting_stake != voting_stakes[i] )
+            tally.add( props, opinion_account_of( a ), voting_stake - voting_stakes[i] );
+      }
+
+      const auto& account_stats = a.statistics( *this );
+      if( account_stats.pending_fees > 0 || account_stats.pending_vested_fees > 0 )
+      {
+         paid_accounts.insert( a.lifetime_referrer );
+         paid_accounts.insert( a.referrer );
+         paid_accounts.insert( a.registrar );
+      }
+      account_stats.process_fees( a, *this );
+   }
+   stats.fees_time = (fc::time_point::now() - fees_start).count();
+
+   _vote_tally_buffer = std::move( tally.votes );
+   _witness_count_histogram_buffer = std::move( tally.witness_counts );
+   _committee_count_histogram_buffer = std::move( tally.committee_counts );
+   _total_voting_stake = tally.total_stake;
 }
 
 /// @brief A visitor for @ref worker_type which calls pay_worker on the worker within
@@ -820,90 +985,14 @@ void database::process_bids( const asset_bitasset_data_object& bad )
 void database::perform_chain_maintenance(const signed_block& next_block, const global_property_object& global_props)
 {
    const auto& gpo = get_global_properties();
+   maintenance_statistics maintenance;
+   maintenance.block_num = next_block.block_num();
+   auto maintenance_start = fc::time_point::now();
 
    distribute_fba_balances(*this);
    create_buyback_orders(*this);
 
-   struct vote_tally_helper {
-      database& d;
-      const global_property_object& props;
-
-      vote_tally_helper(database& d, const global_property_object& gpo)
-         : d(d), props(gpo)
-      {
-         d._vote_tally_buffer.resize(props.next_available_vote_id);
-         d._witness_count_histogram_buffer.resize(props.parameters.maximum_witness_count / 2 + 1);
-         d._committee_count_histogram_buffer.resize(props.parameters.maximum_committee_count / 2 + 1);
-         d._total_voting_stake = 0;
-      }
-
-      void operator()(const account_object& stake_account) {
-         if( props.parameters.count_non_member_votes || stake_account.is_member(d.head_block_time()) )
-         {
-            // There may be a difference between the account whose stake is voting and the one specifying opinions.
-            // Usually they're the same, but if the stake account has specified a voting_account, that account is the one
-            // specifying the opinions.
-            const account_object& opinion_account =
-                  (stake_account.options.voting_account ==
-                   GRAPHENE_PROXY_TO_SELF_ACCOUNT)? stake_account
-                                     : d.get(stake_account.options.voting_account);
-
-            const auto& stats = stake_account.statistics(d);
-            uint64_t voting_stake = stats.total_core_in_orders.value
-                  + (stake_account.cashback_vb.valid() ? (*stake_account.cashback_vb)(d).balance.amount.value: 0)
-                  + d.get_balance(stake_account.get_id(), asset_id_type()).amount.value;
-
-            for( vote_id_type id : opinion_account.options.votes )
-            {
-               uint32_t offset = id.instance();
-               // if they somehow managed to specify an illegal offset, ignore it.
-               if( offset < d._vote_tally_buffer.size() )
-                  d._vote_tally_buffer[offset] += voting_stake;
-            }
-
-            if( opinion_account.options.num_witness <= props.parameters.maximum_witness_count )
-            {
-               uint16_t offset = std::min(size_t(opinion_account.options.num_witness/2),
-                                          d._witness_count_histogram_buffer.size() - 1);
-               // votes for a number greater than maximum_witness_count
-               // are turned into votes for maximum_witness_count.
-               //
-               // in particular, this takes care of the case where a
-               // member was voting for a high number, then the
-               // parameter was lowered.
-               d._witness_count_histogram_buffer[offset] += voting_stake;
-            }
-            if( opinion_account.options.num_committee <= props.parameters.maximum_committee_count )
-            {
-               uint16_t offset = std::min(size_t(opinion_account.options.num_committee/2),
-                                          d._committee_count_histogram_buffer.size() - 1);
-               // votes for a number greater than maximum_committee_count
-               // are turned into votes for maximum_committee_count.
-               //
-               // same rationale as for witnesses
-               d._committee_count_histogram_buffer[offset] += voting_stake;
-            }
-
-            d._total_voting_stake += voting_stake;
-         }
-      }
-   } tally_helper(*this, gpo);
-   struct process_fees_helper {
-      database& d;
-      const global_property_object& props;
-
-      process_fees_helper(database& d, const global_property_object& gpo)
-         : d(d), props(gpo) {}
-
-      void operator()(const account_object& a) {
-         a.statistics(d).process_fees(a, d);
-      }
-   } fee_helper(*this, gpo);
-
-   perform_account_maintenance(std::tie(
-      tally_helper,
-      fee_helper
-      ));
+   perform_account_maintenance( gpo, maintenance );
 
    struct clear_canary {
       clear_canary(vector<uint64_t>& target): target(target){}
@@ -984,6 +1073,12 @@ void database::perform_chain_maintenance(const signed_block& next_block, const g
    // process_budget needs to run at the bottom because
    //   it needs to know the next_maintenance_time
    process_budget();
+
+   maintenance.total_time = (fc::time_point::now() - maintenance_start).count();
+   _last_maintenance = maintenance;
+   ilog( "Chain maintenance at block ${b} took ${t} us, ${a} accounts tallied in ${v} us on ${n} threads, fees in ${f} us",
+         ("b", maintenance.block_num)("t", maintenance.total_time)("a", maintenance.accounts)
+         ("v", maintenance.tally_time)("n", maintenance.tally_threads)("f", maintenance.fees_time) );
 }
 
 } }
@@ -23,6 +23,7 @@
  */
 
 #include <graphene/chain/database.hpp>
+#include <graphene/chain/block_prefetcher.hpp>
 
 #include <graphene/chain/operation_history_object.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
@@ -38,10 +39,12 @@ namespace graphene { namespace chain {
 
 database::database() : _last_activity_processing_block( 0 ),
                        _last_emission_processing_block( 0 ),
+                       _activity_window( singularity::parameters_t() ),
                        _emission( _emission_parameters, _emission_state )
 {
    initialize_indexes();
    initialize_evaluators();
+   _log.open( async_log_options() );
 }
 
 database::~database()
@@ -66,6 +69,8 @@ void database::reindex( fc::path data_dir )
    uint32_t undo_point = last_block_num < 50 ? 0 : last_block_num - 50;
 
    ilog( "Replaying blocks, starting at ${next}...", ("next",head_block_num() + 1) );
+   // the replay saves the whole state at the flush point, tracking the changes would only cost
+   track_changes( false );
    if( head_block_num() >= undo_point )
    {
       if( head_block_num() > 0 )
@@ -73,18 +78,36 @@ void database::reindex( fc::path data_dir )
    }
    else
       _undo_db.disable();
+   // the blocks applied without undo are read and checked ahead on other threads,
+   // the last ones are pushed and stored again, so they are read here
+   block_prefetcher prefetcher( _block_id_to_block, head_block_num() + 1,
+                               undo_point > 0 ? std::min( last_block_num, undo_point - 1 ) : 0 );
+   auto reader = _block_id_to_block.read_from( std::max( head_block_num() + 1, undo_point ) );
    for( uint32_t i = head_block_num() + 1; i <= last_block_num; ++i )
    {
       if( i % 10000 == 0 ) std::cerr << "   " << double(i*100)/last_block_num << "%   "<<i << " of " <<last_block_num<<"   \n";
       if( i == flush_point )
       {
          ilog( "Writing database to disk at block ${i}", ("i",i) );
-         flush();
+         checkpoint();
          ilog( "Done" );
       }
-      fc::optional< signed_block > block = _block_id_to_block.fetch_by_number(i);
+      fc::optional< signed_block > block;
+      bool merkle_checked = false;
+      if( i < undo_point )
+      {
+         auto prefetched = prefetcher.take( i );
+         block = std::move( prefetched.block );
+         merkle_checked = prefetched.merkle_checked;
+      }
+      else
+      {
+         prefetcher.stop();
+         block = reader.next();
+      }
       if( !block.valid() )
       {
+         prefetcher.stop();
          wlog( "Reindexing terminated due to gap:  Block ${i} does not exist!", ("i", i) );
          uint32_t dropped_count = 0;
          while( true )
@@ -108,7 +131,8 @@ void database::reindex( fc::path data_dir )
                              skip_transaction_dupe_check |
                              skip_tapos_check |
                              skip_witness_schedule_check |
-                             skip_authority_check);
+                             skip_authority_check |
+                             ( merkle_checked ? skip_merkle_check : 0 ));
       else
       {
          _undo_db.enable();
@@ -121,10 +145,25 @@ void database::reindex( fc::path data_dir )
       }
    }
    _undo_db.enable();
+   track_changes( _checkpoint_interval > 0 );
+   _last_checkpoint_block = get_dynamic_global_properties().last_irreversible_block_num;
    auto end = fc::time_point::now();
    ilog( "Done reindexing, elapsed time: ${t} sec", ("t",double((end-start).count())/1000000.0 ) );
+
+   prefetcher.stop();
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
 
+void database::configure_logs( const async_log_options& options )
+{
+   _log.open( options );
+}
+
+void database::set_checkpoint_interval( uint32_t blocks )
+{
+   _checkpoint_interval = blocks;
+   track_changes( blocks > 0 );
+}
+
 void database::wipe(const fc::path& data_dir, bool include_blocks)
 {
    ilog("Wiping database", ("include_blocks", include_blocks));
@@ -162,9 +201,11 @@ void database::open(
       object_database::open(data_dir);
 
       _block_id_to_block.open(data_dir / "database" / "block_num_to_block");
+      _block_history.open(data_dir / "database" / "block_history");
 
       if( !find(global_property_id_type()) )
          init_genesis(genesis_loader());
+      _last_checkpoint_block = get_dynamic_global_properties().last_irreversible_block_num;
 
       fc::optional<block_id_type> last_block = _block_id_to_block.last_id();
       if( last_block.valid() )
@@ -210,13 +251,17 @@ void database::close(bool rewind)
    // DB state (issue #336).
    clear_pending();
 
-   object_database::flush();
+   object_database::checkpoint();
    object_database::close();
 
    if( _block_id_to_block.is_open() )
       _block_id_to_block.close();
 
+   if( _block_history.is_open() )
+      _block_history.close();
+
    _fork_db.reset();
+   _log.flush();
 }
 
 } }
@@ -372,12 +372,14 @@ void database::notify_changed_objects()
       // New
       if( !new_objects.empty() )
       {
-        vector<object_id_type> new_ids;  new_ids.reserve(head_undo.new_ids.size());
+        vector<object_id_type> new_ids;  new_ids.reserve(head_undo.entries().size());
         flat_set<account_id_type> new_accounts_impacted;
-        for( const auto& item : head_undo.new_ids )
+        for( const auto& item : head_undo.entries() )
         {
-          new_ids.push_back(item);
-          auto obj = find_object(item);
+          if( item.kind != undo_entry::created )
+            continue;
+          new_ids.push_back(item.id);
+          auto obj = find_object(item.id);
           if(obj != nullptr)
             get_relevant_accounts(obj, new_accounts_impacted);
         }
@@ -388,12 +390,14 @@ void database::notify_changed_objects()
       // Changed
       if( !changed_objects.empty() )
       {
-        vector<object_id_type> changed_ids;  changed_ids.reserve(head_undo.old_values.size());
+        vector<object_id_type> changed_ids;  changed_ids.reserve(head_undo.entries().size());
         flat_set<account_id_type> changed_accounts_impacted;
-        for( const auto& item : head_undo.old_values )
+        for( const auto& item : head_undo.entries() )
         {
-          changed_ids.push_back(item.first);
-          get_relevant_accounts(item.second.get(), changed_accounts_impacted);
+          if( item.kind != undo_entry::modified )
+            continue;
+          changed_ids.push_back(item.id);
+          get_relevant_accounts(item.value, changed_accounts_impacted);
         }
 
         changed_objects(changed_ids, changed_accounts_impacted);
@@ -402,13 +406,15 @@ void database::notify_changed_objects()
       // Removed
       if( !removed_objects.empty() )
       {
-        vector<object_id_type> removed_ids; removed_ids.reserve( head_undo.removed.size() );
-        vector<const object*> removed; removed.reserve( head_undo.removed.size() );
+        vector<object_id_type> removed_ids; removed_ids.reserve( head_undo.entries().size() );
+        vector<const object*> removed; removed.reserve( head_undo.entries().size() );
         flat_set<account_id_type> removed_accounts_impacted;
-        for( const auto& item : head_undo.removed )
+        for( const auto& item : head_undo.entries() )
         {
-          removed_ids.emplace_back( item.first );
-          auto obj = item.second.get();
+          if( item.kind != undo_entry::removed )
+            continue;
+          removed_ids.emplace_back( item.id );
+          auto obj = item.value;
           removed.emplace_back( obj );
           get_relevant_accounts(obj, removed_accounts_impacted);
         }
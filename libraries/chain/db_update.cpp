@@ -484,29 +484,31 @@ void database::collect_block_data(const signed_block& next_block)
 {
     uint32_t next_block_num = next_block.block_num();
 
-    //erase value for this block, to prevent influence from another fork
-    if(_block_history.find(next_block_num) != _block_history.end())
-        _block_history.erase(next_block_num);
-
     //save the threshold settings
-    _block_history[next_block_num].transaction_amount_threshold =
-            get_global_properties().parameters.transaction_amount_threshold;
-    _block_history[next_block_num].account_amount_threshold =
-            get_global_properties().parameters.account_amount_threshold;
-    _block_history[next_block_num].token_usd_rate = 0.1;
+    block_history_info block;
+    block.transaction_amount_threshold = get_global_properties().parameters.transaction_amount_threshold;
+    block.account_amount_threshold = get_global_properties().parameters.account_amount_threshold;
+    block.token_usd_rate = 0.1;
 
+    //log saved info
+    _log.write_text( "block_info.log", "block ", next_block_num, " params (",
+                     block.transaction_amount_threshold, ";",
+                     block.account_amount_threshold, ";",
+                     block.token_usd_rate, ")" );
 
     //find all transfer operations
-    map<std::string, bool> processed_transactions;
+    //only the first transfer of a transaction is recorded
+    std::set<transaction_id_type> processed_transactions;
     for( const auto& trx : next_block.transactions )
     {
+        optional<transaction_id_type> trx_id;
         for( int i = 0; i < trx.operations.size(); i++ )
             if( trx.operations[i].which() == operation::tag< transfer_operation >::value )
             {
-                auto it = processed_transactions.find( trx.id().str() );
-                if( it == processed_transactions.end() )
+                if( !trx_id.valid() )
+                    trx_id = trx.id();
+                if( processed_transactions.insert( *trx_id ).second )
                 {
-                    processed_transactions[trx.id().str()] = true;
 
                     transfer_operation tr = trx.operations[i].get<transfer_operation>();
 
@@ -515,48 +517,46 @@ void database::collect_block_data(const signed_block& next_block)
                     const account_object& to_account = get( tr.to );
                     const asset_object& asset_type = get( tr.amount.asset_id );
 
-                    //add the transaction in transaction_t format
-                    _block_history[next_block_num].transactions.push_back(
-                            { asset_type.amount_to_real( tr.amount.amount ),
-                              asset_type.amount_to_real( tr.fee.amount ),
-                              from_account.name,
-                              to_account.name,
-                              std::chrono::system_clock::to_time_t( std::chrono::system_clock::now() ),
-                              asset_type.amount_to_real( get_balance( from_account, core ).amount ),
-                              asset_type.amount_to_real( get_balance( to_account, core ).amount ),
-                            });
+                    //accounts are kept by instance, names are only written to the log
+                    block_history_transfer transfer;
+                    transfer.source_account = from_account.id.instance();
+                    transfer.target_account = to_account.id.instance();
+                    transfer.amount = asset_type.amount_to_real( tr.amount.amount );
+                    transfer.comission = asset_type.amount_to_real( tr.fee.amount );
+                    transfer.source_account_balance = asset_type.amount_to_real( get_balance( from_account, core ).amount );
+                    transfer.target_account_balance = asset_type.amount_to_real( get_balance( to_account, core ).amount );
+                    transfer.timestamp = std::chrono::system_clock::to_time_t( std::chrono::system_clock::now() );
+                    block.transfers.push_back( transfer );
+
+                    _log.write( "block_info.log",
+                                from_account.name,
+                                to_account.name,
+                                transfer.amount,
+                                transfer.comission,
+                                transfer.source_account_balance,
+                                transfer.target_account_balance,
+                                transfer.timestamp );
                 }
             }
     }
 
-    //log saved info
-    std::ofstream bi_log;
-    bi_log.open( "block_info.log", std::ofstream::app );
-
-    block_info block = _block_history[next_block_num];
-
-    bi_log << "block " << next_block_num << " params (" <<
-           block.transaction_amount_threshold << ";" <<
-           block.account_amount_threshold << ";" <<
-           block.token_usd_rate << ")" << std::endl;
-
-    for (singularity::transaction_t const& tr: block.transactions)
-    {
-        bi_log << tr.source_account << ";"
-               << tr.target_account << ";"
-               << tr.amount << ";"
-               << tr.comission << ";"
-               << tr.source_account_balance << ";"
-               << tr.target_account_balance << ";"
-               << tr.timestamp << std::endl;
-    }
-
-    bi_log.close();
+    //storing a known block number drops it and the blocks after it, to prevent influence from another fork
+    _block_history.store( next_block_num, block );
 }
 
 void database::clear_old_block_history()
 {
     std::cout << "clear_old_block_history start" << std::endl;
+
+    //keep everything the next activity and emission windows may start from
+    const auto& params = get_global_properties().parameters;
+    int64_t activity_start = int64_t(_last_activity_processing_block) - params.transaction_history_window + 1;
+    int64_t emission_start = int64_t(_last_emission_processing_block) - params.emission_period + 1;
+    int64_t first_needed_block = std::min( activity_start, emission_start );
+
+    if( first_needed_block > 1 )
+        _block_history.prune( first_needed_block );
+
     std::cout << "clear_old_block_history end" << std::endl;
 }
 
@@ -572,49 +572,67 @@ void database:: activity_save_parameters()
     std::cout << "activity_save_parameters end" << std::endl;
 }
 
-singularity::account_activity_index_map_t database::async_activity_calculations(int w_start, int w_end)
+static std::vector<singularity::id_transaction_t> to_id_transactions( const block_history_info& block )
 {
-    //open activity log
-    std::ofstream act_log;
-    act_log.open( "activity.log", std::ofstream::app );
-    act_log << "activity calculation started [" << w_start << "," << w_end << "]" << std::endl;
+    std::vector<singularity::id_transaction_t> transactions;
+    transactions.reserve( block.transfers.size() );
+    for( const auto& t : block.transfers )
+        transactions.push_back( { t.amount,
+                                  t.comission,
+                                  t.source_account,
+                                  t.target_account,
+                                  t.source_account_balance,
+                                  t.target_account_balance,
+                                  t.timestamp } );
+    return transactions;
+}
+
+singularity::account_activity_index_vector_t database::async_activity_calculations(int w_start, int w_end)
+{
+    _log.write_text( "activity.log", "activity calculation started [", w_start, ",", w_end, "]" );
     auto time_start = std::chrono::high_resolution_clock::now();
 
-    //create the calculator with saved parameters
-    singularity::activity_index_calculator aic(_activity_parameters);
+    //move the window of the calculator kept from the previous period
+    _activity_window.set_parameters(_activity_parameters);
+    _activity_window.move_window(w_start);
+    if (_activity_window.get_next_block() > w_end + 1)
+    {
+        //the window is ahead of the requested one, start from scratch
+        _activity_window.clear();
+        _activity_window.move_window(w_start);
+    }
+    uint32_t first_new_block = _activity_window.get_next_block();
 
-    //iterate the block history from start to end
-    for (uint32_t i = w_start; i <= w_end; i++)
+    //add only the blocks which are not in the window yet
+    _block_history.for_each_block(first_new_block, w_end, [&](uint32_t i, const block_history_info& b_info)
     {
         if(i % 86400 == 0)
             std::cout << "reading from history block " << i << std::endl;
 
-        //TODO thread safety ????
-        block_info b_info = _block_history[i];
-
         //set threshold parameters
-        auto params = aic.get_parameters();
+        auto params = _activity_window.get_parameters();
         params.account_amount_threshold = b_info.account_amount_threshold;
         params.transaction_amount_threshold = b_info.transaction_amount_threshold;
         params.token_usd_rate = b_info.token_usd_rate;
-        aic.set_parameters(params);
+        _activity_window.set_parameters(params);
 
         //add transactions from block
-        aic.add_block(b_info.transactions);
-    }
+        _activity_window.add_block(i, to_id_transactions(b_info));
+    });
 
     auto blocks_completed = std::chrono::high_resolution_clock::now();
-    act_log << "blocks added in " << (blocks_completed - time_start).count() << std::endl;
+    _log.write_text( "activity.log", "blocks added in ", (blocks_completed - time_start).count(),
+                     " (", (first_new_block <= w_end ? w_end - first_new_block + 1 : 0), " new)" );
 
-    //set saved parameters
-    aic.set_parameters(_activity_parameters);
+    //set saved parameters, the rank starts uniform as a warm start would change the indexes
+    _activity_window.set_parameters(_activity_parameters);
 
     //perform the calculations
-    auto result = aic.calculate( );
+    auto result = _activity_window.calculate( w_end );
 
     auto calculations_completed = std::chrono::high_resolution_clock::now();
-    act_log << "calculations completed in " << (calculations_completed - blocks_completed).count() << std::endl;
-    act_log.close();
+    _log.write_text( "activity.log", "calculations completed in ", (calculations_completed - blocks_completed).count() );
+    _log.write_text( "activity.log", "rank iterations ", _activity_window.get_last_iteration_count() );
 
     return result;
 }
@@ -665,39 +683,29 @@ void database::activity_save_results()
         _activity_calculation_is_running = false;
     }
 
-    //open activity log
-    std::ofstream act_log;
-    act_log.open( "activity.log", std::ofstream::app );
-    act_log << "started saving results" << std::endl;
+    _log.write_text( "activity.log", "started saving results" );
     auto time_start = std::chrono::high_resolution_clock::now();
 
-    //loop through all accounts
-    const auto& idx = get_index_type<account_index>().indices().get<by_name>();
-    for( auto itr = idx.begin( ); itr != idx.end( ); itr++ )
+    //loop through all accounts, the result is addressed by account instance
+    const auto& idx = get_index_type<account_index>().indices();
+    for( const account_object& account : idx )
     {
-        //set account activity_index if we find the value
-        auto ai_result = _activity_index.find(itr->name);
-        if(ai_result != _activity_index.end())
-        {
-            modify( *itr, [&ai_result]( account_object& a )
-            {
-                a.activity_index = ai_result->second;
-            });
-            act_log << itr->name << ";" << ai_result->second << std::endl;
-        }
-        //set it to zero if we cannot find the value
-        else
-        {
-            modify(*itr, [&ai_result](account_object &a)
+        //the index is zero if the account is not in the result
+        auto instance = account.id.instance();
+        double activity_index = instance < _activity_index.size() ? _activity_index[instance] : 0;
+
+        if( activity_index != 0 )
+            _log.write( "activity.log", account.name, activity_index );
+
+        if( account.activity_index != activity_index )
+            modify( account, [activity_index]( account_object& a )
             {
-                a.activity_index = 0;
+                a.activity_index = activity_index;
             });
-        }
     }
 
     auto time_end = std::chrono::high_resolution_clock::now();
-    act_log << "saving results completed in " << (time_end - time_start).count() << std::endl;
-    act_log.close();
+    _log.write_text( "activity.log", "saving results completed in ", (time_end - time_start).count() );
 
     std::cout << "activity_save_results end" << std::endl;
 }
@@ -717,9 +725,7 @@ void database::emission_save_parameters()
     _activity_weight_snapshot = get_global_properties().parameters.activity_weight;
 
     //save all balances
-    std::ofstream act_log;
-    act_log.open( "emission_balances.log", std::ofstream::app );
-    act_log << "saving emission balances" << std::endl;
+    _log.write_text( "emission_balances.log", "saving emission balances" );
     _balances_snapshot.clear();
     const auto& account_idx = get_index_type<account_index>().indices().get<by_name>();
     for( auto account = account_idx.begin(); account != account_idx.end(); account++ )
@@ -729,7 +735,7 @@ void database::emission_save_parameters()
         if( itr != balance_index.end() )
         {
             _balances_snapshot[account->name] = itr->balance.value;
-            act_log << account->name << ";" << _balances_snapshot[account->name] << std::endl;
+            _log.write( "emission_balances.log", account->name, _balances_snapshot[account->name] );
         }
     }
 
@@ -737,46 +743,40 @@ void database::emission_save_parameters()
     const asset_object& core = asset_id_type(0)(*this);
     const asset_dynamic_data_object& core_dd = core.dynamic_asset_data_id(*this);
     _current_supply_snapshot = core_dd.current_supply.value;
-    act_log << "core asset current supply = " << _current_supply_snapshot << std::endl;
+    _log.write_text( "emission_balances.log", "core asset current supply = ", _current_supply_snapshot );
 
     std::cout << "emission_save_parameters end" << std::endl;
 }
 
 uint64_t database::async_emission_calculations(int w_start, int w_end)
 {
-    //open emission log
-    std::ofstream em_log;
-    em_log.open( "emission.log", std::ofstream::app );
-    em_log << "emission calculation started [" << w_start << "," << w_end << "]" << std::endl;
+    _log.write_text( "emission.log", "emission calculation started [", w_start, ",", w_end, "]" );
     auto time_start = std::chrono::high_resolution_clock::now();
 
     //iterate the block history from start to end
-    for (uint32_t i = w_start; i <= w_end; i++)
+    _block_history.for_each_block(w_start, w_end, [&](uint32_t i, const block_history_info& b_info)
     {
-        //TODO thread safety ????
-        block_info b_info = _block_history[i];
-
         //add transactions from block
-        _activity_period.add_block(b_info.transactions);
-    }
+        _activity_period.add_block(to_id_transactions(b_info));
+    });
 
     auto blocks_completed = std::chrono::high_resolution_clock::now();
-    em_log << "blocks added in " << (blocks_completed - time_start).count() << std::endl;
+    _log.write_text( "emission.log", "blocks added in ", (blocks_completed - time_start).count() );
 
     //calculate network activity for the period
     uint32_t current_activity = _activity_period.get_activity( );
-    em_log << "last peak activity = " << _last_peak_activity << std::endl;
-    em_log << "current activity = " << current_activity << std::endl;
+    _log.write_text( "emission.log", "last peak activity = ", _last_peak_activity );
+    _log.write_text( "emission.log", "current activity = ", current_activity );
 
     auto activity_completed = std::chrono::high_resolution_clock::now();
-    em_log << "activity for the period calculated in " << (activity_completed - blocks_completed).count() << std::endl;
+    _log.write_text( "emission.log", "activity for the period calculated in ", (activity_completed - blocks_completed).count() );
 
     //set saved parameters
     _emission.set_parameters(_emission_parameters);
 
     //calculate the total emission
     auto emission_value = _emission.calculate( get_global_properties().parameters.current_emission_volume, _activity_period );
-    em_log << "emission value = " << emission_value << std::endl;
+    _log.write_text( "emission.log", "emission value = ", emission_value );
 
     //save the emission state
     _emission_state = _emission.get_emission_state();
@@ -789,8 +789,7 @@ uint64_t database::async_emission_calculations(int w_start, int w_end)
     _activity_period.clear();
 
     auto emission_completed = std::chrono::high_resolution_clock::now();
-    em_log << "emission for the period calculated in " << (emission_completed - activity_completed).count() << std::endl;
-    em_log.close();
+    _log.write_text( "emission.log", "emission for the period calculated in ", (emission_completed - activity_completed).count() );
 
     return emission_value;
 }
@@ -841,10 +840,7 @@ void database::emission_save_results()
         _emission_calculation_is_running = false;
     }
 
-    //open emission log
-    std::ofstream em_log;
-    em_log.open( "emission.log", std::ofstream::app );
-    em_log << "started saving results" << std::endl;
+    _log.write_text( "emission.log", "started saving results" );
     auto time_start = std::chrono::high_resolution_clock::now();
 
     //prepare gravity index calculator
@@ -874,13 +870,14 @@ void database::emission_save_results()
             });
 
             //save entry to log
-            em_log << account->name << ";" <<
-                std::to_string( account_balance->second ) << ";" <<
-                std::to_string( account_balance->second / _current_supply_snapshot ) << ";" <<
-                account->activity_index << ";" <<
+            _log.write( "emission.log",
+                account->name,
+                std::to_string( account_balance->second ),
+                std::to_string( account_balance->second / _current_supply_snapshot ),
+                account->activity_index,
                 std::to_string( account_balance->second / _current_supply_snapshot * ( 1 - _activity_weight_snapshot ) +
-                                account->activity_index * _activity_weight_snapshot ) << ";" <<
-                std::to_string( acc_emission ) << std::endl;
+                                account->activity_index * _activity_weight_snapshot ),
+                std::to_string( acc_emission ) );
         }
         //set emission to zero if there is no balance in the snapshot
         else
@@ -907,8 +904,7 @@ void database::emission_save_results()
     });
 
     auto time_end = std::chrono::high_resolution_clock::now();
-    em_log << "saving results completed in " << (time_end - time_start).count() << std::endl;
-    em_log.close();
+    _log.write_text( "emission.log", "saving results completed in ", (time_end - time_start).count() );
 
     std::cout << "emission_save_results end" << std::endl;
 }
@@ -34,6 +34,8 @@ void fork_database::reset()
 {
    _head.reset();
    _index.clear();
+   _by_num.clear();
+   _first_num = 0;
 }
 
 void fork_database::pop_block()
@@ -47,8 +49,7 @@ void fork_database::pop_block()
 void     fork_database::start_block(signed_block b)
 {
    auto item = std::make_shared<fork_item>(std::move(b));
-   _index.insert(item);
-   _head = item;
+   _head = _insert(item);
 }
 
 /**
@@ -63,41 +64,69 @@ shared_ptr<fork_item>  fork_database::push_block(const signed_block& b)
    }
    catch ( const unlinkable_block_exception& e )
    {
-      wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",b.id())("num",b.block_num()) );
-      wlog( "Head: ${num}, ${id}", ("num",_head->data.block_num())("id",_head->data.id()) );
+      wlog( "Pushing block to fork database that failed to link: ${id}, ${num}", ("id",item->id)("num",item->num) );
+      wlog( "Head: ${num}, ${id}", ("num",_head->num)("id",_head->id) );
       throw;
       _unlinked_index.insert( item );
    }
    return _head;
 }
 
-void  fork_database::_push_block(const item_ptr& item)
+item_ptr fork_database::_insert(const item_ptr& item)
+{
+   auto inserted = _index.emplace( item->id, item );
+   if( !inserted.second )
+      return inserted.first->second;
+
+   if( _by_num.empty() )
+      _first_num = item->num;
+   else if( item->num < _first_num )
+   {
+      // a fork below the oldest block still kept
+      _by_num.insert( _by_num.begin(), _first_num - item->num, vector<item_ptr>() );
+      _first_num = item->num;
+   }
+   if( item->num - _first_num >= _by_num.size() )
+      _by_num.resize( item->num - _first_num + 1 );
+   _by_num[item->num - _first_num].push_back( item );
+   return item;
+}
+
+void fork_database::_prune(uint32_t min_num)
+{
+   while( !_by_num.empty() && _first_num < min_num )
+   {
+      for( const item_ptr& item : _by_num.front() )
+         _index.erase( item->id );
+      _by_num.pop_front();
+      ++_first_num;
+   }
+}
+
+void  fork_database::_push_block(const item_ptr& new_item)
 {
    if( _head ) // make sure the block is within the range that we are caching
    {
-      FC_ASSERT( item->num > std::max<int64_t>( 0, int64_t(_head->num) - (_max_size) ),
+      FC_ASSERT( new_item->num > std::max<int64_t>( 0, int64_t(_head->num) - (_max_size) ),
                  "attempting to push a block that is too old", 
-                 ("item->num",item->num)("head",_head->num)("max_size",_max_size));
+                 ("item->num",new_item->num)("head",_head->num)("max_size",_max_size));
    }
 
-   if( _head && item->previous_id() != block_id_type() )
+   if( _head && new_item->previous_id() != block_id_type() )
    {
-      auto& index = _index.get<block_id>();
-      auto itr = index.find(item->previous_id());
-      GRAPHENE_ASSERT(itr != index.end(), unlinkable_block_exception, "block does not link to known chain");
-      item->prev = *itr;
+      auto itr = _index.find(new_item->previous_id());
+      GRAPHENE_ASSERT(itr != _index.end(), unlinkable_block_exception, "block does not link to known chain");
+      new_item->prev = itr->second;
    }
 
-   _index.insert(item);
+   item_ptr item = _insert(new_item);
    if( !_head ) _head = item;
    else if( item->num > _head->num )
    {
       _head = item;
       uint32_t min_num = _head->num - std::min( _max_size, _head->num );
 //      ilog( "min block in fork DB ${n}, max_size: ${m}", ("n",min_num)("m",_max_size) );
-      auto& num_idx = _index.get<block_num>();
-      while( num_idx.size() && (*num_idx.begin())->num < min_num )
-         num_idx.erase( num_idx.begin() );
+      _prune( min_num );
       
       _unlinked_index.get<block_num>().erase(_head->num - _max_size);
    }
@@ -130,18 +159,9 @@ void fork_database::set_max_size( uint32_t s )
    _max_size = s;
    if( !_head ) return;
 
-   { /// index
-      auto& by_num_idx = _index.get<block_num>();
-      auto itr = by_num_idx.begin();
-      while( itr != by_num_idx.end() )
-      {
-         if( (*itr)->num < std::max(int64_t(0),int64_t(_head->num) - _max_size) )
-            by_num_idx.erase(itr);
-         else
-            break;
-         itr = by_num_idx.begin();
-      }
-   }
+   /// index
+   _prune( uint32_t( std::max(int64_t(0),int64_t(_head->num) - _max_size) ) );
+
    { /// unlinked_index
       auto& by_num_idx = _unlinked_index.get<block_num>();
       auto itr = by_num_idx.begin();
@@ -158,9 +178,7 @@ void fork_database::set_max_size( uint32_t s )
 
 bool fork_database::is_known_block(const block_id_type& id)const
 {
-   auto& index = _index.get<block_id>();
-   auto itr = index.find(id);
-   if( itr != index.end() )
+   if( _index.find(id) != _index.end() )
       return true;
    auto& unlinked_index = _unlinked_index.get<block_id>();
    auto unlinked_itr = unlinked_index.find(id);
@@ -169,10 +187,9 @@ bool fork_database::is_known_block(const block_id_type& id)const
 
 item_ptr fork_database::fetch_block(const block_id_type& id)const
 {
-   auto& index = _index.get<block_id>();
-   auto itr = index.find(id);
-   if( itr != index.end() )
-      return *itr;
+   auto itr = _index.find(id);
+   if( itr != _index.end() )
+      return itr->second;
    auto& unlinked_index = _unlinked_index.get<block_id>();
    auto unlinked_itr = unlinked_index.find(id);
    if( unlinked_itr != unlinked_index.end() )
@@ -181,17 +198,27 @@ item_ptr fork_database::fetch_block(const block_id_type& id)const
 }
 
 vector<item_ptr> fork_database::fetch_block_by_number(uint32_t num)const
+{
+   if( num < _first_num || num - _first_num >= _by_num.size() )
+      return vector<item_ptr>();
+   return _by_num[num - _first_num];
+}
+
+void fork_database::set_stored(const block_id_type& id, const index_entry& e)
+{
+   auto itr = _index.find(id);
+   if( itr == _index.end() )
+      return;
+   itr->second->stored = e;
+   itr->second->data.reset();
+}
+
+vector<item_ptr> fork_database::fetch_stored_blocks()const
 {
    vector<item_ptr> result;
-   auto itr = _index.get<block_num>().find(num);
-   while( itr != _index.get<block_num>().end() )
-   {
-      if( (*itr)->num == num )
-         result.push_back( *itr );
-      else
-         break;
-      ++itr;
-   }
+   for( const auto& item : _index )
+      if( !item.second->data )
+         result.push_back( item.second );
    return result;
 }
 
@@ -201,28 +228,28 @@ pair<fork_database::branch_type,fork_database::branch_type>
    // This function gets a branch (i.e. vector<fork_item>) leading
    // back to the most recent common ancestor.
    pair<branch_type,branch_type> result;
-   auto first_branch_itr = _index.get<block_id>().find(first);
-   FC_ASSERT(first_branch_itr != _index.get<block_id>().end());
-   auto first_branch = *first_branch_itr;
+   auto first_branch_itr = _index.find(first);
+   FC_ASSERT(first_branch_itr != _index.end());
+   auto first_branch = first_branch_itr->second;
 
-   auto second_branch_itr = _index.get<block_id>().find(second);
-   FC_ASSERT(second_branch_itr != _index.get<block_id>().end());
-   auto second_branch = *second_branch_itr;
+   auto second_branch_itr = _index.find(second);
+   FC_ASSERT(second_branch_itr != _index.end());
+   auto second_branch = second_branch_itr->second;
 
 
-   while( first_branch->data.block_num() > second_branch->data.block_num() )
+   while( first_branch->num > second_branch->num )
    {
       result.first.push_back(first_branch);
       first_branch = first_branch->prev.lock();
       FC_ASSERT(first_branch);
    }
-   while( second_branch->data.block_num() > first_branch->data.block_num() )
+   while( second_branch->num > first_branch->num )
    {
       result.second.push_back( second_branch );
       second_branch = second_branch->prev.lock();
       FC_ASSERT(second_branch);
    }
-   while( first_branch->data.previous != second_branch->data.previous )
+   while( first_branch->previous_id() != second_branch->previous_id() )
    {
       result.first.push_back(first_branch);
       result.second.push_back(second_branch);
@@ -246,7 +273,16 @@ void fork_database::set_head(shared_ptr<fork_item> h)
 
 void fork_database::remove(block_id_type id)
 {
-   _index.get<block_id>().erase(id);
+   auto itr = _index.find(id);
+   if( itr == _index.end() )
+      return;
+   const item_ptr item = itr->second;
+   _index.erase(itr);
+   if( item->num >= _first_num && item->num - _first_num < _by_num.size() )
+   {
+      auto& slot = _by_num[item->num - _first_num];
+      slot.erase( std::remove( slot.begin(), slot.end(), item ), slot.end() );
+   }
 }
 
 } } // graphene::chain
@@ -344,7 +344,9 @@ namespace graphene { namespace chain {
                std::less< account_id_type >
             >
          >
-      >
+      >,
+      // balances are created for every new account and asset pair
+      graphene::db::pool_allocator< account_balance_object >
    > account_balance_object_multi_index_type;
 
    /**
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <fc/filesystem.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace graphene { namespace chain {
+
+   enum class async_log_format
+   {
+      /// each record is a line of its fields separated by ';'
+      csv,
+      /// each record is its time in microseconds, its field count and the fields, each prefixed by its length
+      binary
+   };
+
+   struct async_log_options
+   {
+      bool             enabled = true;
+      /// the log files are relative to the working directory if empty
+      fc::path         directory;
+      async_log_format format = async_log_format::csv;
+      /// a file larger than this is rotated to file.1 ... file.N, 0 never rotates
+      uint64_t         max_file_size = 64 * 1024 * 1024;
+      uint32_t         max_rotated_files = 4;
+      /// records held for the writer, rounded up to a power of two
+      size_t           capacity = 1 << 16;
+      /// the records of these files wait for room in a full ring instead of being dropped
+      std::set<std::string> lossless_files = { "activity.log", "emission.log", "emission_balances.log" };
+   };
+
+   /**
+    * Writes the records of the chain logs on a background thread. Producers
+    * put records into a lock-free ring buffer and do not wait for the file
+    * system; a record which does not fit into a full ring is dropped and
+    * counted, unless its file is one of the lossless files, whose producers
+    * wait for the writer instead. Records of all files go through the same
+    * ring, the writer flushes the files once per batch.
+    */
+   class async_log
+   {
+      public:
+         async_log() {}
+         ~async_log();
+
+         /** Starts the writer, closes the previous one first. Nothing may be written meanwhile. */
+         void open( const async_log_options& options );
+         /**
+          * Writes the records queued so far and stops the writer. A record
+          * written meanwhile is either queued before the writer stops or ignored.
+          */
+         void close();
+         /** Waits until the records queued so far are written, and logs the records dropped since the last report */
+         void flush();
+
+         bool     enabled()const { return _enabled.load( std::memory_order_relaxed ); }
+         uint64_t dropped()const { return _dropped.load( std::memory_order_relaxed ); }
+
+         /** Queues a record of fields, each formatted with operator<< */
+         template<typename... Fields>
+         void write( const char* file, const Fields&... fields )
+         {
+            if( !enabled() )
+               return;
+            std::vector<std::string> values;
+            values.reserve( sizeof...(fields) );
+            int expand[] = { 0, ( values.push_back( to_field( fields ) ), 0 )... };
+            (void)expand;
+            push( file, std::move( values ) );
+         }
+
+         /** Queues a record of one field, the concatenation of parts */
+         template<typename... Parts>
+         void write_text( const char* file, const Parts&... parts )
+         {
+            if( !enabled() )
+               return;
+            std::ostringstream text;
+            int expand[] = { 0, ( text << parts, 0 )... };
+            (void)expand;
+            push( file, std::vector<std::string>{ text.str() } );
+         }
+
+      private:
+         struct record
+         {
+            std::string              file;
+            uint64_t                 time = 0;
+            std::vector<std::string> fields;
+         };
+         struct cell
+         {
+            std::atomic<size_t> sequence;
+            record              value;
+         };
+         struct log_file
+         {
+            std::ofstream out;
+            uint64_t      size = 0;
+         };
+
+         template<typename T>
+         static std::string to_field( const T& value )
+         {
+            std::ostringstream text;
+            text << value;
+            return text.str();
+         }
+
+         void push( const char* file, std::vector<std::string>&& fields );
+         void enqueue( const char* file, std::vector<std::string>&& fields );
+         bool pop( record& r );
+         void report_dropped();
+         void work();
+         void write_record( const record& r );
+         void rotate( const std::string& name, log_file& file );
+
+         async_log_options                 _options;
+         std::unique_ptr<cell[]>           _cells;
+         size_t                            _mask = 0;
+         std::atomic<size_t>               _enqueue_pos{ 0 };
+         size_t                            _dequeue_pos = 0;
+
+         std::atomic<bool>                 _enabled{ false };
+         std::atomic<bool>                 _stopping{ false };
+         std::atomic<uint64_t>             _pushed{ 0 };
+         std::atomic<uint64_t>             _written{ 0 };
+         std::atomic<uint64_t>             _dropped{ 0 };
+         std::atomic<uint64_t>             _reported_dropped{ 0 };
+         /// producers in push(), close() waits for them before it frees the ring
+         std::atomic<uint32_t>             _producers{ 0 };
+
+         std::map<std::string, log_file>   _files;
+         std::mutex                        _lock;
+         std::condition_variable           _wake;
+         std::condition_variable           _flushed;
+         std::thread                       _writer;
+   };
+
+} }
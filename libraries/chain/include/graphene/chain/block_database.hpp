@@ -23,32 +23,139 @@
  */
 #pragma once
 #include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <graphene/chain/protocol/block.hpp>
 
 namespace graphene { namespace chain {
-   class index_entry;
+   struct index_entry
+   {
+      uint64_t      block_pos = 0;
+      uint32_t      block_size = 0;
+      block_id_type block_id;
+   };
 
+   /**
+    * Blocks are appended to the blocks file, the index file holds an index_entry
+    * per block number. The index is kept in memory and blocks are read from
+    * mappings of the blocks file, which is mapped in segments. The const
+    * methods may be called from several threads while nothing is stored.
+    *
+    * compact() moves irreversible blocks into the archive, fixed size segment
+    * files of compressed batches of blocks. The entry of an archived block
+    * points to its batch, so blocks are still found by number in O(1).
+    */
    class block_database 
    {
       public:
+         /**
+          * Reads the blocks in number order for a replay, the part of the blocks
+          * file ahead of the current block is mapped and prefetched in advance.
+          */
+         class replay_reader
+         {
+            public:
+               /** @return the next block, invalid at the end or at a gap */
+               optional<signed_block> next();
+               uint32_t               next_block_num()const { return _next; }
+
+            private:
+               friend class block_database;
+               replay_reader( const block_database& db, uint32_t first ):_db(db),_next(first){}
+
+               const block_database& _db;
+               uint32_t              _next;
+               uint64_t              _prefetched_segment = uint64_t(-1);
+         };
+
          void open( const fc::path& dbdir );
          bool is_open()const;
          void flush();
          void close();
 
-         void store( const block_id_type& id, const signed_block& b );
+         /** @return where the block was stored */
+         index_entry store( const block_id_type& id, const signed_block& b );
          void remove( const block_id_type& id );
+         /**
+          * Archives up to max_batch_count complete batches of blocks up to
+          * last_block_num. The batches reach the disk before the index points
+          * to them. Once everything up to last_block_num is archived and most of
+          * the blocks file is dead, the remaining blocks are copied to a new
+          * blocks file, which replaces the old one when its commit marker is on
+          * the disk, open() completes or drops a rewrite cut off by a crash.
+          * The blocks must not change any more, nothing may be read meanwhile.
+          */
+         void compact( uint32_t last_block_num, uint32_t max_batch_count = std::numeric_limits<uint32_t>::max() );
 
          bool                   contains( const block_id_type& id )const;
          block_id_type          fetch_block_id( uint32_t block_num )const;
          optional<signed_block> fetch_optional( const block_id_type& id )const;
          optional<signed_block> fetch_by_number( uint32_t block_num )const;
+         /**
+          * Reads the block stored at e, which may have been replaced by another
+          * block of the same number since. A block still in the index is read
+          * from its current entry, as compact() moves it, while a replaced one
+          * is only readable until the next compact().
+          */
+         optional<signed_block> fetch_stored( const index_entry& e )const;
          optional<signed_block> last()const;
          optional<block_id_type> last_id()const;
+
+         replay_reader          read_from( uint32_t first_block_num )const { return replay_reader( *this, first_block_num ); }
       private:
+         struct mapped_segment;
+         /** Decompressed batch of archived blocks */
+         struct archived_batch
+         {
+            uint32_t          first_block_num = 0;
+            /// end of every block in data
+            vector<uint32_t>  block_ends;
+            vector<char>      data;
+         };
+
          optional<index_entry> last_index_entry()const;
+         /** Finishes a rewrite of the blocks file that was committed before a crash, or drops an interrupted one */
+         void                  replace_compacted_files();
+         const index_entry*    find_entry( uint32_t block_num )const;
+         /** @return the bytes of the blocks file e holds */
+         uint64_t              live_size( const index_entry& e )const;
+         /** @return the block of e, or throws if it can not be read */
+         signed_block          read_block( const index_entry& e )const;
+         std::shared_ptr<mapped_segment> map_segment( uint64_t segment, uint64_t min_end )const;
+         /** Makes the blocks file hold the bytes below end, the caller holds _segments_lock */
+         void                  flush_blocks( uint64_t end )const;
+         void                  write_entry( uint32_t block_num, const index_entry& e );
+         std::shared_ptr<const archived_batch> read_batch( uint64_t archive_pos )const;
+         std::shared_ptr<mapped_segment>       map_archive( uint64_t segment )const;
+         fc::path              archive_filename( uint64_t segment )const;
+
          fc::path _index_filename;
+         fc::path _blocks_filename;
          mutable std::fstream _blocks;
          mutable std::fstream _block_num_to_pos;
+         uint64_t             _blocks_size = 0;
+         /// the bytes of the blocks file which belong to unarchived blocks of the index
+         uint64_t             _live_size = 0;
+         /// the blocks file holds the bytes below, the rest may still be in the stream buffer
+         mutable uint64_t     _flushed_size = 0;
+         /// the put position of _blocks is at the end of the file
+         bool                 _blocks_at_end = false;
+         /// the index file, entry i is block number i
+         vector<index_entry>  _index;
+         /// reads may come from several threads, writes may not overlap with them
+         mutable std::mutex   _segments_lock;
+         mutable std::map< uint64_t, std::shared_ptr<mapped_segment> > _segments;
+         mutable uint64_t     _segment_uses = 0;
+
+         fc::path             _archive_dir;
+         /// position the next batch is archived at, counted over all archive segments
+         uint64_t             _archive_end = 0;
+         /// the blocks below are archived
+         uint32_t             _first_unarchived = 1;
+         mutable std::map< uint64_t, std::shared_ptr<mapped_segment> > _archives;
+         /// recently read batches and their last use, replays read many blocks from each
+         mutable std::map< uint64_t, std::pair< uint64_t, std::shared_ptr<const archived_batch> > > _batches;
    };
 } }
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <graphene/chain/protocol/types.hpp>
+
+namespace graphene { namespace chain {
+   struct block_history_index_entry;
+
+   /**
+    *  A transfer as it is seen by the activity and emission calculations.
+    *  Accounts are stored as the instance of their account_id_type.
+    */
+   struct block_history_transfer
+   {
+      uint32_t source_account = 0;
+      uint32_t target_account = 0;
+      double   amount = 0;
+      double   comission = 0;
+      double   source_account_balance = 0;
+      double   target_account_balance = 0;
+      int64_t  timestamp = 0;
+   };
+
+   struct block_history_info
+   {
+      //threshold parameters
+      uint32_t transaction_amount_threshold = 0;
+      uint32_t account_amount_threshold = 0;
+      double   token_usd_rate = 0;
+
+      //all transfers in block
+      vector<block_history_transfer> transfers;
+   };
+
+   /**
+    *  @class block_history_database
+    *  @brief Append-only store of the per-block transfers used by the delayed activity and emission calculations
+    *
+    *  Every field of the transfers is kept in its own file, blocks are addressed by number through a fixed size
+    *  index. Reads map the files to memory, so a range scan does not copy more than the blocks it returns.
+    *  Storing a block which is already known drops it together with all the blocks after it (fork switch).
+    *  A range scan holds the lock only while it copies a chunk of blocks, the files are only shrunk or
+    *  replaced under the lock and the scan maps them again before its next chunk.
+    */
+   class block_history_database
+   {
+      public:
+         typedef std::function<void( uint32_t, const block_history_info& )> block_visitor;
+
+         void open( const fc::path& dbdir );
+         bool is_open()const;
+         void flush();
+         void close();
+
+         void store( uint32_t block_num, const block_history_info& info );
+         optional<block_history_info> fetch( uint32_t block_num )const;
+         /** Calls visitor for every stored block in [first_block_num, last_block_num] in ascending order */
+         void for_each_block( uint32_t first_block_num, uint32_t last_block_num, const block_visitor& visitor )const;
+         /** Forgets all the blocks before first_block_num, files are compacted when most of them is dead */
+         void prune( uint32_t first_block_num );
+
+         /** @return 0 if the store is empty */
+         uint32_t first_block_num()const;
+         uint32_t last_block_num()const;
+
+      private:
+         enum column_type
+         {
+            source_account_column,
+            target_account_column,
+            amount_column,
+            comission_column,
+            source_account_balance_column,
+            target_account_balance_column,
+            timestamp_column,
+            column_count
+         };
+
+         fc::path column_path( int column )const;
+         void     open_files();
+         void     close_files();
+         void     flush_files()const;
+         void     truncate( uint32_t block_count, uint64_t transfer_count );
+         void     compact();
+         block_history_index_entry read_index_entry( uint32_t position )const;
+
+         fc::path              _dbdir;
+         mutable std::mutex    _lock;
+         mutable std::ofstream _index;
+         mutable std::ofstream _columns[column_count];
+
+         /// number of the block at the beginning of the files
+         uint32_t              _file_first_block = 0;
+         /// first block which was not pruned
+         uint32_t              _first_block = 0;
+         uint32_t              _block_count = 0;
+         uint64_t              _transfer_count = 0;
+         /// changed whenever the stored part of the files is shrunk or replaced, readers map them again
+         uint64_t              _generation = 0;
+   };
+} }
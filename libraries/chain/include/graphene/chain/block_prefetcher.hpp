@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/chain/block_database.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace graphene { namespace chain {
+
+   /**
+    * Reads and unpacks the blocks of a replay on worker threads ahead of the
+    * apply loop, and checks their transaction merkle roots, which does not
+    * depend on the chain state. The blocks are taken strictly in number order.
+    *
+    * Nothing may be stored to or removed from the block database while the
+    * workers run, stop() them first.
+    */
+   class block_prefetcher
+   {
+      public:
+         struct prefetched_block
+         {
+            optional<signed_block> block;
+            /// the transaction merkle root of the block has been verified
+            bool                   merkle_checked = false;
+         };
+
+         /** Prefetches the blocks first..last, nothing if last < first */
+         block_prefetcher( const block_database& blocks, uint32_t first, uint32_t last,
+                           size_t num_threads = std::max( 1u, std::thread::hardware_concurrency() ),
+                           size_t window = 1024 );
+         ~block_prefetcher();
+
+         /**
+          * Waits for block_num, which must be the block after the previous one taken.
+          * Rethrows the error of a failed read.
+          */
+         prefetched_block take( uint32_t block_num );
+         void             stop();
+
+      private:
+         void work();
+
+         const block_database&         _blocks;
+         const uint32_t                _last;
+         std::vector<prefetched_block> _slots;
+         std::vector<std::exception_ptr> _errors;
+         std::vector<bool>             _ready;
+         uint32_t                      _next_claim;
+         uint32_t                      _next_take;
+         bool                          _stopped = false;
+         std::mutex                    _lock;
+         std::condition_variable       _changed;
+         std::vector<std::thread>      _workers;
+   };
+
+} }
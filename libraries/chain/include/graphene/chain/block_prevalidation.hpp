@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/chain/protocol/block.hpp>
+#include <graphene/chain/thread_pool.hpp>
+
+#include <exception>
+
+namespace graphene { namespace chain {
+
+   /** The checks of a transaction in a block which do not depend on the chain state */
+   struct prevalidated_transaction
+   {
+      transaction_id_type        id;
+      /// thrown by transaction::validate()
+      std::exception_ptr         validate_error;
+      /// recovered from the signatures when requested
+      flat_set<public_key_type>  signature_keys;
+      bool                       keys_recovered = false;
+      /// thrown by signed_transaction::get_signature_keys()
+      std::exception_ptr         keys_error;
+   };
+
+   struct prevalidated_block
+   {
+      vector<prevalidated_transaction> transactions;
+      /// the transaction merkle root has been computed and matches the header
+      bool                             merkle_checked = false;
+   };
+
+   /** The checks of prevalidate_block() for a transaction pushed on its own */
+   prevalidated_transaction prevalidate_transaction( const precomputed_transaction& trx, bool recover_keys );
+
+   /**
+    * Validates the transactions of block, computes their ids and merkle
+    * digests, and recovers their signature keys if recover_keys is set. Blocks
+    * with enough transactions are spread over the threads of pool, the others
+    * are done on the calling thread. The errors are kept with the
+    * transactions, so the apply loop throws them where it would have thrown
+    * them itself.
+    */
+   prevalidated_block prevalidate_block( const signed_block& block, const chain_id_type& chain_id,
+                                         bool recover_keys, bool check_merkle_root,
+                                         thread_pool* pool = nullptr );
+
+} }
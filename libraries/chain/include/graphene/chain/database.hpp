@@ -26,13 +26,17 @@
 #include <graphene/chain/node_property_object.hpp>
 #include <graphene/chain/account_object.hpp>
 #include <graphene/chain/asset_object.hpp>
+#include <graphene/chain/async_log.hpp>
 #include <graphene/chain/fork_database.hpp>
 #include <graphene/chain/block_database.hpp>
+#include <graphene/chain/block_history_database.hpp>
+#include <graphene/chain/block_prevalidation.hpp>
 #include <graphene/chain/genesis_state.hpp>
 #include <graphene/chain/evaluator.hpp>
   
 #include <graphene/db/object_database.hpp>
 #include <graphene/db/object.hpp>
+#include <graphene/db/dense_index.hpp>
 #include <graphene/db/simple_index.hpp>
 #include <fc/signals.hpp>
   
@@ -41,6 +45,7 @@
 #include <fc/log/logger.hpp>
   
 #include <graphene/singularity/activity_index_calculator.hpp>
+#include <graphene/singularity/activity_window.hpp>
 #include <graphene/singularity/gravity_index_calculator.hpp>
 
 #include <graphene/singularity/emission.hpp>
@@ -57,6 +62,19 @@ namespace graphene { namespace chain {
    class transaction_evaluation_state;
   
    struct budget_record;
+
+   /** How long the last chain maintenance took, in microseconds */
+   struct maintenance_statistics
+   {
+      uint32_t block_num = 0;
+      uint64_t accounts = 0;
+      uint32_t tally_threads = 0;
+      /// the vote tally, on tally_threads threads
+      uint64_t tally_time = 0;
+      /// the fee processing, which runs in account name order
+      uint64_t fees_time = 0;
+      uint64_t total_time = 0;
+   };
   
    /**
     *   @class database
@@ -141,14 +159,36 @@ namespace graphene { namespace chain {
           */
          uint32_t witness_participation_rate()const;
   
+         /**
+          * Sets up the block info, activity and emission logs, which are written in the
+          * working directory by default. Nothing may be applied meanwhile.
+          */
+         void                              configure_logs( const async_log_options& options );
+         /**
+          * Saves the changes of the object database once the last irreversible block
+          * advanced by blocks since the last time, 0 saves it only on close().
+          */
+         void                              set_checkpoint_interval( uint32_t blocks );
+         /** Records dropped because the writer of the logs fell behind */
+         uint64_t                          dropped_log_records()const { return _log.dropped(); }
+         const maintenance_statistics&     get_last_maintenance_statistics()const { return _last_maintenance; }
+         /**
+          * The maintenance tallies the votes in a range per min_accounts_per_thread accounts,
+          * up to max_threads ranges, on the worker pool, 0 is the number of cores
+          */
+         void                              set_maintenance_tally_threads( size_t max_threads, size_t min_accounts_per_thread );
+
          void                              add_checkpoints( const flat_map<uint32_t,block_id_type>& checkpts );
          const flat_map<uint32_t,block_id_type> get_checkpoints()const { return _checkpoints; }
          bool before_last_checkpoint()const;
   
          bool push_block( const signed_block& b, uint32_t skip = skip_nothing );
          processed_transaction push_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
+         /** Same as above, the id and signature digest are only computed once for trx */
+         processed_transaction push_transaction( const precomputed_transaction& trx, uint32_t skip = skip_nothing );
          bool _push_block( const signed_block& b );
-         processed_transaction _push_transaction( const signed_transaction& trx );
+         processed_transaction _push_transaction( const signed_transaction& trx,
+                                                  const prevalidated_transaction* prevalidated = nullptr );
   
          ///@throws fc::exception if the proposed transaction fails to apply.
          processed_transaction push_proposal( const proposal_object& proposal );
@@ -441,27 +481,25 @@ namespace graphene { namespace chain {
          uint32_t                                   _emission_start_async_block = 0;
          uint32_t                                   _emission_save_async_result_block = 0;
 
-         struct block_info
-         {
-             //all transactions in block
-             std::vector<singularity::transaction_t> transactions;
-
-             //threshold parameters
-             uint transaction_amount_threshold;
-             uint account_amount_threshold;
-             double token_usd_rate;
-         };
-
          //historical data for delayed calculations of the activity and emission
-         std::map<uint32_t, block_info> _block_history;
+         block_history_database _block_history;
 
          // these were formerly private, but they have a fairly well-defined API, so let's make them public
          void                  apply_block( const signed_block& next_block, uint32_t skip = skip_nothing );
          processed_transaction apply_transaction( const signed_transaction& trx, uint32_t skip = skip_nothing );
          operation_result      apply_operation( transaction_evaluation_state& eval_state, const operation& op );
       private:
+         /** The block of a fork database item, which is read back once it has been stored */
+         signed_block          fetch_fork_block( const fork_item& item )const;
+         thread_pool&          worker_pool();
+         /** Archives a few batches of irreversible blocks, the fork database keeps the blocks compaction drops */
+         void                  compact_blocks();
+         /** Checkpoints the object database if the checkpoint interval has passed */
+         void                  checkpoint_if_due();
          void                  _apply_block( const signed_block& next_block );
-         processed_transaction _apply_transaction( const signed_transaction& trx );
+         /** @param prevalidated the results of prevalidate_block() for trx, if any */
+         processed_transaction _apply_transaction( const signed_transaction& trx,
+                                                   const prevalidated_transaction* prevalidated = nullptr );
          void                  _cancel_bids_and_revive_mpa( const asset_object& bitasset, const asset_bitasset_data_object& bad );
   
          ///Steps involved in applying a new block
@@ -486,7 +524,7 @@ namespace graphene { namespace chain {
          void collect_block_data(const signed_block& next_block);
          void clear_old_block_history();
          void activity_save_parameters();
-         singularity::account_activity_index_map_t async_activity_calculations(int w_start, int w_end);
+         singularity::account_activity_index_vector_t async_activity_calculations(int w_start, int w_end);
          void activity_start_async(int window_start_block, int window_end_block);
          void activity_save_results();
          void emission_save_parameters();
@@ -508,8 +546,8 @@ namespace graphene { namespace chain {
          void update_worker_votes();
          void process_bids( const asset_bitasset_data_object& bad );
   
-         template<class... Types>
-         void perform_account_maintenance(std::tuple<Types...> helpers);
+         /** Tallies the votes of all accounts on several threads and processes their fees */
+         void perform_account_maintenance( const global_property_object& props, maintenance_statistics& stats );
          ///@}
          ///@}
   
@@ -545,7 +583,18 @@ namespace graphene { namespace chain {
          vector<uint64_t>                  _witness_count_histogram_buffer;
          vector<uint64_t>                  _committee_count_histogram_buffer;
          uint64_t                          _total_voting_stake;
-  
+         maintenance_statistics            _last_maintenance;
+         size_t                            _tally_max_threads = 0;
+         size_t                            _tally_min_accounts_per_thread = 4096;
+         /// shared by the block prevalidation and the vote tally, started by the first one that needs it
+         std::unique_ptr<thread_pool>      _worker_pool;
+         uint32_t                          _checkpoint_interval = 1000;
+         /// the last irreversible block at the last checkpoint or open()
+         uint32_t                          _last_checkpoint_block = 0;
+  
+         /// declared ahead of the asynchronous calculations, which write to it until they are destroyed
+         async_log                         _log;
+
          flat_map<uint32_t,block_id_type>  _checkpoints;
   
          node_property_object              _node_property_object;
@@ -555,9 +604,10 @@ namespace graphene { namespace chain {
          std::set<uint32_t>                _active_accounts;
   
          singularity::parameters_t                               _activity_parameters;
-         std::future<singularity::account_activity_index_map_t>  _future_activity_index;
-         singularity::account_activity_index_map_t               _activity_index;
+         std::future<singularity::account_activity_index_vector_t> _future_activity_index;
+         singularity::account_activity_index_vector_t            _activity_index;
          bool                                                    _activity_calculation_is_running;
+         singularity::activity_window_calculator                 _activity_window;
 
          singularity::emission_parameters_t         _emission_parameters;
          double                                     _activity_weight_snapshot;
@@ -573,23 +623,7 @@ namespace graphene { namespace chain {
          singularity::emission_state_t              _emission_state;
    };
   
-   namespace detail
-   {
-       template<int... Is>
-       struct seq { };
-  
-       template<int N, int... Is>
-       struct gen_seq : gen_seq<N - 1, N - 1, Is...> { };
-  
-       template<int... Is>
-       struct gen_seq<0, Is...> : seq<Is...> { };
-  
-       template<typename T, int... Is>
-       void for_each(T&& t, const account_object& a, seq<Is...>)
-       {
-           auto l = { (std::get<Is>(t)(a), 0)... };
-           (void)l;
-       }
-   }
-  
 } }
+
+FC_REFLECT( graphene::chain::maintenance_statistics,
+            (block_num)(accounts)(tally_threads)(tally_time)(fees_time)(total_time) )
@@ -22,6 +22,7 @@
  * THE SOFTWARE.
  */
 #pragma once
+#include <graphene/chain/block_database.hpp>
 #include <graphene/chain/protocol/block.hpp>
 
 #include <boost/multi_index_container.hpp>
@@ -30,22 +31,35 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
 
+#include <deque>
+#include <unordered_map>
+
 
 namespace graphene { namespace chain {
    using boost::multi_index_container;
    using namespace boost::multi_index;
 
+   /**
+    * A block of the fork database. The full block is held only until it is
+    * stored in the block database, afterwards it is read from the entry it
+    * was stored at, which stays valid when a block of another fork replaces
+    * it under the same number.
+    */
    struct fork_item
    {
       fork_item( signed_block d )
-      :num(d.block_num()),id(d.id()),data( std::move(d) ){}
-
-      block_id_type previous_id()const { return data.previous; }
-
-      weak_ptr< fork_item > prev;
-      uint32_t              num;    // initialized in ctor
-      block_id_type         id;
-      signed_block          data;
+      :num(d.block_num()),id(d.id()),header(d),data( std::make_shared<const signed_block>( std::move(d) ) ){}
+
+      block_id_type previous_id()const { return header.previous; }
+
+      weak_ptr< fork_item >          prev;
+      uint32_t                       num;    // initialized in ctor
+      block_id_type                  id;
+      signed_block_header            header;
+      /// the full block, dropped once the block is stored
+      shared_ptr<const signed_block> data;
+      /// where the block is stored, block_size is 0 while it is not
+      index_entry                    stored;
    };
    typedef shared_ptr<fork_item> item_ptr;
 
@@ -59,6 +73,9 @@ namespace graphene { namespace chain {
     *
     *  Every time a block is pushed into the fork DB the
     *  block with the highest block_num will be returned.
+    *
+    *  The linked blocks are kept in a window indexed by block number, which
+    *  slides forward as the head advances.
     */
    class fork_database
    {
@@ -76,6 +93,10 @@ namespace graphene { namespace chain {
          bool                             is_known_block(const block_id_type& id)const;
          shared_ptr<fork_item>            fetch_block(const block_id_type& id)const;
          vector<item_ptr>                 fetch_block_by_number(uint32_t n)const;
+         /** Records where the block was stored and drops its copy of the block */
+         void                             set_stored(const block_id_type& id, const index_entry& e);
+         /** @return the linked blocks that are read from the block database */
+         vector<item_ptr>                 fetch_stored_blocks()const;
 
          /**
           *  @return the new head block ( the longest fork )
@@ -109,11 +130,18 @@ namespace graphene { namespace chain {
          /** @return a pointer to the newly pushed item */
          void _push_block(const item_ptr& b );
          void _push_next(const item_ptr& newly_inserted);
+         /** @return the linked item of the block, which is item unless the block was known */
+         item_ptr _insert(const item_ptr& item);
+         /** Drops the linked blocks below min_num */
+         void _prune(uint32_t min_num);
 
          uint32_t                 _max_size = 1024;
 
          fork_multi_index_type    _unlinked_index;
-         fork_multi_index_type    _index;
+         std::unordered_map< block_id_type, item_ptr, std::hash<fc::ripemd160> > _index;
+         /// the linked blocks of every number from _first_num on, forks share a slot
+         std::deque< vector<item_ptr> > _by_num;
+         uint32_t                 _first_num = 0;
          shared_ptr<fork_item>    _head;
    };
 } } // graphene::chain
@@ -52,6 +52,8 @@ namespace graphene { namespace chain {
    struct signed_block : public signed_block_header
    {
       checksum_type calculate_merkle_root()const;
+      /** The merkle root of the given transaction merkle digests */
+      static checksum_type merkle_root( vector<digest_type> digests );
       vector<processed_transaction> transactions;
    };
 
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/chain/protocol/types.hpp>
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace graphene { namespace chain {
+
+   struct signature_cache_statistics
+   {
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+      uint64_t entries = 0;
+      uint64_t capacity = 0;
+   };
+
+   /**
+    * Remembers the public keys recovered from (digest, signature) pairs, so a
+    * transaction checked when it enters the pending state is not recovered
+    * again when it arrives in a block. Holds at most capacity keys, the
+    * oldest ones are dropped first. Safe to use from several threads, the
+    * recovery itself runs outside of the lock.
+    */
+   class signature_cache
+   {
+      public:
+         static const size_t default_capacity = 1 << 15;
+
+         explicit signature_cache( size_t capacity = default_capacity ) : _capacity( capacity ) {}
+
+         /** The cache used by signed_transaction::get_signature_keys() */
+         static signature_cache& instance();
+
+         /** @throws if no key can be recovered from sig */
+         public_key_type recover( const signature_type& sig, const digest_type& digest );
+
+         void                       set_capacity( size_t capacity );
+         void                       clear();
+         signature_cache_statistics statistics()const;
+
+      private:
+         struct entry_key
+         {
+            digest_type    digest;
+            signature_type signature;
+
+            bool operator==( const entry_key& other )const
+            {
+               return digest == other.digest && signature == other.signature;
+            }
+         };
+         struct entry_key_hash
+         {
+            size_t operator()( const entry_key& key )const;
+         };
+
+         void trim();
+
+         mutable std::mutex                                               _lock;
+         std::unordered_map< entry_key, public_key_type, entry_key_hash > _keys;
+         std::deque< entry_key >                                          _order;
+         size_t                                                           _capacity;
+         uint64_t                                                         _hits = 0;
+         uint64_t                                                         _misses = 0;
+   };
+
+} } // graphene::chain
+
+FC_REFLECT( graphene::chain::signature_cache_statistics, (hits)(misses)(entries)(capacity) )
@@ -166,6 +166,8 @@ namespace graphene { namespace chain {
          ) const;
 
       flat_set<public_key_type> get_signature_keys( const chain_id_type& chain_id )const;
+      /** The keys of the signatures, for a caller which has the sig_digest() of the transaction already */
+      flat_set<public_key_type> recover_signature_keys( const digest_type& sig_digest )const;
 
       vector<signature_type> signatures;
 
@@ -204,6 +206,35 @@ namespace graphene { namespace chain {
       digest_type merkle_digest()const;
    };
 
+   /**
+    *  @brief a signed transaction which computes its id and signature digest only once
+    *
+    *  A transaction received from the network or the API is handed to the database in one of
+    *  these, so each step it passes does not serialize and hash it again. The wrapped
+    *  transaction cannot be changed.
+    */
+   class precomputed_transaction
+   {
+      public:
+         precomputed_transaction( signed_transaction trx, const chain_id_type& chain_id )
+            : _trx( std::move( trx ) ), _chain_id( chain_id ) {}
+
+         const signed_transaction&  get()const { return _trx; }
+         const chain_id_type&       chain_id()const { return _chain_id; }
+
+         const transaction_id_type& id()const;
+         const digest_type&         sig_digest()const;
+         /** Runs transaction::validate() on the first call only */
+         void                       validate()const;
+
+      private:
+         signed_transaction                    _trx;
+         chain_id_type                         _chain_id;
+         mutable optional<transaction_id_type> _id;
+         mutable optional<digest_type>         _sig_digest;
+         mutable bool                          _validated = false;
+   };
+
    /// @} transactions group
 
 } } // graphene::chain
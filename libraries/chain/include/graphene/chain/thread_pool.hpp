@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace graphene { namespace chain {
+
+   /**
+    * Worker threads kept for the lifetime of the database, which the block
+    * prevalidation and the maintenance vote tally share instead of starting
+    * threads on every call. The calling thread takes part in the work, so a
+    * pool of one thread runs everything inline. Tasks must not throw.
+    */
+   class thread_pool
+   {
+      public:
+         explicit thread_pool( size_t num_threads = std::max( 1u, std::thread::hardware_concurrency() ) );
+         ~thread_pool();
+         thread_pool( const thread_pool& ) = delete;
+         thread_pool& operator=( const thread_pool& ) = delete;
+
+         size_t size()const { return _workers.size() + 1; }
+         /** Calls task(i) for every i in [0, num_tasks) and waits until all of them are done */
+         void   run( size_t num_tasks, const std::function<void(size_t)>& task );
+
+      private:
+         void work();
+         void run_tasks();
+
+         std::vector<std::thread>            _workers;
+         std::mutex                          _lock;
+         std::condition_variable             _task_ready;
+         std::condition_variable             _task_done;
+         const std::function<void(size_t)>*  _task = nullptr;
+         size_t                              _task_count = 0;
+         std::atomic<size_t>                 _next_task{ 0 };
+         size_t                              _busy_workers = 0;
+         uint64_t                            _generation = 0;
+         bool                                _stopping = false;
+   };
+
+} }
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/protocol/signature_cache.hpp>
+
+#include <cstring>
+
+namespace graphene { namespace chain {
+
+signature_cache& signature_cache::instance()
+{
+   static signature_cache cache;
+   return cache;
+}
+
+size_t signature_cache::entry_key_hash::operator()( const entry_key& key )const
+{
+   // both are hashes already, a word of each is plenty
+   uint64_t sig_word;
+   memcpy( &sig_word, key.signature.data + 1, sizeof(sig_word) );
+   return size_t( key.digest._hash[0] ^ ( sig_word * 0x9e3779b97f4a7c15ull ) );
+}
+
+public_key_type signature_cache::recover( const signature_type& sig, const digest_type& digest )
+{
+   entry_key key{ digest, sig };
+   {
+      std::lock_guard<std::mutex> guard( _lock );
+      auto itr = _keys.find( key );
+      if( itr != _keys.end() )
+      {
+         ++_hits;
+         return itr->second;
+      }
+      ++_misses;
+   }
+
+   public_key_type result( fc::ecc::public_key( sig, digest ) );
+
+   std::lock_guard<std::mutex> guard( _lock );
+   if( _capacity > 0 && _keys.emplace( key, result ).second )
+   {
+      _order.push_back( key );
+      trim();
+   }
+   return result;
+}
+
+void signature_cache::set_capacity( size_t capacity )
+{
+   std::lock_guard<std::mutex> guard( _lock );
+   _capacity = capacity;
+   trim();
+}
+
+void signature_cache::clear()
+{
+   std::lock_guard<std::mutex> guard( _lock );
+   _keys.clear();
+   _order.clear();
+   _hits = 0;
+   _misses = 0;
+}
+
+signature_cache_statistics signature_cache::statistics()const
+{
+   std::lock_guard<std::mutex> guard( _lock );
+   signature_cache_statistics result;
+   result.hits = _hits;
+   result.misses = _misses;
+   result.entries = _keys.size();
+   result.capacity = _capacity;
+   return result;
+}
+
+void signature_cache::trim()
+{
+   while( _order.size() > _capacity )
+   {
+      _keys.erase( _order.front() );
+      _order.pop_front();
+   }
+}
+
+} } // graphene::chain
@@ -23,6 +23,7 @@
  */
 #include <graphene/chain/exceptions.hpp>
 #include <graphene/chain/protocol/fee_schedule.hpp>
+#include <graphene/chain/protocol/signature_cache.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/bitutil.hpp>
 #include <fc/smart_ref_impl.hpp>
@@ -298,13 +299,18 @@ void verify_authority( const vector<operation>& ops, const flat_set<public_key_t
 
 
 flat_set<public_key_type> signed_transaction::get_signature_keys( const chain_id_type& chain_id )const
+{
+   return recover_signature_keys( sig_digest( chain_id ) );
+}
+
+flat_set<public_key_type> signed_transaction::recover_signature_keys( const digest_type& d )const
 { try {
-   auto d = sig_digest( chain_id );
+   auto& cache = signature_cache::instance();
    flat_set<public_key_type> result;
    for( const auto&  sig : signatures )
    {
       GRAPHENE_ASSERT(
-         result.insert( fc::ecc::public_key(sig,d) ).second,
+         result.insert( cache.recover( sig, d ) ).second,
          tx_duplicate_sig,
          "Duplicate Signature detected" );
    }
@@ -383,4 +389,26 @@ void signed_transaction::verify_authority(
    graphene::chain::verify_authority( operations, get_signature_keys( chain_id ), get_active, get_owner, max_recursion );
 } FC_CAPTURE_AND_RETHROW( (*this) ) }
 
+const transaction_id_type& precomputed_transaction::id()const
+{
+   if( !_id.valid() )
+      _id = _trx.id();
+   return *_id;
+}
+
+const digest_type& precomputed_transaction::sig_digest()const
+{
+   if( !_sig_digest.valid() )
+      _sig_digest = _trx.sig_digest( _chain_id );
+   return *_sig_digest;
+}
+
+void precomputed_transaction::validate()const
+{
+   if( _validated )
+      return;
+   _trx.validate();
+   _validated = true;
+}
+
 } } // graphene::chain
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/chain/thread_pool.hpp>
+
+#include <fc/log/logger.hpp>
+
+#include <system_error>
+
+namespace graphene { namespace chain {
+
+thread_pool::thread_pool( size_t num_threads )
+{
+   try
+   {
+      for( size_t i = 1; i < num_threads; ++i )
+         _workers.emplace_back( [this]() { work(); } );
+   }
+   catch( const std::system_error& e )
+   {
+      // the threads which did start share the work
+      wlog( "Thread pool started ${n} of ${t} threads: ${e}", ("n", _workers.size() + 1)("t", num_threads)("e", e.what()) );
+   }
+}
+
+thread_pool::~thread_pool()
+{
+   {
+      std::lock_guard<std::mutex> guard( _lock );
+      _stopping = true;
+   }
+   _task_ready.notify_all();
+   for( auto& worker : _workers )
+      worker.join();
+}
+
+void thread_pool::run( size_t num_tasks, const std::function<void(size_t)>& task )
+{
+   if( _workers.empty() || num_tasks <= 1 )
+   {
+      for( size_t i = 0; i < num_tasks; ++i )
+         task( i );
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> guard( _lock );
+      _task = &task;
+      _task_count = num_tasks;
+      _next_task = 0;
+      _busy_workers = _workers.size();
+      ++_generation;
+   }
+   _task_ready.notify_all();
+
+   run_tasks();
+
+   std::unique_lock<std::mutex> guard( _lock );
+   _task_done.wait( guard, [this]() { return _busy_workers == 0; } );
+   _task = nullptr;
+}
+
+void thread_pool::work()
+{
+   uint64_t seen_generation = 0;
+   while( true )
+   {
+      {
+         std::unique_lock<std::mutex> guard( _lock );
+         _task_ready.wait( guard, [&]() { return _stopping || _generation != seen_generation; } );
+         if( _stopping )
+            return;
+         seen_generation = _generation;
+      }
+
+      run_tasks();
+
+      std::lock_guard<std::mutex> guard( _lock );
+      if( --_busy_workers == 0 )
+         _task_done.notify_all();
+   }
+}
+
+void thread_pool::run_tasks()
+{
+   for( size_t i = _next_task++; i < _task_count; i = _next_task++ )
+      (*_task)( i );
+}
+
+} }
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <graphene/db/index.hpp>
+
+#include <bitset>
+#include <map>
+#include <type_traits>
+
+namespace graphene { namespace db {
+
+   /**
+    *  @class dense_index
+    *  @brief Stores the objects in place in chunks of contiguous slots addressed by instance
+    *
+    *  This index is preferred for object types whose instances are dense and rarely
+    *  removed, and which are mostly looked up by ID. Finding an object costs two array
+    *  lookups, objects never move once created, and a chunk is allocated once for
+    *  ChunkSize objects instead of once per object. Other orderings can be added with
+    *  ordered_secondary_index.
+    */
+   template<typename T, size_t ChunkSize = 1024>
+   class dense_index : public index
+   {
+      public:
+         typedef T object_type;
+
+         dense_index() {}
+         dense_index( const dense_index& ) = delete;
+         dense_index& operator=( const dense_index& ) = delete;
+         ~dense_index()
+         {
+            for( uint64_t instance = 0; instance < _chunks.size() * ChunkSize; ++instance )
+               if( is_live( instance ) )
+                  slot( instance )->~T();
+         }
+
+         virtual const object&  create( const std::function<void(object&)>& constructor ) override
+         {
+            auto id = get_next_id();
+            T& obj = emplace( id.instance(), T() );
+            obj.id = id;
+            constructor( obj );
+            obj.id = id; // just in case it changed
+            use_next_id();
+            return obj;
+         }
+
+         virtual void modify( const object& obj, const std::function<void(object&)>& modify_callback ) override
+         {
+            assert( is_live( obj.id.instance() ) );
+            modify_callback( *slot( obj.id.instance() ) );
+         }
+
+         virtual const object& insert( object&& obj )override
+         {
+            assert( nullptr != dynamic_cast<T*>(&obj) );
+            return emplace( obj.id.instance(), std::move( static_cast<T&>(obj) ) );
+         }
+
+         virtual void remove( const object& obj ) override
+         {
+            assert( nullptr != dynamic_cast<const T*>(&obj) );
+            const auto instance = obj.id.instance();
+            assert( is_live( instance ) );
+            slot( instance )->~T();
+            _chunks[instance / ChunkSize]->live.reset( instance % ChunkSize );
+            --_size;
+         }
+
+         virtual const object* find( object_id_type id )const override
+         {
+            assert( id.space() == T::space_id );
+            assert( id.type() == T::type_id );
+
+            const auto instance = id.instance();
+            if( !is_live( instance ) ) return nullptr;
+            return slot( instance );
+         }
+
+         virtual void inspect_all_objects(std::function<void (const object&)> inspector)const override
+         {
+            try {
+               for( const auto& obj : *this )
+                  inspector( obj );
+            } FC_CAPTURE_AND_RETHROW()
+         }
+         virtual fc::uint128 hash()const override {
+            fc::uint128 result;
+            for( const auto& obj : *this )
+               result += obj.hash();
+
+            return result;
+         }
+
+         /** Visits the objects in instance order */
+         class const_iterator
+         {
+            public:
+               const_iterator( const dense_index& idx, uint64_t instance ):_index(&idx),_instance(instance)
+               {
+                  skip_removed();
+               }
+               friend bool operator==( const const_iterator& a, const const_iterator& b ) { return a._instance == b._instance; }
+               friend bool operator!=( const const_iterator& a, const const_iterator& b ) { return a._instance != b._instance; }
+               const T& operator*()const  { return *_index->slot( _instance ); }
+               const T* operator->()const { return _index->slot( _instance ); }
+               const_iterator operator++(int)     // postfix
+               {
+                  const_iterator result( *this );
+                  ++(*this);
+                  return result;
+               }
+               const_iterator& operator++()       // prefix
+               {
+                  ++_instance;
+                  skip_removed();
+                  return *this;
+               }
+               typedef std::forward_iterator_tag iterator_category;
+               typedef T                         value_type;
+               typedef std::ptrdiff_t            difference_type;
+               typedef const T*                  pointer;
+               typedef const T&                  reference;
+            private:
+               void skip_removed()
+               {
+                  const uint64_t end = _index->end_instance();
+                  while( _instance < end && !_index->is_live( _instance ) )
+                     ++_instance;
+               }
+
+               const dense_index* _index;
+               uint64_t           _instance;
+         };
+         const_iterator begin()const { return const_iterator( *this, 0 ); }
+         const_iterator end()const   { return const_iterator( *this, end_instance() ); }
+
+         /** Number of objects in the index */
+         size_t size()const { return _size; }
+
+      private:
+         typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_type;
+         struct chunk
+         {
+            storage_type            slots[ChunkSize];
+            std::bitset<ChunkSize>  live;
+         };
+
+         uint64_t end_instance()const { return _chunks.size() * ChunkSize; }
+
+         bool is_live( uint64_t instance )const
+         {
+            return instance < end_instance() && _chunks[instance / ChunkSize]->live.test( instance % ChunkSize );
+         }
+
+         T* slot( uint64_t instance )const
+         {
+            return reinterpret_cast<T*>( &_chunks[instance / ChunkSize]->slots[instance % ChunkSize] );
+         }
+
+         T& emplace( uint64_t instance, T&& obj )
+         {
+            while( instance >= end_instance() )
+               _chunks.emplace_back( new chunk );
+            FC_ASSERT( !is_live( instance ), "Object ${i} is already in the index", ("i", instance) );
+            T* result = new( slot( instance ) ) T( std::move( obj ) );
+            _chunks[instance / ChunkSize]->live.set( instance % ChunkSize );
+            ++_size;
+            return *result;
+         }
+
+         vector< unique_ptr<chunk> > _chunks;
+         size_t                      _size = 0;
+   };
+
+   /**
+    *  @class ordered_secondary_index
+    *  @brief Orders the objects of a primary index by a key, such as a boost::multi_index::member
+    */
+   template<typename ObjectType, typename KeyFromObject,
+            typename Compare = std::less<typename KeyFromObject::result_type>>
+   class ordered_secondary_index : public secondary_index
+   {
+      public:
+         typedef typename KeyFromObject::result_type                       key_type;
+         typedef std::multimap<key_type, const ObjectType*, Compare>     index_type;
+
+         virtual void object_inserted( const object& obj )override
+         {
+            const ObjectType& o = static_cast<const ObjectType&>( obj );
+            _indices.emplace( KeyFromObject()( o ), &o );
+         }
+         virtual void object_removed( const object& obj )override
+         {
+            erase( static_cast<const ObjectType&>( obj ) );
+         }
+         virtual void about_to_modify( const object& before )override
+         {
+            erase( static_cast<const ObjectType&>( before ) );
+         }
+         virtual void object_modified( const object& after )override
+         {
+            object_inserted( after );
+         }
+
+         const index_type& indices()const { return _indices; }
+
+      private:
+         void erase( const ObjectType& o )
+         {
+            auto range = _indices.equal_range( KeyFromObject()( o ) );
+            for( auto itr = range.first; itr != range.second; ++itr )
+               if( itr->second == &o )
+               {
+                  _indices.erase( itr );
+                  return;
+               }
+         }
+
+         index_type _indices;
+   };
+
+} } // graphene::db
@@ -38,6 +38,10 @@ namespace graphene { namespace chain {
     *  Almost all objects can be tracked and managed via a boost::multi_index container that uses
     *  an unordered_unique key on the object ID.  This template class adapts the generic index interface
     *  to work with arbitrary boost multi_index containers on the same type.
+    *
+    *  Containers of objects created at a high rate should allocate their nodes with
+    *  graphene::db::pool_allocator, the pool is released with the index and its statistics are
+    *  reported by the index.
     */
    template<typename ObjectType, typename MultiIndexType>
    class generic_index : public index
@@ -97,6 +101,11 @@ namespace graphene { namespace chain {
 
          const index_type& indices()const { return _indices; }
 
+         virtual graphene::db::allocation_statistics get_allocation_statistics()const override
+         {
+            return graphene::db::pool_statistics<typename MultiIndexType::allocator_type>::get( _indices.get_allocator() );
+         }
+
          virtual fc::uint128 hash()const override {
             fc::uint128 result;
             for( const auto& ptr : _indices )
@@ -23,11 +23,13 @@
  */
 #pragma once
 #include <graphene/db/object.hpp>
+#include <graphene/db/pool_allocator.hpp>
 #include <fc/interprocess/file_mapping.hpp>
 #include <fc/io/raw.hpp>
 #include <fc/io/json.hpp>
 #include <fc/crypto/sha256.hpp>
 #include <fstream>
+#include <unordered_set>
 
 namespace graphene { namespace db {
    class object_database;
@@ -96,6 +98,16 @@ namespace graphene { namespace db {
          virtual void open( const fc::path& db ) = 0;
          virtual void save( const fc::path& db ) = 0;
 
+         /**
+          *  Incremental checkpoints: save_changes writes the objects added, modified or
+          *  removed since the last save or clear_changes, load_changes applies them on
+          *  top of an opened index.
+          */
+         virtual bool     has_changes()const = 0;
+         virtual uint64_t save_changes( std::ostream& out )const = 0;
+         virtual void     load_changes( fc::datastream<const char*>& ds ) = 0;
+         virtual void     clear_changes() = 0;
+
 
 
          /** @return the object with id or nullptr if not found */
@@ -132,6 +144,9 @@ namespace graphene { namespace db {
 
          virtual void               object_from_variant( const fc::variant& var, object& obj )const = 0;
          virtual void               object_default( object& obj )const = 0;
+
+         /** Counters of the pool the objects are allocated from, if the index pools them */
+         virtual allocation_statistics get_allocation_statistics()const { return allocation_statistics(); }
    };
 
    class secondary_index
@@ -183,8 +198,13 @@ namespace graphene { namespace db {
          }
 
       protected:
+         /** Remembers the instance for the next checkpoint, if the database tracks changes */
+         void note_changed( uint64_t instance );
+
          vector< shared_ptr<index_observer> >   _observers;
          vector< unique_ptr<secondary_index> >  _sindex;
+         /** instances changed since the last save or checkpoint */
+         std::unordered_set<uint64_t>           _changed_instances;
 
       private:
          object_database& _db;
@@ -205,7 +225,7 @@ namespace graphene { namespace db {
          typedef typename DerivedIndex::object_type object_type;
 
          primary_index( object_database& db )
-         :base_primary_index(db),_next_id(object_type::space_id,object_type::type_id,0) {}
+         :base_primary_index(db),_next_id(object_type::space_id,object_type::type_id,0),_saved_next_id(_next_id) {}
 
          virtual uint8_t object_space_id()const override
          { return object_type::space_id; }
@@ -223,6 +243,16 @@ namespace graphene { namespace db {
             return fc::sha256::hash(desc);
          }
 
+         /**
+          * Marks the snapshot layout: the object count followed by the packed
+          * objects. Files starting with get_object_version() hold length
+          * prefixed records instead.
+          */
+         fc::sha256 get_snapshot_version()const
+         {
+            return fc::sha256::hash( std::string( "1.0/snapshot-2" ) );
+         }
+
          virtual void open( const path& db )override
          { 
             if( !fc::exists( db ) ) return;
@@ -233,30 +263,50 @@ namespace graphene { namespace db {
 
             fc::raw::unpack(ds, _next_id);
             fc::raw::unpack(ds, open_ver);
+            if( open_ver == get_snapshot_version() )
+            {
+               uint64_t count = 0;
+               fc::raw::unpack( ds, count );
+               for( uint64_t i = 0; i < count; ++i )
+                  load_object( ds );
+               FC_ASSERT( ds.remaining() == 0, "Unexpected data after ${n} objects in ${f}", ("n", count)("f", db.generic_string()) );
+               return;
+            }
+
             FC_ASSERT( open_ver == get_object_version(), "Incompatible Version, the serialization of objects in this index has changed" );
-            try {
-               vector<char> tmp;
-               while( true ) 
-               {
-                  fc::raw::unpack( ds, tmp );
-                  load( tmp );
-               }
-            } catch ( const fc::exception&  ){}
+            while( ds.remaining() > 0 )
+            {
+               fc::unsigned_int size;
+               fc::raw::unpack( ds, size );
+               FC_ASSERT( size.value <= ds.remaining(), "Truncated object in ${f}", ("f", db.generic_string()) );
+               fc::datastream<const char*> record( ds.pos(), size.value );
+               load_object( record );
+               ds.skip( size.value );
+            }
          }
 
          virtual void save( const path& db ) override 
          {
-            std::ofstream out( db.generic_string(), 
-                               std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
+            std::vector<char> stream_buffer( 1 << 20 );
+            std::ofstream out;
+            out.rdbuf()->pubsetbuf( stream_buffer.data(), stream_buffer.size() );
+            out.open( db.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::trunc );
             FC_ASSERT( out );
-            auto ver  = get_object_version();
+            auto ver  = get_snapshot_version();
             fc::raw::pack( out, _next_id );
             fc::raw::pack( out, ver );
+            // the count is filled in once the objects are written
+            auto count_pos = out.tellp();
+            uint64_t count = 0;
+            fc::raw::pack( out, count );
             this->inspect_all_objects( [&]( const object& o ) {
-                auto vec = fc::raw::pack( static_cast<const object_type&>(o) );
-                auto packed_vec = fc::raw::pack( vec );
-                out.write( packed_vec.data(), packed_vec.size() );
+                fc::raw::pack( out, static_cast<const object_type&>(o) );
+                ++count;
             });
+            out.seekp( count_pos );
+            fc::raw::pack( out, count );
+            out.flush();
+            FC_ASSERT( out, "Failed to write ${f}", ("f", db.generic_string()) );
          }
 
          virtual const object&  load( const std::vector<char>& data )override
@@ -267,7 +317,79 @@ namespace graphene { namespace db {
             return result;
          }
 
+         virtual bool has_changes()const override
+         {
+            return !_changed_instances.empty() || _next_id != _saved_next_id;
+         }
+
+         virtual uint64_t save_changes( std::ostream& out )const override
+         {
+            fc::raw::pack( out, _next_id );
+            uint64_t count = _changed_instances.size();
+            fc::raw::pack( out, count );
+            for( uint64_t instance : _changed_instances )
+            {
+               const object* obj = DerivedIndex::find( object_id_type( object_type::space_id, object_type::type_id, instance ) );
+               fc::raw::pack( out, instance );
+               fc::raw::pack( out, obj != nullptr );
+               if( obj != nullptr )
+                  fc::raw::pack( out, static_cast<const object_type&>(*obj) );
+            }
+            return count;
+         }
+
+         virtual void load_changes( fc::datastream<const char*>& ds )override
+         {
+            fc::raw::unpack( ds, _next_id );
+            uint64_t count = 0;
+            fc::raw::unpack( ds, count );
+            for( uint64_t i = 0; i < count; ++i )
+            {
+               uint64_t instance = 0;
+               bool exists = false;
+               fc::raw::unpack( ds, instance );
+               fc::raw::unpack( ds, exists );
+               const object* old = DerivedIndex::find( object_id_type( object_type::space_id, object_type::type_id, instance ) );
+               if( old != nullptr )
+               {
+                  for( const auto& item : _sindex )
+                     item->object_removed( *old );
+                  DerivedIndex::remove( *old );
+               }
+               if( exists )
+                  load_object( ds );
+            }
+         }
+
+         virtual void clear_changes()override
+         {
+            _changed_instances.clear();
+            _saved_next_id = _next_id;
+         }
+
+         /** undo_database restores removed objects through here */
+         virtual const object& insert( object&& obj )override
+         {
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            for( const auto& item : _sindex )
+               item->object_inserted( result );
+            note_changed( result.id.instance() );
+            return result;
+         }
+
+      private:
+         /** Unpacks the next object straight from the stream and inserts it like load() */
+         template<typename Stream>
+         void load_object( Stream& ds )
+         {
+            object_type obj;
+            fc::raw::unpack( ds, obj );
+            const auto& result = DerivedIndex::insert( std::move(obj) );
+            for( const auto& item : _sindex )
+               item->object_inserted( result );
+         }
 
+      public:
          virtual const object&  create(const std::function<void(object&)>& constructor )override
          {
             const auto& result = DerivedIndex::create( constructor );
@@ -321,6 +443,8 @@ namespace graphene { namespace db {
 
       private:
          object_id_type _next_id;
+         /** _next_id as of the last save or checkpoint */
+         object_id_type _saved_next_id;
    };
 
 } } // graphene::db
@@ -26,6 +26,7 @@
 #include <fc/io/raw.hpp>
 #include <fc/crypto/city.hpp>
 #include <fc/uint128.hpp>
+#include <new>
 
 namespace graphene { namespace db {
 
@@ -72,6 +73,9 @@ namespace graphene { namespace db {
 
          /// these methods are implemented for derived classes by inheriting abstract_object<DerivedClass>
          virtual unique_ptr<object> clone()const = 0;
+         /// copies the object into memory of at least clone_size() bytes, aligned for any type
+         virtual object*            clone_into( void* memory )const = 0;
+         virtual size_t             clone_size()const = 0;
          virtual void               move_from( object& obj ) = 0;
          virtual variant            to_variant()const  = 0;
          virtual vector<char>       pack()const = 0;
@@ -93,6 +97,11 @@ namespace graphene { namespace db {
          {
             return unique_ptr<object>(new DerivedClass( *static_cast<const DerivedClass*>(this) ));
          }
+         virtual object* clone_into( void* memory )const
+         {
+            return new (memory) DerivedClass( *static_cast<const DerivedClass*>(this) );
+         }
+         virtual size_t  clone_size()const { return sizeof(DerivedClass); }
 
          virtual void    move_from( object& obj )
          {
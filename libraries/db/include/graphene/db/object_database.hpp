@@ -50,6 +50,19 @@ namespace graphene { namespace db {
           * Saves the complete state of the object_database to disk, this could take a while
           */
          void flush();
+         /**
+          * Appends the objects changed since the last flush or checkpoint to the delta log
+          * of the saved state. Falls back to a full flush when there is no saved state yet
+          * or when the log has grown larger than the saved indexes, which compacts it.
+          * Without change tracking, or after a time without it, this is a full flush.
+          */
+         void checkpoint();
+         /**
+          * The indexes remember the objects changed since the last checkpoint only
+          * while this is enabled, which costs memory and time on every change
+          */
+         void track_changes( bool enabled );
+         bool tracks_changes()const { return _track_changes; }
          void wipe(const fc::path& data_dir); // remove from disk
          void close();
 
@@ -77,6 +90,9 @@ namespace graphene { namespace db {
          const index&  get_index(object_id_type id)const { return get_index(id.space(),id.type()); }
          /// @}
 
+         /** Allocation counters of the indexes which pool their objects */
+         vector<allocation_statistics> get_allocation_statistics()const;
+
          const object& get_object( object_id_type id )const;
          const object* find_object( object_id_type id )const;
 
@@ -164,8 +180,15 @@ namespace graphene { namespace db {
          void save_undo_add( const object& obj );
          void save_undo_remove( const object& obj );
 
+         /** Applies the complete batches of the delta log and drops a torn one at its end */
+         void replay_delta_log();
+         void clear_changes();
+
          fc::path                                                  _data_dir;
          vector< vector< unique_ptr<index> > >                     _index;
+         bool                                                      _track_changes = true;
+         /// objects were changed without being tracked since the last flush
+         bool                                                      _untracked_changes = false;
    };
 
 } } // graphene::db
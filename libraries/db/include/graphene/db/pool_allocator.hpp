@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#pragma once
+#include <fc/reflect/reflect.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace graphene { namespace db {
+
+   /** Counters of the node pool of an index, all zero for an index that does not pool */
+   struct allocation_statistics
+   {
+      uint8_t  space_id = 0;
+      uint8_t  type_id = 0;
+      uint64_t node_size = 0;
+      uint64_t allocated_nodes = 0;
+      uint64_t freed_nodes = 0;
+      uint64_t slabs = 0;
+      uint64_t slab_bytes = 0;
+   };
+
+   /**
+    * Hands out nodes of one size from slabs and keeps the freed ones on a
+    * free list. Slabs are only released with the pool, nodes of the same
+    * container end up next to each other. The node size is taken from the
+    * first allocation. A pool belongs to one container and is not locked,
+    * the container may only be changed by one thread at a time.
+    */
+   class node_pool
+   {
+      public:
+         /** @return nullptr if the pool holds nodes of another size */
+         void*                 allocate( size_t node_size );
+         /** @return false if the pool holds nodes of another size and node is not its */
+         bool                  deallocate( void* node, size_t node_size );
+         const allocation_statistics& statistics()const { return _statistics; }
+
+      private:
+         struct free_node { free_node* next; };
+
+         size_t                               _node_size = 0;
+         size_t                               _stride = 0;
+         size_t                               _nodes_per_slab = 0;
+         std::vector< std::unique_ptr<char[]> > _slabs;
+         free_node*                           _free = nullptr;
+         char*                                _next = nullptr;
+         char*                                _end = nullptr;
+         allocation_statistics                _statistics;
+   };
+
+   /**
+    * Allocator for boost::multi_index_container which takes its nodes from a
+    * pool of its own. The container rebinds it to its node type, the copies
+    * share the pool, which is released with the container. The allocations of
+    * other sizes and of arrays, such as hash buckets, go to operator new.
+    */
+   template<typename T>
+   class pool_allocator
+   {
+      public:
+         typedef T              value_type;
+         typedef T*             pointer;
+         typedef const T*       const_pointer;
+         typedef T&             reference;
+         typedef const T&       const_reference;
+         typedef std::size_t    size_type;
+         typedef std::ptrdiff_t difference_type;
+
+         template<typename U>
+         struct rebind { typedef pool_allocator<U> other; };
+
+         pool_allocator():_pool( std::make_shared<node_pool>() ) {}
+         template<typename U>
+         pool_allocator( const pool_allocator<U>& other ):_pool( other.pool() ) {}
+
+         pointer       address( reference r )const       { return &r; }
+         const_pointer address( const_reference r )const { return &r; }
+         size_type     max_size()const                   { return size_type(-1) / sizeof(T); }
+
+         pointer allocate( size_type n, const void* = nullptr )
+         {
+            void* node = n == 1 ? _pool->allocate( sizeof(T) ) : nullptr;
+            if( node == nullptr )
+               node = ::operator new( n * sizeof(T) );
+            return static_cast<pointer>( node );
+         }
+         void deallocate( pointer p, size_type n )
+         {
+            if( n != 1 || !_pool->deallocate( p, sizeof(T) ) )
+               ::operator delete( p );
+         }
+
+         template<typename U, typename... Args>
+         void construct( U* p, Args&&... args ) { ::new((void*)p) U( std::forward<Args>(args)... ); }
+         template<typename U>
+         void destroy( U* p ) { p->~U(); }
+
+         const std::shared_ptr<node_pool>& pool()const { return _pool; }
+
+      private:
+         std::shared_ptr<node_pool> _pool;
+   };
+
+   /** Statistics of the pool an allocator takes its nodes from, none for other allocators */
+   template<typename Allocator>
+   struct pool_statistics
+   {
+      static allocation_statistics get( const Allocator& ) { return allocation_statistics(); }
+   };
+   template<typename T>
+   struct pool_statistics< pool_allocator<T> >
+   {
+      static allocation_statistics get( const pool_allocator<T>& a ) { return a.pool()->statistics(); }
+   };
+
+   template<typename T, typename U>
+   bool operator==( const pool_allocator<T>& a, const pool_allocator<U>& b ) { return a.pool() == b.pool(); }
+   template<typename T, typename U>
+   bool operator!=( const pool_allocator<T>& a, const pool_allocator<U>& b ) { return a.pool() != b.pool(); }
+
+} } // graphene::db
+
+FC_REFLECT( graphene::db::allocation_statistics,
+            (space_id)(type_id)(node_size)(allocated_nodes)(freed_nodes)(slabs)(slab_bytes) )
@@ -25,19 +25,84 @@
 #include <graphene/db/object.hpp>
 #include <deque>
 #include <fc/exception/exception.hpp>
+#include <fc/container/flat.hpp>
 
 namespace graphene { namespace db {
 
    using std::unordered_map;
    using fc::flat_set;
+   using fc::flat_map;
    class object_database;
 
-   struct undo_state
+   /**
+    * Bump allocator for the object copies kept by an undo state. The memory is
+    * released in bulk with the arena, the objects are destroyed by their owner.
+    */
+   class undo_arena
+   {
+      public:
+         undo_arena() = default;
+         undo_arena( undo_arena&& ) = default;
+         undo_arena& operator = ( undo_arena&& ) = default;
+
+         object* clone( const object& obj );
+         /** Takes over the blocks of other, so its objects live as long as this arena */
+         void    splice( undo_arena& other );
+
+      private:
+         void*   allocate( size_t size );
+
+         vector< std::unique_ptr<char[]> > _blocks;
+         char*                             _next = nullptr;
+         size_t                            _left = 0;
+   };
+
+   struct undo_entry
+   {
+      enum kind_type : uint8_t
+      {
+         none     = 0, ///< not changed by the state
+         created  = 1,
+         modified = 2, ///< value holds the object before the state
+         removed  = 3  ///< value holds the object before the state
+      };
+
+      object_id_type id;
+      kind_type      kind  = none;
+      object*        value = nullptr;
+   };
+
+   /**
+    * The changes made in one undo session: one entry per touched object, found by
+    * id through an open addressing table, with the old values kept in the arena.
+    */
+   class undo_state
    {
-      unordered_map<object_id_type, unique_ptr<object> > old_values;
-      unordered_map<object_id_type, object_id_type>      old_index_next_ids;
-      std::unordered_set<object_id_type>                 new_ids;
-      unordered_map<object_id_type, unique_ptr<object> > removed;
+      public:
+         undo_state() = default;
+         undo_state( undo_state&& ) = default;
+         ~undo_state();
+
+         /** @return the entry of id, nullptr if the state has none */
+         undo_entry*       find( object_id_type id );
+         const undo_entry* find( object_id_type id )const;
+         /** @return the entry of id, added with kind none if missing; invalidates other entry pointers */
+         undo_entry&       get( object_id_type id );
+
+         /** the entries in the order they were added, entries of kind none are to be skipped */
+         const vector<undo_entry>& entries()const { return _entries; }
+         vector<undo_entry>&       entries()      { return _entries; }
+
+         flat_map<object_id_type, object_id_type> old_index_next_ids;
+         undo_arena                               arena;
+
+      private:
+         size_t slot_of( object_id_type id )const;
+         void   rehash( size_t num_slots );
+
+         vector<undo_entry> _entries;
+         /// positions in _entries plus one, zero marks a free slot
+         vector<uint32_t>   _slots;
    };
 
 
@@ -136,6 +201,8 @@ namespace graphene { namespace db {
          void undo();
          void merge();
          void commit();
+         /** Restores the database to the state before state */
+         void revert( undo_state& state );
 
          uint32_t                _active_sessions = 0;
          bool                    _disabled = true;
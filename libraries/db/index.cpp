@@ -29,15 +29,29 @@ namespace graphene { namespace db {
    void base_primary_index::save_undo( const object& obj )
    { _db.save_undo( obj ); }
 
+   void base_primary_index::note_changed( uint64_t instance )
+   {
+      if( _db.tracks_changes() )
+         _changed_instances.insert( instance );
+   }
+
    void base_primary_index::on_add( const object& obj )
    {
       _db.save_undo_add( obj );
+      note_changed( obj.id.instance() );
       for( auto ob : _observers ) ob->on_add( obj );
    }
 
    void base_primary_index::on_remove( const object& obj )
-   { _db.save_undo_remove( obj ); for( auto ob : _observers ) ob->on_remove( obj ); }
+   {
+      _db.save_undo_remove( obj );
+      note_changed( obj.id.instance() );
+      for( auto ob : _observers ) ob->on_remove( obj );
+   }
 
    void base_primary_index::on_modify( const object& obj )
-   {for( auto ob : _observers ) ob->on_modify(  obj ); }
+   {
+      note_changed( obj.id.instance() );
+      for( auto ob : _observers ) ob->on_modify(  obj );
+   }
 } } // graphene::chain
@@ -27,8 +27,67 @@
 #include <fc/container/flat.hpp>
 #include <fc/uint128.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
 namespace graphene { namespace db {
 
+namespace {
+
+   typedef std::pair< uint64_t, std::function<void()> > index_task;
+
+   /** Size of the saved index, zero if there is none yet */
+   uint64_t index_file_size( const fc::path& file )
+   {
+      return fc::exists( file ) ? fc::file_size( file ) : 0;
+   }
+
+   /**
+    * Runs the index tasks on a few threads, largest first, so the wall time
+    * is close to that of the largest index. The first exception thrown by a
+    * task is rethrown after all the threads are joined.
+    */
+   void run_index_tasks( vector<index_task> tasks )
+   {
+      std::stable_sort( tasks.begin(), tasks.end(), []( const index_task& a, const index_task& b ) {
+         return a.first > b.first;
+      });
+
+      std::atomic<size_t> next( 0 );
+      std::exception_ptr error;
+      std::mutex error_mutex;
+      auto worker = [&]() {
+         for( size_t i = next++; i < tasks.size(); i = next++ )
+         {
+            try {
+               tasks[i].second();
+            } catch( ... ) {
+               std::lock_guard<std::mutex> lock( error_mutex );
+               if( !error )
+                  error = std::current_exception();
+               next = tasks.size();
+            }
+         }
+      };
+
+      size_t num_threads = std::min<size_t>( tasks.size(), std::max( 1u, std::thread::hardware_concurrency() ) );
+      vector<std::thread> threads;
+      for( size_t t = 1; t < num_threads; ++t )
+         threads.emplace_back( worker );
+      worker();
+      for( auto& t : threads )
+         t.join();
+
+      if( error )
+         std::rethrow_exception( error );
+   }
+
+}
+
 object_database::object_database()
 :_undo_db(*this)
 {
@@ -59,6 +118,24 @@ const index& object_database::get_index(uint8_t space_id, uint8_t type_id)const
    FC_ASSERT( tmp );
    return *tmp;
 }
+vector<allocation_statistics> object_database::get_allocation_statistics()const
+{
+   vector<allocation_statistics> result;
+   for( size_t space_id = 0; space_id < _index.size(); ++space_id )
+      for( size_t type_id = 0; type_id < _index[space_id].size(); ++type_id )
+      {
+         if( !_index[space_id][type_id] )
+            continue;
+         allocation_statistics statistics = _index[space_id][type_id]->get_allocation_statistics();
+         if( statistics.node_size == 0 )
+            continue;
+         statistics.space_id = space_id;
+         statistics.type_id = type_id;
+         result.push_back( statistics );
+      }
+   return result;
+}
+
 index& object_database::get_mutable_index(uint8_t space_id, uint8_t type_id)
 {
    FC_ASSERT( _index.size() > space_id, "", ("space_id",space_id)("type_id",type_id)("index.size",_index.size()) );
@@ -72,19 +149,153 @@ void object_database::flush()
 {
 //   ilog("Save object_database in ${d}", ("d", _data_dir));
    fc::create_directories( _data_dir / "object_database.tmp" / "lock" );
+   vector<index_task> tasks;
    for( uint32_t space = 0; space < _index.size(); ++space )
    {
       fc::create_directories( _data_dir / "object_database.tmp" / fc::to_string(space) );
       const auto types = _index[space].size();
       for( uint32_t type = 0; type  <  types; ++type )
          if( _index[space][type] )
-            _index[space][type]->save( _data_dir / "object_database.tmp" / fc::to_string(space)/fc::to_string(type) );
+         {
+            // the size of the previous save is the estimate of the work
+            index* idx = _index[space][type].get();
+            fc::path file = fc::path( fc::to_string(space) ) / fc::to_string(type);
+            tasks.emplace_back( index_file_size( _data_dir / "object_database" / file ), [this, idx, file]() {
+               idx->save( _data_dir / "object_database.tmp" / file );
+            });
+         }
    }
+   run_index_tasks( std::move(tasks) );
    fc::remove_all( _data_dir / "object_database.tmp" / "lock" );
    if( fc::exists( _data_dir / "object_database" ) )
       fc::rename( _data_dir / "object_database", _data_dir / "object_database.old" );
    fc::rename( _data_dir / "object_database.tmp", _data_dir / "object_database" );
    fc::remove_all( _data_dir / "object_database.old" );
+   clear_changes();
+   _untracked_changes = false;
+}
+
+void object_database::track_changes( bool enabled )
+{
+   if( enabled == _track_changes )
+      return;
+   _track_changes = enabled;
+   // the changes from here on are missing from the delta log until the next flush
+   if( !enabled )
+   {
+      clear_changes();
+      _untracked_changes = true;
+   }
+}
+
+void object_database::checkpoint()
+{ try {
+   const fc::path dir = _data_dir / "object_database";
+   if( !fc::exists( dir ) || !_track_changes || _untracked_changes )
+   {
+      flush();
+      return;
+   }
+
+   uint64_t snapshot_size = 0;
+   vector<index*> changed;
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+         if( _index[space][type] )
+         {
+            snapshot_size += index_file_size( dir / fc::to_string(space) / fc::to_string(type) );
+            if( _index[space][type]->has_changes() )
+               changed.push_back( _index[space][type].get() );
+         }
+
+   const fc::path log = dir / "delta.log";
+   if( index_file_size( log ) >= snapshot_size )
+   {
+      flush();
+      return;
+   }
+   if( changed.empty() )
+      return;
+
+   // one batch per checkpoint: payload size, payload and its hash, so a torn write is detected
+   std::ostringstream payload;
+   fc::raw::pack( payload, uint32_t( changed.size() ) );
+   for( index* idx : changed )
+   {
+      fc::raw::pack( payload, idx->object_space_id() );
+      fc::raw::pack( payload, idx->object_type_id() );
+      idx->save_changes( payload );
+   }
+   const std::string data = payload.str();
+
+   std::ofstream out( log.generic_string(), std::ofstream::binary | std::ofstream::out | std::ofstream::app );
+   FC_ASSERT( out );
+   fc::raw::pack( out, uint64_t( data.size() ) );
+   out.write( data.data(), data.size() );
+   fc::raw::pack( out, fc::sha256::hash( data.data(), data.size() ) );
+   out.flush();
+   FC_ASSERT( out, "Failed to write ${f}", ("f", log) );
+
+   for( index* idx : changed )
+      idx->clear_changes();
+} FC_CAPTURE_AND_RETHROW() }
+
+void object_database::replay_delta_log()
+{
+   const fc::path log = _data_dir / "object_database" / "delta.log";
+   if( !fc::exists( log ) )
+      return;
+
+   const uint64_t log_size = fc::file_size( log );
+   uint64_t valid_size = 0;
+   uint32_t batches = 0;
+   if( log_size > 0 )
+   {
+      fc::file_mapping fm( log.generic_string().c_str(), fc::read_only );
+      fc::mapped_region mr( fm, fc::read_only, 0, log_size );
+      fc::datastream<const char*> ds( (const char*)mr.get_address(), mr.get_size() );
+      while( ds.remaining() >= sizeof(uint64_t) )
+      {
+         uint64_t size = 0;
+         fc::raw::unpack( ds, size );
+         if( ds.remaining() < size + sizeof(fc::sha256) )
+            break;
+         const char* data = ds.pos();
+         ds.skip( size );
+         fc::sha256 hash;
+         fc::raw::unpack( ds, hash );
+         if( hash != fc::sha256::hash( data, size ) )
+            break;
+
+         fc::datastream<const char*> payload( data, size );
+         uint32_t num_indexes = 0;
+         fc::raw::unpack( payload, num_indexes );
+         for( uint32_t i = 0; i < num_indexes; ++i )
+         {
+            uint8_t space = 0, type = 0;
+            fc::raw::unpack( payload, space );
+            fc::raw::unpack( payload, type );
+            get_mutable_index( space, type ).load_changes( payload );
+         }
+         valid_size = ds.tellp();
+         ++batches;
+      }
+   }
+
+   if( valid_size < log_size )
+   {
+      wlog( "Dropping ${n} bytes of an incomplete checkpoint", ("n", log_size - valid_size) );
+      fc::resize_file( log, valid_size );
+   }
+   ilog( "Applied ${n} checkpoints", ("n", batches) );
+}
+
+void object_database::clear_changes()
+{
+   for( uint32_t space = 0; space < _index.size(); ++space )
+      for( uint32_t type = 0; type  < _index[space].size(); ++type )
+         if( _index[space][type] )
+            _index[space][type]->clear_changes();
 }
 
 void object_database::wipe(const fc::path& data_dir)
@@ -104,10 +315,19 @@ void object_database::open(const fc::path& data_dir)
        return;
    }
    ilog("Opening object database from ${d} ...", ("d", data_dir));
+   // the indexes do not look at each other while loading, so each one is read by its own task
+   vector<index_task> tasks;
    for( uint32_t space = 0; space < _index.size(); ++space )
       for( uint32_t type = 0; type  < _index[space].size(); ++type )
          if( _index[space][type] )
-            _index[space][type]->open( _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type) );
+         {
+            index* idx = _index[space][type].get();
+            fc::path file = _data_dir / "object_database" / fc::to_string(space)/fc::to_string(type);
+            tasks.emplace_back( index_file_size( file ), [idx, file]() { idx->open( file ); } );
+         }
+   run_index_tasks( std::move(tasks) );
+   replay_delta_log();
+   clear_changes();
    ilog( "Done opening object database." );
 
 } FC_CAPTURE_AND_RETHROW( (data_dir) ) }
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <graphene/db/pool_allocator.hpp>
+
+#include <algorithm>
+
+namespace graphene { namespace db {
+
+namespace {
+   const size_t slab_size = 64 * 1024;
+   const size_t min_nodes_per_slab = 16;
+   const size_t node_alignment = alignof(std::max_align_t);
+}
+
+void* node_pool::allocate( size_t node_size )
+{
+   if( _node_size == 0 )
+   {
+      _node_size = node_size;
+      _statistics.node_size = node_size;
+      // every node can hold the free list link and stays aligned
+      _stride = ( std::max( node_size, sizeof(free_node) ) + node_alignment - 1 ) / node_alignment * node_alignment;
+      _nodes_per_slab = std::max( min_nodes_per_slab, slab_size / _stride );
+   }
+   else if( node_size != _node_size )
+      return nullptr;
+
+   ++_statistics.allocated_nodes;
+   if( _free != nullptr )
+   {
+      free_node* node = _free;
+      _free = node->next;
+      return node;
+   }
+
+   if( _next == _end )
+   {
+      _slabs.emplace_back( new char[ _stride * _nodes_per_slab ] );
+      _next = _slabs.back().get();
+      _end = _next + _stride * _nodes_per_slab;
+      ++_statistics.slabs;
+      _statistics.slab_bytes += _stride * _nodes_per_slab;
+   }
+   void* node = _next;
+   _next += _stride;
+   return node;
+}
+
+bool node_pool::deallocate( void* node, size_t node_size )
+{
+   if( node_size != _node_size )
+      return false;
+   free_node* freed = static_cast<free_node*>( node );
+   freed->next = _free;
+   _free = freed;
+   ++_statistics.freed_nodes;
+   return true;
+}
+
+} } // graphene::db
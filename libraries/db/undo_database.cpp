@@ -25,8 +25,110 @@
 #include <graphene/db/undo_database.hpp>
 #include <fc/reflect/variant.hpp>
 
+#include <cstddef>
+
 namespace graphene { namespace db {
 
+namespace {
+   const size_t arena_alignment = alignof(std::max_align_t);
+   const size_t min_arena_block = 4 * 1024;
+   const size_t max_arena_block = 64 * 1024;
+}
+
+object* undo_arena::clone( const object& obj )
+{
+   return obj.clone_into( allocate( obj.clone_size() ) );
+}
+
+void* undo_arena::allocate( size_t size )
+{
+   size = ( size + arena_alignment - 1 ) & ~( arena_alignment - 1 );
+   if( size > _left )
+   {
+      // the blocks grow with the session, small sessions stay small
+      size_t block_size = _blocks.empty() ? min_arena_block : std::min( max_arena_block, 2 * _blocks.size() * min_arena_block );
+      block_size = std::max( block_size, size );
+      _blocks.emplace_back( new char[block_size] );
+      _next = _blocks.back().get();
+      _left = block_size;
+   }
+   void* result = _next;
+   _next += size;
+   _left -= size;
+   return result;
+}
+
+void undo_arena::splice( undo_arena& other )
+{
+   // keep allocating from the current block, the spliced ones are full enough
+   for( auto& block : other._blocks )
+      _blocks.insert( _blocks.end() - ( _blocks.empty() ? 0 : 1 ), std::move( block ) );
+   other._blocks.clear();
+   other._next = nullptr;
+   other._left = 0;
+}
+
+undo_state::~undo_state()
+{
+   for( auto& entry : _entries )
+      if( entry.value != nullptr )
+         entry.value->~object();
+}
+
+size_t undo_state::slot_of( object_id_type id )const
+{
+   // Fibonacci hashing, the table size is a power of two
+   return size_t( ( id.number * 0x9E3779B97F4A7C15ull ) >> 32 ) & ( _slots.size() - 1 );
+}
+
+const undo_entry* undo_state::find( object_id_type id )const
+{
+   if( _slots.empty() )
+      return nullptr;
+   for( size_t slot = slot_of( id ); _slots[slot] != 0; slot = ( slot + 1 ) & ( _slots.size() - 1 ) )
+   {
+      const undo_entry& entry = _entries[ _slots[slot] - 1 ];
+      if( entry.id == id )
+         return entry.kind != undo_entry::none ? &entry : nullptr;
+   }
+   return nullptr;
+}
+
+undo_entry* undo_state::find( object_id_type id )
+{
+   return const_cast<undo_entry*>( static_cast<const undo_state*>(this)->find( id ) );
+}
+
+undo_entry& undo_state::get( object_id_type id )
+{
+   if( 2 * ( _entries.size() + 1 ) > _slots.size() )
+      rehash( std::max<size_t>( 16, 2 * _slots.size() ) );
+
+   size_t slot = slot_of( id );
+   for( ; _slots[slot] != 0; slot = ( slot + 1 ) & ( _slots.size() - 1 ) )
+   {
+      undo_entry& entry = _entries[ _slots[slot] - 1 ];
+      if( entry.id == id )
+         return entry;
+   }
+   _entries.emplace_back();
+   _entries.back().id = id;
+   _slots[slot] = _entries.size();
+   return _entries.back();
+}
+
+void undo_state::rehash( size_t num_slots )
+{
+   _slots.assign( num_slots, 0 );
+   for( size_t i = 0; i < _entries.size(); ++i )
+   {
+      size_t slot = slot_of( _entries[i].id );
+      while( _slots[slot] != 0 )
+         slot = ( slot + 1 ) & ( num_slots - 1 );
+      _slots[slot] = i + 1;
+   }
+}
+
 void undo_database::enable()  { _disabled = false; }
 void undo_database::disable() { _disabled = true; }
 
@@ -55,7 +157,7 @@ void undo_database::on_create( const object& obj )
    auto itr = state.old_index_next_ids.find( index_id );
    if( itr == state.old_index_next_ids.end() )
       state.old_index_next_ids[index_id] = obj.id;
-   state.new_ids.insert(obj.id);
+   state.get(obj.id).kind = undo_entry::created;
 }
 void undo_database::on_modify( const object& obj )
 {
@@ -64,11 +166,12 @@ void undo_database::on_modify( const object& obj )
    if( _stack.empty() )
       _stack.emplace_back();
    auto& state = _stack.back();
-   if( state.new_ids.find(obj.id) != state.new_ids.end() )
+   // new objects are removed on undo and modified ones keep their first value
+   if( state.find(obj.id) != nullptr )
       return;
-   auto itr =  state.old_values.find(obj.id);
-   if( itr != state.old_values.end() ) return;
-   state.old_values[obj.id] = obj.clone();
+   auto& entry = state.get(obj.id);
+   entry.kind = undo_entry::modified;
+   entry.value = state.arena.clone(obj);
 }
 void undo_database::on_remove( const object& obj )
 {
@@ -77,19 +180,37 @@ void undo_database::on_remove( const object& obj )
    if( _stack.empty() )
       _stack.emplace_back();
    undo_state& state = _stack.back();
-   if( state.new_ids.count(obj.id) )
+   if( auto entry = state.find(obj.id) )
    {
-      state.new_ids.erase(obj.id);
+      if( entry->kind == undo_entry::created )
+         entry->kind = undo_entry::none;
+      else if( entry->kind == undo_entry::modified )
+         entry->kind = undo_entry::removed;
       return;
    }
-   if( state.old_values.count(obj.id) )
+   auto& entry = state.get(obj.id);
+   entry.kind = undo_entry::removed;
+   entry.value = state.arena.clone(obj);
+}
+
+void undo_database::revert( undo_state& state )
+{
+   for( auto& entry : state.entries() )
+      if( entry.kind == undo_entry::modified )
+         _db.modify( _db.get_object( entry.id ), [&]( object& obj ){ obj.move_from( *entry.value ); } );
+
+   for( auto& entry : state.entries() )
+      if( entry.kind == undo_entry::created )
+         _db.remove( _db.get_object( entry.id ) );
+
+   for( auto& item : state.old_index_next_ids )
    {
-      state.removed[obj.id] = std::move(state.old_values[obj.id]);
-      state.old_values.erase(obj.id);
-      return;
+      _db.get_mutable_index( item.first.space(), item.first.type() ).set_next_id( item.second );
    }
-   if( state.removed.count(obj.id) ) return;
-   state.removed[obj.id] = obj.clone();
+
+   for( auto& entry : state.entries() )
+      if( entry.kind == undo_entry::removed )
+         _db.insert( std::move(*entry.value) );
 }
 
 void undo_database::undo()
@@ -98,24 +219,7 @@ void undo_database::undo()
    FC_ASSERT( _active_sessions > 0 );
    disable();
 
-   auto& state = _stack.back();
-   for( auto& item : state.old_values )
-   {
-      _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
-   }
-
-   for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
-   {
-      _db.remove( _db.get_object(*ritr) );
-   }
-
-   for( auto& item : state.old_index_next_ids )
-   {
-      _db.get_mutable_index( item.first.space(), item.first.type() ).set_next_id( item.second );
-   }
-
-   for( auto& item : state.removed )
-      _db.insert( std::move(*item.second) );
+   revert( _stack.back() );
 
    _stack.pop_back();
    enable();
@@ -175,31 +279,61 @@ void undo_database::merge()
    // (a serious logic error which should never happen).
    //
 
-   // We can only be outside type A/AB (the nop path) if B is not nop, so it suffices to iterate through B's three containers.
-
-   // *+upd
-   for( auto& obj : state.old_values )
+   // We can only be outside type A/AB (the nop path) if B is not nop, so it suffices to iterate through B's entries.
+   // The values left in B are destroyed with it, its arena moves to prev_state since values moved there live in it.
+   for( auto& entry : state.entries() )
    {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
-      {
-         // new+upd -> new, type A
-         continue;
-      }
-      if( prev_state.old_values.find(obj.second->id) != prev_state.old_values.end() )
+      undo_entry* prev = prev_state.find( entry.id );
+      switch( entry.kind )
       {
-         // upd(was=X) + upd(was=Y) -> upd(was=X), type A
-         continue;
+         case undo_entry::none:
+            break;
+         case undo_entry::created:
+            // *+new, but we assume the N/A cases don't happen, leaving type B nop+new -> new
+            prev_state.get( entry.id ).kind = undo_entry::created;
+            break;
+         case undo_entry::modified:
+            // new+upd -> new, upd(was=X) + upd(was=Y) -> upd(was=X), type A
+            if( prev != nullptr )
+            {
+               // del+upd -> N/A
+               assert( prev->kind != undo_entry::removed );
+               break;
+            }
+            // nop+upd(was=Y) -> upd(was=Y), type B
+            {
+               undo_entry& merged = prev_state.get( entry.id );
+               merged.kind = undo_entry::modified;
+               merged.value = entry.value;
+               entry.value = nullptr;
+            }
+            break;
+         case undo_entry::removed:
+            if( prev != nullptr && prev->kind == undo_entry::created )
+            {
+               // new + del -> nop (type C)
+               prev->kind = undo_entry::none;
+               break;
+            }
+            if( prev != nullptr && prev->kind == undo_entry::modified )
+            {
+               // upd(was=X) + del(was=Y) -> del(was=X)
+               prev->kind = undo_entry::removed;
+               break;
+            }
+            // del + del -> N/A
+            assert( prev == nullptr );
+            // nop + del(was=Y) -> del(was=Y)
+            {
+               undo_entry& merged = prev_state.get( entry.id );
+               merged.kind = undo_entry::removed;
+               merged.value = entry.value;
+               entry.value = nullptr;
+            }
+            break;
       }
-      // del+upd -> N/A
-      assert( prev_state.removed.find(obj.second->id) == prev_state.removed.end() );
-      // nop+upd(was=Y) -> upd(was=Y), type B
-      prev_state.old_values[obj.second->id] = std::move(obj.second);
    }
 
-   // *+new, but we assume the N/A cases don't happen, leaving type B nop+new -> new
-   for( auto id : state.new_ids )
-      prev_state.new_ids.insert(id);
-
    // old_index_next_ids can only be updated, iterate over *+upd cases
    for( auto& item : state.old_index_next_ids )
    {
@@ -217,28 +351,7 @@ void undo_database::merge()
       }
    }
 
-   // *+del
-   for( auto& obj : state.removed )
-   {
-      if( prev_state.new_ids.find(obj.second->id) != prev_state.new_ids.end() )
-      {
-         // new + del -> nop (type C)
-         prev_state.new_ids.erase(obj.second->id);
-         continue;
-      }
-      auto it = prev_state.old_values.find(obj.second->id);
-      if( it != prev_state.old_values.end() )
-      {
-         // upd(was=X) + del(was=Y) -> del(was=X)
-         prev_state.removed[obj.second->id] = std::move(it->second);
-         prev_state.old_values.erase(obj.second->id);
-         continue;
-      }
-      // del + del -> N/A
-      assert( prev_state.removed.find( obj.second->id ) == prev_state.removed.end() );
-      // nop + del(was=Y) -> del(was=Y)
-      prev_state.removed[obj.second->id] = std::move(obj.second);
-   }
+   prev_state.arena.splice( state.arena );
    _stack.pop_back();
    --_active_sessions;
 }
@@ -255,25 +368,7 @@ void undo_database::pop_commit()
 
    disable();
    try {
-      auto& state = _stack.back();
-
-      for( auto& item : state.old_values )
-      {
-         _db.modify( _db.get_object( item.second->id ), [&]( object& obj ){ obj.move_from( *item.second ); } );
-      }
-
-      for( auto ritr = state.new_ids.begin(); ritr != state.new_ids.end(); ++ritr  )
-      {
-         _db.remove( _db.get_object(*ritr) );
-      }
-
-      for( auto& item : state.old_index_next_ids )
-      {
-         _db.get_mutable_index( item.first.space(), item.first.type() ).set_next_id( item.second );
-      }
-
-      for( auto& item : state.removed )
-         _db.insert( std::move(*item.second) );
+      revert( _stack.back() );
 
       _stack.pop_back();
    }
@@ -1,11 +1,13 @@
 #include <graphene/singularity/activity_index_calculator.hpp>
 #include <graphene/singularity/ncd_aware_rank.hpp>
+#include <chrono>
 #include <ctime>
 #include <boost/numeric/ublas/io.hpp>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <fstream>
 #include <thread>
+#include <algorithm>
 
 using namespace boost::numeric::ublas;
 using namespace boost;
@@ -16,29 +18,28 @@ activity_index_calculator::activity_index_calculator(parameters_t parameters) {
     p_weight_matrix = std::make_shared<matrix_t>(initial_size, initial_size);
 }
 
-void activity_index_calculator::collect_accounts(
+unsigned int activity_index_calculator::collect_accounts(
     account_id_map_t& account_id_map,
     const std::vector<transaction_t>& transactions
 ) {
     std::lock_guard<std::mutex> lock(accounts_lock);
     unsigned int account_id = account_id_map.size();
     for (unsigned int i=0; i<transactions.size(); i++) {
-        transaction_t transaction = transactions[i];
-        account_id_map_t::iterator found_source = account_id_map.find(transaction.source_account);
-        account_id_map_t::iterator found_target = account_id_map.find(transaction.target_account);
-        if (found_source == account_id_map.end()) {
-            account_id_map.insert(account_id_map_t::value_type(transaction.source_account, account_id++));
+        const transaction_t& transaction = transactions[i];
+        if (account_id_map.insert(account_id_map_t::value_type(transaction.source_account, account_id)).second) {
+            account_id++;
         }
-        if (found_target == account_id_map.end()) {
-            account_id_map.insert(account_id_map_t::value_type(transaction.target_account, account_id++));
+        if (account_id_map.insert(account_id_map_t::value_type(transaction.target_account, account_id)).second) {
+            account_id++;
         }
     }
+    return account_id;
 }
 
 void activity_index_calculator::add_block(const std::vector<transaction_t>& transactions) {
     std::vector<transaction_t> filtered_transactions = filter_block(transactions);
     std::lock_guard<std::mutex> lock(weight_matrix_lock);
-    collect_accounts(account_map, filtered_transactions);
+    unsigned int next_account_id = collect_accounts(account_map, filtered_transactions);
     
     total_handled_blocks_count++;
     handled_blocks_count++;
@@ -47,9 +48,9 @@ void activity_index_calculator::add_block(const std::vector<transaction_t>& tran
         *p_weight_matrix *= parameters.decay_koefficient;
     }
     
-    if (p_weight_matrix->size1() < account_map.size()) {
+    if (p_weight_matrix->size1() < next_account_id) {
         matrix_t::size_type new_size = p_weight_matrix->size1();
-        while (new_size < account_map.size()) {
+        while (new_size < next_account_id) {
             new_size *= 2;
         }
         p_weight_matrix = matrix_tools::resize(*p_weight_matrix, new_size, new_size);
@@ -71,6 +72,19 @@ std::vector<transaction_t> singularity::activity_index_calculator::filter_block(
     return filtered_block;
 }
 
+std::vector<id_transaction_t> activity_index_calculator::filter_block(const std::vector<id_transaction_t>& block)
+{
+    std::vector<id_transaction_t> filtered_block;
+    
+    for (auto& transaction: block) {
+        if (check_transaction(transaction)) {
+            filtered_block.push_back(transaction);
+        }
+    }
+    
+    return filtered_block;
+}
+
 void activity_index_calculator::skip_blocks(unsigned int blocks_count)
 {
     std::lock_guard<std::mutex> lock(weight_matrix_lock);
@@ -87,15 +101,118 @@ void activity_index_calculator::skip_blocks(unsigned int blocks_count)
 
 account_activity_index_map_t activity_index_calculator::calculate()
 {
-    if (account_map.size() == 0) {
+    return calculate(account_map, *p_weight_matrix);
+}
+
+account_activity_index_map_t activity_index_calculator::calculate(
+    const account_id_map_t& account_id_map,
+    matrix_t& weight_matrix
+)
+{
+    if (account_id_map.size() == 0) {
         return account_activity_index_map_t();
     }
     ncd_aware_rank nar(parameters);
-    matrix_t outlink_matrix(account_map.size(), account_map.size());
-    calculate_outlink_matrix(outlink_matrix, *p_weight_matrix);
-    std::shared_ptr<vector_t> rank = nar.process(outlink_matrix);
+    auto outlink_start = std::chrono::steady_clock::now();
+    std::shared_ptr<csr_matrix_t> outlink_matrix = calculate_outlink_matrix(account_id_map.size(), weight_matrix);
+    auto outlink_end = std::chrono::steady_clock::now();
+    std::shared_ptr<vector_t> rank;
+    if (initial_index.empty()) {
+        rank = nar.process(*outlink_matrix);
+    } else {
+        rank = nar.process(*outlink_matrix, create_initial_rank(account_id_map));
+    }
+    last_statistics = nar.get_statistics();
+    last_statistics.outlink_matrix_seconds = std::chrono::duration<double>(outlink_end - outlink_start).count();
+    
+    return calculate_score(account_id_map, *rank);
+}
+
+account_activity_index_vector_t activity_index_calculator::calculate(
+    const std::vector<uint32_t>& accounts,
+    matrix_t& weight_matrix
+)
+{
+    account_activity_index_vector_t result;
+    if (accounts.size() == 0) {
+        return result;
+    }
+    ncd_aware_rank nar(parameters);
+    auto outlink_start = std::chrono::steady_clock::now();
+    std::shared_ptr<csr_matrix_t> outlink_matrix = calculate_outlink_matrix(accounts.size(), weight_matrix);
+    auto outlink_end = std::chrono::steady_clock::now();
+    std::shared_ptr<vector_t> rank;
+    if (initial_index_by_id.empty()) {
+        rank = nar.process(*outlink_matrix);
+    } else {
+        rank = nar.process(*outlink_matrix, create_initial_rank(accounts));
+    }
+    last_statistics = nar.get_statistics();
+    last_statistics.outlink_matrix_seconds = std::chrono::duration<double>(outlink_end - outlink_start).count();
+    
+    result.resize(*std::max_element(accounts.begin(), accounts.end()) + 1, 0);
+    for (unsigned int i = 0; i < accounts.size(); i++) {
+        result[accounts[i]] = (*rank)[i];
+    }
+    
+    return result;
+}
+
+vector_t activity_index_calculator::create_initial_rank(const account_id_map_t& account_id_map)
+{
+    double uniform_value = 1.0 / account_id_map.size();
+    vector_t rank(account_id_map.size(), uniform_value);
+    double total = 0;
+    
+    for (auto& account: account_id_map) {
+        auto previous = initial_index.find(account.first);
+        if (previous != initial_index.end() && previous->second > 0) {
+            rank[account.second] = previous->second;
+        }
+        total += rank[account.second];
+    }
     
-    return calculate_score(account_map, *rank);
+    rank /= total;
+    
+    return rank;
+}
+
+vector_t activity_index_calculator::create_initial_rank(const std::vector<uint32_t>& accounts)
+{
+    double uniform_value = 1.0 / accounts.size();
+    vector_t rank(accounts.size(), uniform_value);
+    double total = 0;
+    
+    for (unsigned int i = 0; i < accounts.size(); i++) {
+        if (accounts[i] < initial_index_by_id.size() && initial_index_by_id[accounts[i]] > 0) {
+            rank[i] = initial_index_by_id[accounts[i]];
+        }
+        total += rank[i];
+    }
+    
+    rank /= total;
+    
+    return rank;
+}
+
+void activity_index_calculator::set_initial_index(const account_activity_index_map_t& index)
+{
+    initial_index = index;
+}
+
+void activity_index_calculator::set_initial_index(const account_activity_index_vector_t& index)
+{
+    initial_index_by_id = index;
+}
+
+unsigned int activity_index_calculator::get_last_iteration_count()
+{
+    return last_statistics.rank_iterations;
+}
+
+calculation_statistics_t activity_index_calculator::get_last_statistics()
+{
+    return last_statistics;
 }
 
 bool activity_index_calculator::check_account( account_t account ) 
@@ -109,30 +226,41 @@ bool activity_index_calculator::check_account( account_t account )
 
 bool activity_index_calculator::check_transaction( transaction_t transaction) 
 {
-    if (transaction.amount < parameters.transaction_amount_threshold * parameters.token_usd_rate) {
+    return check_transfer(transaction.amount, transaction.source_account_balance, transaction.target_account_balance);
+}
+
+bool activity_index_calculator::check_transaction( const id_transaction_t& transaction) 
+{
+    return check_transfer(transaction.amount, transaction.source_account_balance, transaction.target_account_balance);
+}
+
+bool activity_index_calculator::check_transfer(double amount, double source_account_balance, double target_account_balance)
+{
+    if (amount < parameters.transaction_amount_threshold * parameters.token_usd_rate) {
         return false;
     }
 
-    if (transaction.source_account_balance < parameters.account_amount_threshold * parameters.token_usd_rate) {
+    if (source_account_balance < parameters.account_amount_threshold * parameters.token_usd_rate) {
         return false;
     }
 
-    if (transaction.target_account_balance < parameters.account_amount_threshold * parameters.token_usd_rate) {
+    if (target_account_balance < parameters.account_amount_threshold * parameters.token_usd_rate) {
         return false;
     }
     
     return true;
 }
 
-void activity_index_calculator::calculate_outlink_matrix(
-    matrix_t& o,
+std::shared_ptr<csr_matrix_t> activity_index_calculator::calculate_outlink_matrix(
+    matrix_t::size_type size,
     matrix_t& weight_matrix
 )
 {
-    matrix_t::size_type size = o.size1();
+    triplet_vector_t triplets;
     {
         std::lock_guard<std::mutex> lock(weight_matrix_lock);
 
+        triplets.reserve(2 * weight_matrix.nnz());
         for (matrix_t::iterator1 i = weight_matrix.begin1(); i != weight_matrix.end1(); i++)
         {
             if (i.index1() >= size) {
@@ -143,23 +271,19 @@ void activity_index_calculator::calculate_outlink_matrix(
                 if (j.index2() >= size) {
                     break;
                 }
-                o(j.index1(), j.index2()) -= *j;
-                o(j.index2(), j.index1()) += *j;
+                triplets.push_back(triplet_t(j.index1(), j.index2(), -*j));
+                triplets.push_back(triplet_t(j.index2(), j.index1(), *j));
             }
         }
     }
     
-    for (matrix_t::iterator1 i = o.begin1(); i != o.end1(); i++)
-    {
-        for (matrix_t::iterator2 j = i.begin(); j != i.end(); j++)
-        {
-            if (*j < 0) {
-                *j = 0;
-            }
-        }
-    }
+    std::shared_ptr<csr_matrix_t> o(new csr_matrix_t(size, size, triplets));
+    
+    o->prune_non_positive();
+    
+    matrix_tools::normalize_columns(*o);
     
-    matrix_tools::normalize_columns(o);
+    return o;
 }
 
 void activity_index_calculator::update_weight_matrix(matrix_t& weight_matrix, account_id_map_t& account_id_map, const std::vector<transaction_t>& transactions) {
@@ -177,7 +301,7 @@ account_activity_index_map_t activity_index_calculator::calculate_score(
     account_activity_index_map_t v;
     
     for (auto i: account_id_map) {
-        v[i.first] = rank[i.second];
+        v[i.first] = i.second < rank.size() ? rank[i.second] : 0;
     }
 
     return v;
@@ -0,0 +1,291 @@
+#include <graphene/singularity/activity_window.hpp>
+#include <algorithm>
+#include <limits>
+
+using namespace singularity;
+
+activity_window_calculator::activity_window_calculator(parameters_t parameters):
+parameters(parameters),
+calculator(parameters)
+{ }
+
+void activity_window_calculator::move_window(uint32_t new_window_start)
+{
+    if (new_window_start == 0) {
+        throw runtime_exception("Window cannot start at block 0");
+    }
+
+    bool aligned = window_start != 0
+        && decay_period == parameters.decay_period
+        && (new_window_start - 1) % decay_period == decay_offset;
+
+    if (window_start != 0 && (new_window_start < window_start || !aligned)) {
+        clear();
+    }
+
+    if (window_start == 0) {
+        if (parameters.decay_period == 0) {
+            throw runtime_exception("Decay period cannot be zero");
+        }
+        decay_period = parameters.decay_period;
+        decay_offset = (new_window_start - 1) % decay_period;
+    } else {
+        uint64_t bucket_number = get_bucket_number(new_window_start);
+        while (!buckets.empty() && first_bucket < bucket_number) {
+            drop_first_bucket();
+        }
+        if (!buckets.empty()) {
+            trim_first_bucket(new_window_start);
+        }
+    }
+
+    last_block = std::max(last_block, new_window_start - 1);
+    window_start = new_window_start;
+}
+
+void activity_window_calculator::add_block(uint32_t block_num, const std::vector<id_transaction_t>& transactions)
+{
+    if (window_start == 0 || block_num < window_start || block_num <= last_block) {
+        throw runtime_exception("Block " + std::to_string(block_num) + " is out of the window order");
+    }
+    last_block = block_num;
+
+    std::vector<id_transaction_t> filtered_transactions = calculator.filter_block(transactions);
+    if (filtered_transactions.empty()) {
+        return;
+    }
+
+    uint64_t bucket_number = get_bucket_number(block_num);
+    if (buckets.empty()) {
+        first_bucket = bucket_number;
+    }
+    while (first_bucket + buckets.size() <= bucket_number) {
+        buckets.push_back(decay_bucket_t());
+    }
+    decay_bucket_t& bucket = buckets.back();
+
+    window_block_t block;
+    block.block_num = block_num;
+    block.transfers.reserve(filtered_transactions.size());
+    for (auto& t: filtered_transactions) {
+        window_transfer_t transfer;
+        transfer.source = get_account_id(t.source_account);
+        transfer.target = get_account_id(t.target_account);
+        transfer.amount = t.amount;
+        add_transfer(bucket, transfer);
+        block.transfers.push_back(transfer);
+    }
+    bucket.blocks.push_back(std::move(block));
+}
+
+uint32_t activity_window_calculator::get_next_block()
+{
+    return std::max(last_block + 1, window_start);
+}
+
+account_activity_index_vector_t activity_window_calculator::calculate(uint32_t window_end)
+{
+    if (window_start == 0 || window_end < last_block) {
+        throw runtime_exception("Window end " + std::to_string(window_end) + " is before the last added block");
+    }
+
+    const unsigned int no_id = std::numeric_limits<unsigned int>::max();
+    std::vector<unsigned int> result_ids(account_instances.size(), no_id);
+    unsigned int account_count = 0;
+
+    // the replay numbers accounts in the order of their first appearance in the window
+    for (auto& bucket: buckets) {
+        for (auto& block: bucket.blocks) {
+            // the new accounts of a block are numbered from the account count
+            unsigned int next_id = account_count;
+            for (auto& transfer: block.transfers) {
+                if (result_ids[transfer.source] == no_id) {
+                    result_ids[transfer.source] = next_id++;
+                    account_count++;
+                }
+                if (result_ids[transfer.target] == no_id) {
+                    result_ids[transfer.target] = next_id++;
+                    account_count++;
+                }
+            }
+        }
+    }
+
+    // the weights are summed and decayed in the order of the replay, which
+    // decays all of them once at the start of every decay period
+    matrix_t weight_matrix(account_count, account_count);
+    uint64_t last_bucket = get_bucket_number(window_end);
+
+    for (uint64_t m = 0; m < buckets.size(); m++) {
+        if (m > 0) {
+            weight_matrix *= parameters.decay_koefficient;
+        }
+        for (auto& block: buckets[m].blocks) {
+            for (auto& transfer: block.transfers) {
+                weight_matrix(result_ids[transfer.source], result_ids[transfer.target]) += transfer.amount;
+            }
+        }
+    }
+    for (uint64_t b = first_bucket + buckets.size(); b <= last_bucket; b++) {
+        weight_matrix *= parameters.decay_koefficient;
+    }
+
+    // the rank is calculated by id, the accounts which are not in the window have none
+    std::vector<uint32_t> ids(account_count);
+    account_activity_index_vector_t seed;
+    uint32_t last_instance = 0;
+    for (unsigned int id = 0; id < account_count; id++) {
+        ids[id] = id;
+    }
+    if (!initial_index.empty()) {
+        seed.assign(account_count, 0);
+    }
+    for (unsigned int i = 0; i < result_ids.size(); i++) {
+        if (result_ids[i] < account_count) {
+            last_instance = std::max(last_instance, account_instances[i]);
+            if (!seed.empty() && account_instances[i] < initial_index.size()) {
+                seed[result_ids[i]] = initial_index[account_instances[i]];
+            }
+        }
+    }
+
+    calculator.set_parameters(parameters);
+    calculator.set_initial_index(seed);
+    account_activity_index_vector_t rank = calculator.calculate(ids, weight_matrix);
+
+    account_activity_index_vector_t result;
+    if (account_count > 0) {
+        result.resize(last_instance + 1, 0);
+        for (unsigned int i = 0; i < result_ids.size(); i++) {
+            if (result_ids[i] < account_count) {
+                result[account_instances[i]] = rank[result_ids[i]];
+            }
+        }
+    }
+
+    return result;
+}
+
+void activity_window_calculator::clear()
+{
+    window_start = 0;
+    last_block = 0;
+    first_bucket = 0;
+    buckets.clear();
+    account_ids.clear();
+    account_instances.clear();
+    account_bucket_count.clear();
+    free_ids.clear();
+}
+
+void activity_window_calculator::set_parameters(parameters_t params)
+{
+    parameters = params;
+    calculator.set_parameters(params);
+}
+
+parameters_t activity_window_calculator::get_parameters()
+{
+    return parameters;
+}
+
+void activity_window_calculator::set_initial_index(const account_activity_index_vector_t& index)
+{
+    initial_index = index;
+}
+
+unsigned int activity_window_calculator::get_last_iteration_count()
+{
+    return calculator.get_last_iteration_count();
+}
+
+calculation_statistics_t activity_window_calculator::get_last_statistics()
+{
+    return calculator.get_last_statistics();
+}
+
+uint64_t activity_window_calculator::get_bucket_number(uint32_t block_num)
+{
+    return (block_num - decay_offset) / decay_period;
+}
+
+unsigned int activity_window_calculator::get_account_id(uint32_t account)
+{
+    if (account < account_ids.size() && account_ids[account] != std::numeric_limits<unsigned int>::max()) {
+        return account_ids[account];
+    }
+    if (account >= account_ids.size()) {
+        account_ids.resize(account + 1, std::numeric_limits<unsigned int>::max());
+    }
+
+    unsigned int id;
+    if (!free_ids.empty()) {
+        id = free_ids.back();
+        free_ids.pop_back();
+        account_instances[id] = account;
+        account_bucket_count[id] = 0;
+    } else {
+        id = account_instances.size();
+        account_instances.push_back(account);
+        account_bucket_count.push_back(0);
+    }
+    account_ids[account] = id;
+
+    return id;
+}
+
+void activity_window_calculator::add_transfer(decay_bucket_t& bucket, const window_transfer_t& transfer)
+{
+    for (unsigned int id: {transfer.source, transfer.target}) {
+        if (bucket.account_set.insert(id).second) {
+            bucket.accounts.push_back(id);
+            account_bucket_count[id]++;
+        }
+    }
+}
+
+void activity_window_calculator::release_account(unsigned int id)
+{
+    if (--account_bucket_count[id] == 0) {
+        account_ids[account_instances[id]] = std::numeric_limits<unsigned int>::max();
+        free_ids.push_back(id);
+    }
+}
+
+void activity_window_calculator::drop_first_bucket()
+{
+    for (unsigned int id: buckets.front().accounts) {
+        release_account(id);
+    }
+
+    buckets.pop_front();
+    first_bucket++;
+}
+
+void activity_window_calculator::trim_first_bucket(uint32_t new_window_start)
+{
+    decay_bucket_t& bucket = buckets.front();
+    if (bucket.blocks.empty() || bucket.blocks.front().block_num >= new_window_start) {
+        return;
+    }
+
+    // the accounts of the bucket are collected again from the remaining blocks
+    std::vector<unsigned int> old_accounts;
+    old_accounts.swap(bucket.accounts);
+    bucket.account_set.clear();
+
+    auto first_remaining = std::find_if(bucket.blocks.begin(), bucket.blocks.end(), [&](const window_block_t& b) {
+        return b.block_num >= new_window_start;
+    });
+    bucket.blocks.erase(bucket.blocks.begin(), first_remaining);
+
+    for (auto& block: bucket.blocks) {
+        for (auto& transfer: block.transfers) {
+            add_transfer(bucket, transfer);
+        }
+    }
+
+    for (unsigned int id: old_accounts) {
+        release_account(id);
+    }
+}
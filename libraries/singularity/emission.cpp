@@ -2,98 +2,60 @@
 
 using namespace singularity;
 
-activity_period::activity_period()
+uint32_t activity_period::get_account_id(const std::string& account)
 {
-    p_weight_matrix = std::make_shared<matrix_t>(initial_size, initial_size);
+    return account_map.insert(std::make_pair(account, uint32_t(account_map.size()))).first->second;
 }
 
-void activity_period::collect_accounts(
-    account_id_map_t& account_id_map,
-    const std::vector<transaction_t>& transactions
-) {
-    std::lock_guard<std::mutex> lock(accounts_lock);
-    unsigned int account_id = account_id_map.size();
-    for (unsigned int i=0; i<transactions.size(); i++) {
-        transaction_t transaction = transactions[i];
-        account_id_map_t::iterator found_source = account_id_map.find(transaction.source_account);
-        account_id_map_t::iterator found_target = account_id_map.find(transaction.target_account);
-        if (found_source == account_id_map.end()) {
-            account_id_map.insert(account_id_map_t::value_type(transaction.source_account, account_id++));
-        }
-        if (found_target == account_id_map.end()) {
-            account_id_map.insert(account_id_map_t::value_type(transaction.target_account, account_id++));
-        }
-    }
-}
-
-void activity_period::add_block(const std::vector<transaction_t>& transactions)
+void activity_period::add_transfer(uint32_t source, uint32_t target, double amount)
 {
-    std::lock_guard<std::mutex> lock(weight_matrix_lock);
-    collect_accounts(account_map, transactions);
+    if (source == target) {
+        return;
+    }
+    
+    uint64_t key = (uint64_t(std::min(source, target)) << 32) | std::max(source, target);
+    pair_flow_t& flow = pair_flows[key];
+    bool was_positive = flow.forward != flow.backward;
+    if (source < target) {
+        flow.forward += amount;
+    } else {
+        flow.backward += amount;
+    }
+    bool is_positive = flow.forward != flow.backward;
     
-    if (p_weight_matrix->size1() < account_map.size()) {
-        matrix_t::size_type new_size = p_weight_matrix->size1();
-        while (new_size < account_map.size()) {
-            new_size *= 2;
+    // a pair with a nonzero net flow gives exactly one positive link
+    if (is_positive != was_positive) {
+        if (is_positive) {
+            positive_links++;
+        } else {
+            positive_links--;
         }
-        p_weight_matrix = matrix_tools::resize(*p_weight_matrix, new_size, new_size);
     }
-
-    update_weight_matrix(*p_weight_matrix, account_map, transactions);
 }
 
-byte_matrix_t activity_period::calculate_link_matrix(
-    matrix_t::size_type size,
-    matrix_t& weight_matrix
-)
+void activity_period::add_block(const std::vector<transaction_t>& transactions)
 {
-    matrix_t l(size, size);
-    {
-        std::lock_guard<std::mutex> lock(weight_matrix_lock);
-
-        for (matrix_t::iterator1 i = weight_matrix.begin1(); i != weight_matrix.end1(); i++)
-        {
-            if (i.index1() >= size) {
-                break;
-            }
-            for (matrix_t::iterator2 j = i.begin(); j != i.end(); j++)
-            {
-                if (j.index2() >= size) {
-                    break;
-                }
-                l(j.index1(), j.index2()) -= *j;
-                l(j.index2(), j.index1()) += *j;
-            }
-        }
-    }
-    
-    byte_matrix_t result(size, size);
-    
-    for (matrix_t::iterator1 i = l.begin1(); i != l.end1(); i++)
-    {
-        for (matrix_t::iterator2 j = i.begin(); j != i.end(); j++)
-        {
-            if (*j > 0) {
-                result(j.index1(), j.index2()) = 1;
-            }
-        }
+    std::lock_guard<std::mutex> lock(flows_lock);
+    for (const transaction_t& t: transactions) {
+        uint32_t source = get_account_id(t.source_account);
+        uint32_t target = get_account_id(t.target_account);
+        add_transfer(source, target, t.amount);
     }
-    
-    return result;
 }
 
-void activity_period::update_weight_matrix(matrix_t& weight_matrix, account_id_map_t& account_id_map, const std::vector<transaction_t>& transactions) {
-    for (unsigned int i=0; i<transactions.size(); i++) {
-        transaction_t t = transactions[i];
-        weight_matrix(account_id_map[t.source_account], account_id_map[t.target_account]) += t.amount;
+void activity_period::add_block(const std::vector<id_transaction_t>& transactions)
+{
+    std::lock_guard<std::mutex> lock(flows_lock);
+    for (const id_transaction_t& t: transactions) {
+        add_transfer(t.source_account, t.target_account, t.amount);
     }
 }
 
 double activity_period::get_activity()
 {
-    byte_matrix_t n = calculate_link_matrix(account_map.size(), *p_weight_matrix);
+    std::lock_guard<std::mutex> lock(flows_lock);
     
-    return (double) n.nnz();
+    return (double) positive_links;
 }
 
 uint64_t emission_calculator::calculate(uint64_t total_emission, activity_period& period)
@@ -126,9 +88,11 @@ singularity::emission_state_t singularity::emission_calculator::get_emission_sta
 
 void activity_period::clear()
 {
-    std::lock_guard<std::mutex> lock(weight_matrix_lock);
+    std::lock_guard<std::mutex> lock(flows_lock);
     
-    p_weight_matrix->clear();
+    account_map.clear();
+    pair_flows.clear();
+    positive_links = 0;
 }
 
 singularity::emission_parameters_t singularity::emission_calculator::get_parameters()
@@ -10,6 +10,8 @@ namespace singularity {
     
     typedef std::map<std::string, unsigned int> account_id_map_t;
     typedef std::map<std::string, double> account_activity_index_map_t;
+    /** Activity indexes addressed by the account instance number, absent accounts have 0 */
+    typedef std::vector<double> account_activity_index_vector_t;
     
     struct account_t {
         double amount;
@@ -43,6 +45,17 @@ namespace singularity {
         { }
     };
     
+    /** transaction_t with the accounts given by their instance numbers */
+    struct id_transaction_t {
+        double amount;
+        double comission;
+        uint32_t source_account;
+        uint32_t target_account;
+        double source_account_balance;
+        double target_account_balance;
+        time_t timestamp;
+    };
+
     class activity_index_calculator 
     {
     public:
@@ -51,17 +64,45 @@ namespace singularity {
         void add_block(const std::vector<transaction_t>& transactions);
         void skip_blocks(unsigned int blocks_count);
         account_activity_index_map_t calculate();
+        account_activity_index_map_t calculate(
+            const account_id_map_t& account_id_map,
+            matrix_t& weight_matrix
+        );
+        /**
+         * Same as the map version, accounts[i] is the instance number of
+         * the account in row i of the weight matrix.
+         */
+        account_activity_index_vector_t calculate(
+            const std::vector<uint32_t>& accounts,
+            matrix_t& weight_matrix
+        );
         bool check_account( account_t account);
         bool check_transaction( transaction_t transaction);
+        bool check_transaction( const id_transaction_t& transaction);
         void save_state_to_file(std::string filename);
         void load_state_from_file(std::string filename);
         unsigned int get_total_handled_block_count();
         std::vector<transaction_t> filter_block(const std::vector<transaction_t>& block);
+        std::vector<id_transaction_t> filter_block(const std::vector<id_transaction_t>& block);
         void set_parameters(parameters_t params);
         parameters_t get_parameters();
+        /**
+         * Seeds the rank with a previous result. Accounts missing from it
+         * start with the uniform value, the seed is renormalised to the
+         * total of the uniform start. An empty map restores the uniform start.
+         */
+        void set_initial_index(const account_activity_index_map_t& index);
+        /** Seed for the calculations addressed by instance numbers */
+        void set_initial_index(const account_activity_index_vector_t& index);
+        /** Number of rank iterations made by the last calculate() */
+        unsigned int get_last_iteration_count();
+        calculation_statistics_t get_last_statistics();
     private:
         friend class boost::serialization::access;
         parameters_t parameters;
+        account_activity_index_map_t initial_index;
+        account_activity_index_vector_t initial_index_by_id;
+        calculation_statistics_t last_statistics;
         
         unsigned int total_handled_blocks_count = 0;
         unsigned int handled_blocks_count = 0;
@@ -70,16 +111,20 @@ namespace singularity {
         std::mutex accounts_lock;
         std::mutex weight_matrix_lock;
                 
+        vector_t create_initial_rank(const account_id_map_t& account_id_map);
+        vector_t create_initial_rank(const std::vector<uint32_t>& accounts);
+        bool check_transfer(double amount, double source_account_balance, double target_account_balance);
         account_activity_index_map_t calculate_score(
             const account_id_map_t& account_id_map,
             const vector_t& rank
         );
-        void collect_accounts(
+        /** @return the id after the last one given to an account of the block */
+        unsigned int collect_accounts(
             account_id_map_t& account_id_map,
             const std::vector<transaction_t>& transactions
         );
-        void calculate_outlink_matrix(
-            matrix_t& o,
+        std::shared_ptr<csr_matrix_t> calculate_outlink_matrix(
+            matrix_t::size_type size,
             matrix_t& weight_matrix
         );
         void update_weight_matrix(
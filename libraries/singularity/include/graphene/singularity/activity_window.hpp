@@ -0,0 +1,92 @@
+
+#ifndef ACTIVITY_WINDOW_HPP
+#define ACTIVITY_WINDOW_HPP
+
+#include <deque>
+#include <set>
+#include <graphene/singularity/activity_index_calculator.hpp>
+
+namespace singularity {
+
+    struct window_transfer_t {
+        unsigned int source;
+        unsigned int target;
+        double amount;
+    };
+
+    struct window_block_t {
+        uint32_t block_num;
+        std::vector<window_transfer_t> transfers;
+    };
+
+    /**
+     * Blocks of the window which share the same decay exponent,
+     * i.e. blocks between two consecutive decays of the full replay.
+     */
+    struct decay_bucket_t {
+        std::vector<window_block_t> blocks;
+        // accounts in the order of their first appearance in the bucket
+        std::vector<unsigned int> accounts;
+        std::set<unsigned int> account_set;
+    };
+
+    /**
+     * Sliding window version of activity_index_calculator.
+     *
+     * The filtered transfers are kept between the calculations grouped by
+     * decay period, so moving the window only adds the new blocks, drops the
+     * buckets which have left it and trims the one bucket it starts in.
+     * calculate() sums the weights in the order of the replay of the whole
+     * window through activity_index_calculator and decays them by the same
+     * multiplications, so the result is bit-identical to the replay.
+     */
+    class activity_window_calculator
+    {
+    public:
+        activity_window_calculator(parameters_t parameters);
+        /**
+         * Moves the beginning of the window. If the window cannot be moved
+         * without changing the decay alignment, all the state is dropped
+         * and the blocks have to be added again.
+         */
+        void move_window(uint32_t window_start);
+        /** Adds a block using the current parameters for filtering */
+        void add_block(uint32_t block_num, const std::vector<id_transaction_t>& transactions);
+        /** Returns the number of the first block which has to be added */
+        uint32_t get_next_block();
+        account_activity_index_vector_t calculate(uint32_t window_end);
+        void clear();
+        void set_parameters(parameters_t params);
+        parameters_t get_parameters();
+        /** @see activity_index_calculator::set_initial_index */
+        void set_initial_index(const account_activity_index_vector_t& index);
+        unsigned int get_last_iteration_count();
+        calculation_statistics_t get_last_statistics();
+    private:
+        parameters_t parameters;
+        activity_index_calculator calculator;
+        account_activity_index_vector_t initial_index;
+
+        uint32_t window_start = 0;
+        uint32_t last_block = 0;
+        uint32_t decay_offset = 0;
+        uint32_t decay_period = 0;
+        uint64_t first_bucket = 0;
+        std::deque<decay_bucket_t> buckets;
+
+        // internal ids by account instance and back
+        std::vector<unsigned int> account_ids;
+        std::vector<uint32_t> account_instances;
+        std::vector<unsigned int> account_bucket_count;
+        std::vector<unsigned int> free_ids;
+
+        uint64_t get_bucket_number(uint32_t block_num);
+        unsigned int get_account_id(uint32_t account);
+        void add_transfer(decay_bucket_t& bucket, const window_transfer_t& transfer);
+        void release_account(unsigned int id);
+        void drop_first_bucket();
+        void trim_first_bucket(uint32_t new_window_start);
+    };
+}
+
+#endif /* ACTIVITY_WINDOW_HPP */
@@ -4,6 +4,7 @@
 
 #include <graphene/singularity/utils.hpp>
 #include <graphene/singularity/activity_index_calculator.hpp>
+#include <unordered_map>
 
 namespace singularity {
 
@@ -27,32 +28,39 @@ namespace singularity {
         double last_activity = 0;
     };
     
+    /**
+     * Counts the positive net links between accounts over a period. The
+     * transfers of every account pair are summed in both directions as the
+     * blocks arrive, so the count is kept up to date without building the
+     * flow matrix.
+     */
     class activity_period
     {
     public:
-        activity_period();
-        const matrix_t::size_type initial_size = 10000;
+        activity_period() {};
         void add_block(const std::vector<transaction_t>& transactions);
+        /**
+         * Adds transfers between accounts given by the instance numbers, a
+         * period should be fed either by names or by instances.
+         */
+        void add_block(const std::vector<id_transaction_t>& transactions);
         double get_activity();
         void clear();
     private:
-        account_id_map_t account_map;
-        std::mutex accounts_lock;
-        std::mutex weight_matrix_lock;
-        std::shared_ptr<matrix_t> p_weight_matrix;
-        void collect_accounts(
-            account_id_map_t& account_id_map,
-            const std::vector<transaction_t>& transactions
-        );
-        byte_matrix_t calculate_link_matrix(
-            matrix_t::size_type size,
-            matrix_t& weight_matrix
-        );
-        void update_weight_matrix(
-            matrix_t& weight_matrix,
-            account_id_map_t& account_id_map,
-            const std::vector<transaction_t>& transactions
-        );
+        struct pair_flow_t
+        {
+            // transfers from the lower account to the higher one and back
+            double forward = 0;
+            double backward = 0;
+        };
+        typedef std::unordered_map<uint64_t, pair_flow_t> pair_flow_map_t;
+        
+        std::mutex flows_lock;
+        std::map<std::string, uint32_t> account_map;
+        pair_flow_map_t pair_flows;
+        uint64_t positive_links = 0;
+        uint32_t get_account_id(const std::string& account);
+        void add_transfer(uint32_t source, uint32_t target, double amount);
     };
 
     class emission_calculator
@@ -8,34 +8,56 @@ namespace singularity {
     class ncd_aware_rank
     {
     public:
-        ncd_aware_rank(parameters_t parameters):parameters(parameters) {};
+        ncd_aware_rank(parameters_t parameters):parameters(parameters), pool(parameters.num_threads) {};
         const uint32_t MAX_ITERATIONS = 1000;
         std::shared_ptr<vector_t> process(
-            const matrix_t& outlink_matrix
+            const csr_matrix_t& outlink_matrix
         );
+        /** Starts the iterations from initial_rank instead of the uniform vector */
+        std::shared_ptr<vector_t> process(
+            const csr_matrix_t& outlink_matrix,
+            const vector_t& initial_rank
+        );
+        /** Number of power iterations made by the last process() */
+        unsigned int get_iteration_count() { return statistics.rank_iterations; }
+        /** Clustering and rank timings of the last process() */
+        calculation_statistics_t get_statistics() { return statistics; }
     private:
         parameters_t parameters;
+        thread_pool pool;
+        // row partitions of the matrices, balanced by the nonzero count
+        std::vector<range_t> outlink_ranges;
+        std::vector<range_t> interlevel_l_ranges;
+        calculation_statistics_t statistics;
         double const precision = 0.01;
         std::shared_ptr<vector_t> calculate_ncd_aware_rank(
-            const matrix_t& outlink_matrix, 
+            const csr_matrix_t& outlink_matrix, 
             const sparce_vector_t& outlink_vector, 
-            const matrix_t& interlevel_matrix_s, 
-            const matrix_t& intelevel_matrix_l
+            const csr_matrix_t& interlevel_matrix_s, 
+            const csr_matrix_t& intelevel_matrix_l,
+            const vector_t& initial_rank
         );
-        std::shared_ptr<matrix_t> create_interlevel_matrix_s(const Graph& g);
-        std::shared_ptr<matrix_t> create_interlevel_matrix_l(
-            const Graph& g, 
-            const matrix_t& outlink_matrix
+        std::shared_ptr<csr_matrix_t> create_interlevel_matrix_s(const scan_result_t& clusters);
+        std::shared_ptr<csr_matrix_t> create_interlevel_matrix_l(
+            const scan_result_t& clusters, 
+            const csr_matrix_t& outlink_matrix
         );
-        std::shared_ptr<vector_t> iterate(
-            const matrix_t& outlink_matrix, 
-            const sparce_vector_t& outlink_vector, 
-            const matrix_t& interlevel_matrix_s, 
-            const matrix_t& interlevel_matrix_l, 
+        /**
+         * One power iteration step for the rows in the range, the dangling
+         * correction and the teleportation are the same for every row.
+         * @return the part of norm_1(next - previous) for the range
+         */
+        double iterate_partial(
+            const csr_matrix_t& outlink_matrix, 
+            const csr_matrix_t& interlevel_matrix_s, 
             const vector_t& previous,
-            const vector_t& teleportation
+            const vector_t& cluster_values,
+            double correction,
+            double teleportation,
+            vector_t& next,
+            range_t range
         );
-        Graph create_graph(const matrix_t& m);
+        csr_graph_t create_graph(const csr_matrix_t& m);
     };
 }
 
@@ -64,6 +64,39 @@ namespace singularity {
             GraphProperties
     > Graph;
 
+    typedef std::pair<unsigned int, unsigned int> edge_t;
+
+    /**
+     * Undirected graph in the compressed sparse row form. Every edge is
+     * stored in the lists of both its ends, the lists are sorted and have
+     * neither loops nor parallel edges.
+     */
+    class csr_graph_t
+    {
+    public:
+        typedef std::size_t size_type;
+
+        csr_graph_t(size_type num_vertices, const std::vector<edge_t>& edges);
+
+        size_type num_vertices() const { return offsets.size() - 1; }
+        size_type num_entries() const { return neighbours.size(); }
+        size_type degree(size_type vertex) const { return offsets[vertex + 1] - offsets[vertex]; }
+        size_type neighbours_begin(size_type vertex) const { return offsets[vertex]; }
+        size_type neighbours_end(size_type vertex) const { return offsets[vertex + 1]; }
+        unsigned int neighbour(size_type k) const { return neighbours[k]; }
+        /** Position of the edge in the list of the vertex */
+        size_type find(size_type vertex, unsigned int neighbour) const;
+    private:
+        std::vector<size_type> offsets;
+        std::vector<unsigned int> neighbours;
+    };
+
+    struct scan_result_t {
+        std::vector<unsigned int> cluster_ids;
+        std::vector<node_status_t> statuses;
+        unsigned int num_clusters = 0;
+    };
+
     class id_generator
     {
     public:
@@ -77,12 +110,31 @@ namespace singularity {
     class scan
     {
     public:
-        scan(double parameter_e, uint parameter_m);
+        scan(double parameter_e, uint parameter_m, unsigned int num_threads = 1);
         void process(Graph &g);
+        /**
+         * Same clustering as process(Graph&), the similarities are found by
+         * merging the sorted neighbour lists on num_threads threads.
+         */
+        scan_result_t process(const csr_graph_t& g);
         void print_graph(Graph& g);
     private:
         double parameter_e;
         uint parameter_m;
+        unsigned int num_threads;
+        void calculate_similarity_partial(const csr_graph_t& g, range_t r, std::vector<uint8_t>& similarity_is_high);
+        void calculate_cores_partial(
+            const csr_graph_t& g,
+            range_t r,
+            const std::vector<uint8_t>& similarity_is_high,
+            std::vector<uint8_t>& is_core
+        );
+        void find_clusters(
+            const csr_graph_t& g,
+            const std::vector<uint8_t>& similarity_is_high,
+            const std::vector<uint8_t>& is_core,
+            scan_result_t& result
+        );
         void calculate_neighbours(Graph &g);
         void calculate_neighbours_partial(Graph &g, range_t r);
         void calculate_neighbours(Graph &g, Graph::vertex_descriptor vertex);
@@ -5,5 +5,6 @@
 #include <graphene/singularity/emission.hpp>
 #include <graphene/singularity/gravity_index_calculator.hpp>
 #include <graphene/singularity/activity_index_calculator.hpp>
+#include <graphene/singularity/activity_window.hpp>
 
 #endif
@@ -3,6 +3,11 @@
 #define UTILS_HPP
 
 #include <cstdlib>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <boost/numeric/ublas/vector.hpp>
 #include <boost/numeric/ublas/matrix_sparse.hpp>
 #include <boost/graph/adjacency_list.hpp>
@@ -32,16 +37,106 @@ namespace singularity {
         unsigned int num_threads = 1;
         double token_usd_rate = 1;
     };
+
+    /** Time spent in the stages of the last activity index calculation */
+    struct calculation_statistics_t {
+        double outlink_matrix_seconds = 0;
+        double clustering_seconds = 0;
+        double rank_seconds = 0;
+        unsigned int rank_iterations = 0;
+    };
+
+    struct triplet_t {
+        index_t row;
+        index_t column;
+        double value;
+        triplet_t(index_t row, index_t column, double value) :
+        row(row),
+        column(column),
+        value(value)
+        { }
+    };
+
+    typedef std::vector<triplet_t> triplet_vector_t;
+
+    /**
+     * Compressed sparse row matrix. It is built once from a list of triplets
+     * (duplicates are summed in the order they were added) and then only
+     * read, so all the data lives in three contiguous arrays.
+     */
+    class csr_matrix_t
+    {
+    public:
+        typedef std::size_t size_type;
+
+        csr_matrix_t();
+        csr_matrix_t(size_type size1, size_type size2);
+        csr_matrix_t(size_type size1, size_type size2, const triplet_vector_t& triplets);
+
+        size_type size1() const { return rows; }
+        size_type size2() const { return columns; }
+        size_type nnz() const { return values.size(); }
+
+        size_type row_begin(size_type row) const { return row_offsets[row]; }
+        size_type row_end(size_type row) const { return row_offsets[row + 1]; }
+        index_t column(size_type k) const { return column_indices[k]; }
+        double value(size_type k) const { return values[k]; }
+        double& value(size_type k) { return values[k]; }
+
+        /** Drops all the entries which are not positive */
+        void prune_non_positive();
+        void scale(double factor);
+    private:
+        size_type rows;
+        size_type columns;
+        std::vector<size_type> row_offsets;
+        std::vector<index_t> column_indices;
+        std::vector<double> values;
+    };
     
+    /**
+     * Fixed set of worker threads kept for the whole calculation, so the
+     * power iterations do not start new threads on every product. The
+     * calling thread takes part in the work as well.
+     */
+    class thread_pool
+    {
+    public:
+        explicit thread_pool(unsigned int num_threads);
+        ~thread_pool();
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        unsigned int size() const { return workers.size() + 1; }
+        /** Calls task(i) for every i in [0, num_tasks) and waits until all of them are done */
+        void run(unsigned int num_tasks, const std::function<void(unsigned int)>& task);
+    private:
+        std::vector<std::thread> workers;
+        std::mutex lock;
+        std::condition_variable task_ready;
+        std::condition_variable task_done;
+        const std::function<void(unsigned int)>* current_task = nullptr;
+        unsigned int task_count = 0;
+        std::atomic<unsigned int> next_task;
+        unsigned int busy_workers = 0;
+        uint64_t generation = 0;
+        bool stopping = false;
+
+        void work();
+        void run_tasks();
+    };
+
     namespace matrix_tools
     {
-        void normalize_columns(matrix_t &m);
+        void normalize_columns(csr_matrix_t &m);
         void normalize_rows(matrix_t &m);
-        sparce_vector_t calculate_correction_vector(const matrix_t& o);
+        sparce_vector_t calculate_correction_vector(const csr_matrix_t& o);
         std::shared_ptr<matrix_t> resize(matrix_t& m, matrix_t::size_type size1, matrix_t::size_type size2);
-        void prod( vector_t& out, const matrix_t& m, const vector_t& v, unsigned int num_threads);
-        void partial_prod( vector_t& out, const matrix_t& m, const vector_t& v, range_t range);
+        void prod( vector_t& out, const csr_matrix_t& m, const vector_t& v, thread_pool& pool, const std::vector<range_t>& ranges);
+        void partial_prod( vector_t& out, const csr_matrix_t& m, const vector_t& v, range_t range);
         std::vector<range_t> split_range(range_t range, unsigned int max);
+        /** Splits the rows into at most max ranges with about the same number of nonzeros */
+        std::vector<range_t> split_rows(const csr_matrix_t& m, unsigned int max);
     };
     
     class runtime_exception: public std::runtime_error
@@ -1,157 +1,199 @@
 #include <graphene/singularity/ncd_aware_rank.hpp>
 #include <boost/numeric/ublas/io.hpp>
+#include <chrono>
+#include <cmath>
 
 using namespace boost;
 using namespace boost::numeric::ublas;
 using namespace singularity;
 
 std::shared_ptr<vector_t> ncd_aware_rank::process(
-        const matrix_t& outlink_matrix
+        const csr_matrix_t& outlink_matrix
 ) {
-    sparce_vector_t v = matrix_tools::calculate_correction_vector(outlink_matrix);
-    Graph g = create_graph(outlink_matrix);
-    scan scan(parameters.clustering_e, parameters.clustering_m);
-    scan.process(g);
-    std::shared_ptr<matrix_t> ms = create_interlevel_matrix_s(g);
-    std::shared_ptr<matrix_t> ml = create_interlevel_matrix_l(g, outlink_matrix);
-    
-    return calculate_ncd_aware_rank(outlink_matrix, v, *ms, *ml);
+    return process(outlink_matrix, vector_t(outlink_matrix.size2(), 1.0/outlink_matrix.size2()));
 }
 
-std::shared_ptr<vector_t> ncd_aware_rank::iterate(
-        const matrix_t& outlink_matrix, 
-        const sparce_vector_t& outlink_vector, 
-        const matrix_t& interlevel_matrix_s, 
-        const matrix_t& interlevel_matrix_l, 
-        const vector_t& previous,
-        const vector_t& teleportation
+std::shared_ptr<vector_t> ncd_aware_rank::process(
+        const csr_matrix_t& outlink_matrix,
+        const vector_t& initial_rank
 ) {
-    unsigned int num_accounts = outlink_matrix.size2();
-    vector_t tmp(interlevel_matrix_l.size1(), 0); 
-    matrix_tools::prod(tmp, interlevel_matrix_l, previous, parameters.num_threads);
-    
-    vector_t tmp2(interlevel_matrix_s.size1(), 0);
-    std::shared_ptr<vector_t> next(new vector_t(outlink_matrix.size1(), 0));
-    
-    matrix_tools::prod(*next, outlink_matrix, previous, parameters.num_threads);
-    matrix_tools::prod(tmp2, interlevel_matrix_s, tmp, parameters.num_threads);
+    if (initial_rank.size() != outlink_matrix.size2()) {
+        throw runtime_exception("Initial rank size does not match the matrix");
+    }
+    auto clustering_start = std::chrono::steady_clock::now();
+    sparce_vector_t v = matrix_tools::calculate_correction_vector(outlink_matrix);
+    csr_graph_t g = create_graph(outlink_matrix);
+    scan scan(parameters.clustering_e, parameters.clustering_m, parameters.num_threads);
+    scan_result_t clusters = scan.process(g);
+    std::shared_ptr<csr_matrix_t> ms = create_interlevel_matrix_s(clusters);
+    std::shared_ptr<csr_matrix_t> ml = create_interlevel_matrix_l(clusters, outlink_matrix);
+    auto rank_start = std::chrono::steady_clock::now();
     
-    *next += tmp2;
+    std::shared_ptr<vector_t> rank = calculate_ncd_aware_rank(outlink_matrix, v, *ms, *ml, initial_rank);
     
-    vector_t correction_vector(num_accounts, inner_prod(outlink_vector, previous));
+    auto rank_end = std::chrono::steady_clock::now();
+    statistics.clustering_seconds = std::chrono::duration<double>(rank_start - clustering_start).count();
+    statistics.rank_seconds = std::chrono::duration<double>(rank_end - rank_start).count();
     
-    *next += correction_vector;
-    *next += teleportation;
+    return rank;
+}
+
+double ncd_aware_rank::iterate_partial(
+        const csr_matrix_t& outlink_matrix, 
+        const csr_matrix_t& interlevel_matrix_s, 
+        const vector_t& previous,
+        const vector_t& cluster_values,
+        double correction,
+        double teleportation,
+        vector_t& next,
+        range_t range
+) {
+    const double* previous_data = &previous.data()[0];
+    const double* cluster_data = &cluster_values.data()[0];
+    double* next_data = &next.data()[0];
+    double norm = 0;
+    
+    for (range_t::size_type i = range.start(); i < range.start() + range.size(); i++) {
+        double outlink_value = 0;
+        for (csr_matrix_t::size_type k = outlink_matrix.row_begin(i); k < outlink_matrix.row_end(i); k++) {
+            outlink_value += outlink_matrix.value(k) * previous_data[outlink_matrix.column(k)];
+        }
+        double interlevel_value = 0;
+        for (csr_matrix_t::size_type k = interlevel_matrix_s.row_begin(i); k < interlevel_matrix_s.row_end(i); k++) {
+            interlevel_value += interlevel_matrix_s.value(k) * cluster_data[interlevel_matrix_s.column(k)];
+        }
+        
+        double value = outlink_value + interlevel_value + correction + teleportation;
+        next_data[i] = value;
+        norm += std::abs(value - previous_data[i]);
+    }
     
-    return next;
+    return norm;
 }
 
 std::shared_ptr<vector_t> ncd_aware_rank::calculate_ncd_aware_rank(
-        const matrix_t& outlink_matrix, 
+        const csr_matrix_t& outlink_matrix, 
         const sparce_vector_t& outlink_vector, 
-        const matrix_t& interlevel_matrix_s, 
-        const matrix_t& interlevel_matrix_l
+        const csr_matrix_t& interlevel_matrix_s, 
+        const csr_matrix_t& interlevel_matrix_l,
+        const vector_t& initial_rank
 ) {
     unsigned int num_accounts = outlink_matrix.size2();
     double initialValue = 1.0/num_accounts;
-    std::shared_ptr<vector_t> next;
-    std::shared_ptr<vector_t> previous(new vector_t(num_accounts, initialValue));
-    vector_t teleportation = (*previous) * (1.0 - parameters.outlink_weight - parameters.interlevel_weight) ;
+    double teleportation = initialValue * (1.0 - parameters.outlink_weight - parameters.interlevel_weight);
     
-    matrix_t outlink_matrix_weighted = outlink_matrix * parameters.outlink_weight;
-    matrix_t interlevel_matrix_s_weighted = interlevel_matrix_s * parameters.interlevel_weight;
+    csr_matrix_t outlink_matrix_weighted = outlink_matrix;
+    outlink_matrix_weighted.scale(parameters.outlink_weight);
+    csr_matrix_t interlevel_matrix_s_weighted = interlevel_matrix_s;
+    interlevel_matrix_s_weighted.scale(parameters.interlevel_weight);
     sparce_vector_t outlink_vector_weighted = outlink_vector * parameters.outlink_weight;
     
+    outlink_ranges = matrix_tools::split_rows(outlink_matrix_weighted, pool.size());
+    interlevel_l_ranges = matrix_tools::split_rows(interlevel_matrix_l, pool.size());
+    
+    // everything the iterations use is allocated here, the two rank buffers swap roles every step
+    std::shared_ptr<vector_t> previous(new vector_t(initial_rank));
+    std::shared_ptr<vector_t> next(new vector_t(num_accounts, 0));
+    vector_t cluster_values(interlevel_matrix_l.size1(), 0);
+    std::vector<double> partial_norms(outlink_ranges.size(), 0);
+    double correction = 0;
+    
+    std::function<void(unsigned int)> cluster_step = [&](unsigned int r) {
+        matrix_tools::partial_prod(cluster_values, interlevel_matrix_l, *previous, interlevel_l_ranges[r]);
+    };
+    std::function<void(unsigned int)> rank_step = [&](unsigned int r) {
+        partial_norms[r] = iterate_partial(
+            outlink_matrix_weighted, interlevel_matrix_s_weighted, *previous, cluster_values,
+            correction, teleportation, *next, outlink_ranges[r]
+        );
+    };
+    
+    statistics.rank_iterations = 0;
     for (uint i = 0; i < MAX_ITERATIONS; i++) {
-        next  = iterate(outlink_matrix_weighted, outlink_vector_weighted, interlevel_matrix_s_weighted, interlevel_matrix_l, *previous, teleportation);
-        double norm = norm_1(*next - *previous);
+        statistics.rank_iterations++;
+        pool.run(interlevel_l_ranges.size(), cluster_step);
+        correction = inner_prod(outlink_vector_weighted, *previous);
+        pool.run(outlink_ranges.size(), rank_step);
+        
+        double norm = 0;
+        for (double partial_norm: partial_norms) {
+            norm += partial_norm;
+        }
         if (norm <= precision) {
             return next;
         } else {
-            previous = next;
+            std::swap(previous, next);
         }
     }
     
-    return next;
+    return previous;
 }
 
 
-std::shared_ptr<matrix_t> ncd_aware_rank::create_interlevel_matrix_s(const Graph& g)
+std::shared_ptr<csr_matrix_t> ncd_aware_rank::create_interlevel_matrix_s(const scan_result_t& clusters)
 {
-    Graph::vertex_iterator current, end;
-    
-    unsigned int num_clasters = get_property(g, graph_num_clusters);
+    unsigned int num_vertices = clusters.cluster_ids.size();
     
-    std::shared_ptr<matrix_t> S(new matrix_t(num_vertices(g), num_clasters));
+    triplet_vector_t triplets;
+    triplets.reserve(num_vertices);
     
-    tie(current, end) = vertices(g);
-    
-    for ( ; current != end; current++) {
-        unsigned int index = get(vertex_index, g, *current);
-        unsigned int cluster_id = get(vertex_cluster_id, g, *current);
-        (*S)(index, cluster_id) = 1;
+    for (unsigned int index = 0; index < num_vertices; index++) {
+        triplets.push_back(triplet_t(index, clusters.cluster_ids[index], 1));
     }
 
+    std::shared_ptr<csr_matrix_t> S(new csr_matrix_t(num_vertices, clusters.num_clusters, triplets));
+
     matrix_tools::normalize_columns(*S);
     
     return S;
 }
 
-std::shared_ptr<matrix_t> ncd_aware_rank::create_interlevel_matrix_l(
-        const Graph& g, 
-        const matrix_t& outlink_matrix
+std::shared_ptr<csr_matrix_t> ncd_aware_rank::create_interlevel_matrix_l(
+        const scan_result_t& clusters, 
+        const csr_matrix_t& outlink_matrix
 ) 
 {
-    unsigned int num_clusters = get_property(g, graph_num_clusters);
-
-    Graph::vertex_iterator start, end;
-    
-    tie(start, end) = vertices(g);
+    triplet_vector_t triplets;
+    triplets.reserve(outlink_matrix.size1() + outlink_matrix.nnz());
     
-    std::shared_ptr<matrix_t> L(new matrix_t(num_clusters, num_vertices(g)));
-    
-    for (matrix_t::const_iterator1 i = outlink_matrix.begin1(); i != outlink_matrix.end1(); i++)
+    for (csr_matrix_t::size_type i = 0; i < outlink_matrix.size1(); i++)
     {
-        Graph::vertex_descriptor vertex = start[i.index1()];
-        unsigned int clusterId = get(vertex_cluster_id, g, vertex);
-        (*L)(clusterId, i.index1()) = 1;
-        for (matrix_t::const_iterator2 j = i.begin(); j != i.end(); j++)
+        unsigned int clusterId = clusters.cluster_ids[i];
+        triplets.push_back(triplet_t(clusterId, i, 1));
+        for (csr_matrix_t::size_type k = outlink_matrix.row_begin(i); k < outlink_matrix.row_end(i); k++)
         {
-            if (*j > 0) {
-                (*L)(clusterId, j.index2()) = 1;
+            if (outlink_matrix.value(k) > 0) {
+                triplets.push_back(triplet_t(clusterId, outlink_matrix.column(k), 1));
             }
         }
     }
     
+    std::shared_ptr<csr_matrix_t> L(new csr_matrix_t(clusters.num_clusters, clusters.cluster_ids.size(), triplets));
+    
+    // the matrix marks links, so duplicates must not add up
+    for (csr_matrix_t::size_type k = 0; k < L->nnz(); k++) {
+        L->value(k) = 1;
+    }
+    
     matrix_tools::normalize_columns(*L);
     
     return L;
 }
 
-Graph ncd_aware_rank::create_graph(const matrix_t& m)
+csr_graph_t ncd_aware_rank::create_graph(const csr_matrix_t& m)
 {
-    Graph g(m.size2());
-    
-    Graph::vertex_iterator v,ve;
-    
-    tie(v, ve) = vertices(g);
-
-    unsigned int id = 0;
+    std::vector<edge_t> edges;
+    edges.reserve(m.nnz());
     
-    for (matrix_t::const_iterator1 i = m.begin1(); i != m.end1(); i++)
+    for (csr_matrix_t::size_type i = 0; i < m.size1(); i++)
     {
-        for (matrix_t::const_iterator2 j = i.begin(); j != i.end(); j++)
+        for (csr_matrix_t::size_type k = m.row_begin(i); k < m.row_end(i); k++)
         {
-            Graph::edge_descriptor edge;
-            bool added = false;
-            if (*j > 0) {
-                tie(edge, added) = add_edge(v[j.index1()], v[j.index2()], g);
-                if (added) {
-                    put(edge_index, g, edge, id++);
-                }
+            if (m.value(k) > 0) {
+                edges.push_back(edge_t(i, m.column(k)));
             }
         }
     }
     
-    return g;
+    return csr_graph_t(m.size2(), edges);
 }
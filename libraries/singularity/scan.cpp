@@ -1,14 +1,17 @@
 #include <graphene/singularity/scan.hpp>
+#include <algorithm>
 #include <queue>
+#include <thread>
 #include <boost/graph/graphviz.hpp>
 
 using namespace boost;
 using namespace boost::numeric::ublas;
 using namespace singularity;
 
-scan::scan(double parameter_e, uint parameter_m) {
+scan::scan(double parameter_e, uint parameter_m, unsigned int num_threads) {
     this->parameter_e = parameter_e;
     this->parameter_m = parameter_m;
+    this->num_threads = num_threads;
 }
 
 void scan::process(Graph& g) {
@@ -207,6 +210,221 @@ void scan::find_clusters(Graph& g)
     set_property(g, graph_num_clusters, new_cluster_id + 1);
 }
 
+scan_result_t scan::process(const csr_graph_t& g)
+{
+    std::vector<uint8_t> similarity_is_high(g.num_entries(), false);
+    std::vector<uint8_t> is_core(g.num_vertices(), false);
+    std::vector<range_t> ranges = matrix_tools::split_range(range_t(0, g.num_vertices()), num_threads);
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < ranges.size(); i++) {
+        threads.push_back(std::thread([&, i]() {
+            calculate_similarity_partial(g, ranges[i], similarity_is_high);
+        }));
+    }
+    for (unsigned int i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+
+    threads.clear();
+    for (unsigned int i = 0; i < ranges.size(); i++) {
+        threads.push_back(std::thread([&, i]() {
+            calculate_cores_partial(g, ranges[i], similarity_is_high, is_core);
+        }));
+    }
+    for (unsigned int i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+
+    scan_result_t result;
+    find_clusters(g, similarity_is_high, is_core, result);
+
+    return result;
+}
+
+void scan::calculate_similarity_partial(const csr_graph_t& g, range_t r, std::vector<uint8_t>& similarity_is_high)
+{
+    double parameter_e_sq = parameter_e * parameter_e;
+
+    for (range_t::size_type v1 = r.start(); v1 < r.start() + r.size(); v1++) {
+        for (csr_graph_t::size_type k = g.neighbours_begin(v1); k < g.neighbours_end(v1); k++) {
+            unsigned int v2 = g.neighbour(k);
+            // every edge is calculated once, by its lower end
+            if (v2 < v1) {
+                continue;
+            }
+
+            csr_graph_t::size_type v_1_N = g.degree(v1) + 1;
+            csr_graph_t::size_type v_2_N = g.degree(v2) + 1;
+            csr_graph_t::size_type v_12_N = 2;
+
+            csr_graph_t::size_type i1 = g.neighbours_begin(v1), end1 = g.neighbours_end(v1);
+            csr_graph_t::size_type i2 = g.neighbours_begin(v2), end2 = g.neighbours_end(v2);
+            while (i1 < end1 && i2 < end2) {
+                unsigned int x1 = g.neighbour(i1), x2 = g.neighbour(i2);
+                if (x1 < x2) {
+                    i1++;
+                } else if (x2 < x1) {
+                    i2++;
+                } else {
+                    v_12_N++;
+                    i1++;
+                    i2++;
+                }
+            }
+
+            double similarity = (double) (v_12_N * v_12_N) / (v_1_N * v_2_N);
+            bool is_high = similarity >= parameter_e_sq;
+
+            // the two entries of an edge are never written by another thread
+            similarity_is_high[k] = is_high;
+            similarity_is_high[g.find(v2, v1)] = is_high;
+        }
+    }
+}
+
+void scan::calculate_cores_partial(
+    const csr_graph_t& g,
+    range_t r,
+    const std::vector<uint8_t>& similarity_is_high,
+    std::vector<uint8_t>& is_core
+) {
+    for (range_t::size_type v = r.start(); v < r.start() + r.size(); v++) {
+        unsigned int neighbours_count = 0;
+        for (csr_graph_t::size_type k = g.neighbours_begin(v); k < g.neighbours_end(v); k++) {
+            if (similarity_is_high[k]) {
+                neighbours_count++;
+            }
+        }
+        is_core[v] = neighbours_count >= parameter_m;
+    }
+}
+
+void scan::find_clusters(
+    const csr_graph_t& g,
+    const std::vector<uint8_t>& similarity_is_high,
+    const std::vector<uint8_t>& is_core,
+    scan_result_t& result
+) {
+    unsigned int new_cluster_id = 0;
+
+    std::queue<unsigned int> q;
+
+    result.cluster_ids.assign(g.num_vertices(), 0);
+    result.statuses.assign(g.num_vertices(), node_status_unclassified);
+
+    id_generator gen;
+
+    for (unsigned int v = 0; v < g.num_vertices(); v++) {
+        if (result.statuses[v] != node_status_unclassified) {
+            continue;
+        }
+
+        if (is_core[v]) {
+            new_cluster_id = gen.get_next_id();
+            result.cluster_ids[v] = new_cluster_id;
+            result.statuses[v] = node_status_member;
+            q.push(v);
+
+            while (q.size() > 0) {
+                unsigned int y = q.front();
+
+                if (is_core[y]) {
+                    for (csr_graph_t::size_type k = g.neighbours_begin(y); k < g.neighbours_end(y); k++) {
+                        if (similarity_is_high[k]) {
+                            unsigned int x = g.neighbour(k);
+                            node_status_t status = result.statuses[x];
+                            if (status == node_status_unclassified || status == node_status_non_member) {
+                                result.cluster_ids[x] = new_cluster_id;
+                                result.statuses[x] = node_status_member;
+                            }
+                            if (status == node_status_unclassified) {
+                                q.push(x);
+                            }
+                        }
+                    }
+                }
+
+                q.pop();
+            }
+        } else {
+            result.statuses[v] = node_status_non_member;
+        }
+    }
+
+    for (unsigned int v = 0; v < g.num_vertices(); v++) {
+        if (result.statuses[v] == node_status_non_member) {
+            new_cluster_id = gen.get_next_id();
+            result.cluster_ids[v] = new_cluster_id;
+            bool cluster_is_found = false;
+            unsigned int found_cluster_id;
+            bool node_is_hub = false;
+            for (csr_graph_t::size_type k = g.neighbours_begin(v); k < g.neighbours_end(v); k++) {
+                unsigned int x = g.neighbour(k);
+                if (result.statuses[x] == node_status_member) {
+                    if (!cluster_is_found) {
+                        cluster_is_found = true;
+                        found_cluster_id = result.cluster_ids[x];
+                    } else if (found_cluster_id != result.cluster_ids[x]) {
+                        node_is_hub = true;
+                        break;
+                    }
+                }
+            }
+
+            result.statuses[v] = node_is_hub ? node_status_hub : node_status_outlier;
+        }
+    }
+
+    result.num_clusters = new_cluster_id + 1;
+}
+
+csr_graph_t::csr_graph_t(size_type num_vertices, const std::vector<edge_t>& edges):
+offsets(num_vertices + 1, 0)
+{
+    for (auto& e: edges) {
+        if (e.first >= num_vertices || e.second >= num_vertices) {
+            throw runtime_exception("Edge is out of the graph");
+        }
+        if (e.first != e.second) {
+            offsets[e.first + 1]++;
+            offsets[e.second + 1]++;
+        }
+    }
+    for (size_type v = 0; v < num_vertices; v++) {
+        offsets[v + 1] += offsets[v];
+    }
+
+    neighbours.resize(offsets[num_vertices]);
+    std::vector<size_type> next(offsets.begin(), offsets.end() - 1);
+    for (auto& e: edges) {
+        if (e.first != e.second) {
+            neighbours[next[e.first]++] = e.second;
+            neighbours[next[e.second]++] = e.first;
+        }
+    }
+
+    // sort the lists and drop parallel edges, compacting in place
+    size_type position = 0;
+    for (size_type v = 0; v < num_vertices; v++) {
+        auto begin = neighbours.begin() + offsets[v];
+        auto end = neighbours.begin() + offsets[v + 1];
+        std::sort(begin, end);
+        auto unique_end = std::unique(begin, end);
+        offsets[v] = position;
+        position = std::copy(begin, unique_end, neighbours.begin() + position) - neighbours.begin();
+    }
+    offsets[num_vertices] = position;
+    neighbours.resize(position);
+}
+
+csr_graph_t::size_type csr_graph_t::find(size_type vertex, unsigned int neighbour) const
+{
+    auto begin = neighbours.begin() + offsets[vertex];
+    auto end = neighbours.begin() + offsets[vertex + 1];
+    return std::lower_bound(begin, end, neighbour) - neighbours.begin();
+}
+
 id_generator::id_generator() {
     init();
 }
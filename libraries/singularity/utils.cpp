@@ -1,32 +1,114 @@
 #include <thread>
+#include <algorithm>
 #include <graphene/singularity/utils.hpp>
 
 using namespace boost::numeric::ublas;
 using namespace boost;
 using namespace singularity;
 
-void matrix_tools::normalize_columns(matrix_t &m)
+csr_matrix_t::csr_matrix_t() :
+rows(0),
+columns(0),
+row_offsets(1, 0)
+{ }
+
+csr_matrix_t::csr_matrix_t(size_type size1, size_type size2) :
+rows(size1),
+columns(size2),
+row_offsets(size1 + 1, 0)
+{ }
+
+csr_matrix_t::csr_matrix_t(size_type size1, size_type size2, const triplet_vector_t& triplets) :
+rows(size1),
+columns(size2),
+row_offsets(size1 + 1, 0)
 {
-    mapped_vector<double> a (m.size2());
+    // counting sort by row keeps the original order of triplets inside a row
+    for (auto& t: triplets) {
+        if (t.row >= rows || t.column >= columns) {
+            throw runtime_exception("Triplet is out of the matrix bounds");
+        }
+        row_offsets[t.row + 1]++;
+    }
+    for (size_type i = 0; i < rows; i++) {
+        row_offsets[i + 1] += row_offsets[i];
+    }
     
-    for (matrix_t::iterator1 i = m.begin1(); i != m.end1(); i++)
-    {
-        for (matrix_t::iterator2 j = i.begin(); j != i.end(); j++)
-        {
-            if (*j != 0) {
-                a[j.index2()] += *j;
+    std::vector<size_type> position(row_offsets.begin(), row_offsets.end() - 1);
+    std::vector<index_t> unsorted_columns(triplets.size());
+    std::vector<double> unsorted_values(triplets.size());
+    for (auto& t: triplets) {
+        size_type k = position[t.row]++;
+        unsorted_columns[k] = t.column;
+        unsorted_values[k] = t.value;
+    }
+    
+    column_indices.reserve(triplets.size());
+    values.reserve(triplets.size());
+    std::vector<size_type> order;
+    size_type row_start = 0;
+    for (size_type i = 0; i < rows; i++) {
+        size_type begin = row_offsets[i], end = row_offsets[i + 1];
+        order.resize(end - begin);
+        for (size_type k = begin; k < end; k++) {
+            order[k - begin] = k;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_type a, size_type b) {
+            return unsorted_columns[a] < unsorted_columns[b];
+        });
+        for (size_type k: order) {
+            if (column_indices.size() > row_start && column_indices.back() == unsorted_columns[k]) {
+                values.back() += unsorted_values[k];
+            } else {
+                column_indices.push_back(unsorted_columns[k]);
+                values.push_back(unsorted_values[k]);
             }
         }
+        row_offsets[i] = row_start;
+        row_start = column_indices.size();
     }
-    for (matrix_t::iterator1 i = m.begin1(); i != m.end1(); i++)
-    {
-        for (matrix_t::iterator2 j = i.begin(); j != i.end(); j++)
-        {
-            double norm = a[j.index2()];
-            if (norm != 0) {
-                *j /= norm;
+    row_offsets[rows] = row_start;
+}
+
+void csr_matrix_t::prune_non_positive()
+{
+    size_type k = 0;
+    size_type begin = 0;
+    for (size_type i = 0; i < rows; i++) {
+        size_type end = row_offsets[i + 1];
+        for (size_type j = begin; j < end; j++) {
+            if (values[j] > 0) {
+                column_indices[k] = column_indices[j];
+                values[k] = values[j];
+                k++;
             }
         }
+        begin = end;
+        row_offsets[i + 1] = k;
+    }
+    column_indices.resize(k);
+    values.resize(k);
+}
+
+void csr_matrix_t::scale(double factor)
+{
+    for (double& x: values) {
+        x *= factor;
+    }
+}
+
+void matrix_tools::normalize_columns(csr_matrix_t &m)
+{
+    std::vector<double> a(m.size2(), 0);
+    
+    for (csr_matrix_t::size_type k = 0; k < m.nnz(); k++) {
+        a[m.column(k)] += m.value(k);
+    }
+    for (csr_matrix_t::size_type k = 0; k < m.nnz(); k++) {
+        double norm = a[m.column(k)];
+        if (norm != 0) {
+            m.value(k) /= norm;
+        }
     }
 }
 
@@ -48,20 +130,15 @@ void matrix_tools::normalize_rows(matrix_t &m)
     }
 }
 
-sparce_vector_t matrix_tools::calculate_correction_vector(const matrix_t& o) {
+sparce_vector_t matrix_tools::calculate_correction_vector(const csr_matrix_t& o) {
     
-    sparce_vector_t v(o.size2()), a(o.size2());
+    sparce_vector_t v(o.size2());
+    std::vector<double> a(o.size2(), 0);
     
     double correction_value = 1.0/o.size2();
     
-    for (matrix_t::const_iterator1 j = o.begin1(); j != o.end1(); j++)
-    {
-        for (matrix_t::const_iterator2 i = j.begin(); i != j.end(); i++)
-        {
-            if (*i != 0) {
-                a[i.index2()] += *i;
-            }
-        }
+    for (csr_matrix_t::size_type k = 0; k < o.nnz(); k++) {
+        a[o.column(k)] += o.value(k);
     }
     
     for (unsigned int i=0; i< a.size();i++) {
@@ -95,33 +172,21 @@ std::shared_ptr<matrix_t> matrix_tools::resize(matrix_t& m, matrix_t::size_type
     return m2;
 }
 
-void matrix_tools::prod( vector_t& out, const matrix_t& m, const vector_t& v, unsigned int num_threads) {
-    std::vector<std::thread> threads;
-    
-    std::vector<range_t> ranges = split_range(range_t(0, m.size1()), num_threads);
-    
-    
-    for (unsigned int i=0; i<ranges.size(); i++) {
-        threads.push_back(std::thread(partial_prod, std::ref(out), std::ref(m), std::ref(v), ranges[i]));
-    }
-
-    for (unsigned int i=0; i<threads.size(); i++) {
-        threads[i].join();
-    }
+void matrix_tools::prod( vector_t& out, const csr_matrix_t& m, const vector_t& v, thread_pool& pool, const std::vector<range_t>& ranges) {
+    pool.run(ranges.size(), [&](unsigned int i) {
+        partial_prod(out, m, v, ranges[i]);
+    });
 }
 
-
-void matrix_tools::partial_prod( vector_t& out, const matrix_t& m, const vector_t& v, range_t range)
+void matrix_tools::partial_prod( vector_t& out, const csr_matrix_t& m, const vector_t& v, range_t range)
 {
-    for (matrix_t::const_iterator1 i = m.begin1(); i != m.end1(); i++) {
-        if (i.index1() >= range.start() && i.index1() < range.start() + range.size()) {
-            double x = 0;
-            for (matrix_t::const_iterator2 j = i.begin(); j != i.end(); j++) {
-                x += (*j) * v(j.index2());
-            }
-            
-            out[i.index1()] = x;
+    for (range_t::size_type i = range.start(); i < range.start() + range.size(); i++) {
+        double x = 0;
+        for (csr_matrix_t::size_type k = m.row_begin(i); k < m.row_end(i); k++) {
+            x += m.value(k) * v(m.column(k));
         }
+        
+        out[i] = x;
     }
 }
 
@@ -151,3 +216,104 @@ std::vector<range_t> matrix_tools::split_range(range_t range, unsigned int max)
     return result;
 }
 
+
+std::vector<range_t> matrix_tools::split_rows(const csr_matrix_t& m, unsigned int max)
+{
+    std::vector<range_t> result;
+    if (max == 0) {
+        max = 1;
+    }
+
+    // a row costs its nonzeros and one write of the result
+    csr_matrix_t::size_type total_cost = m.nnz() + m.size1();
+    csr_matrix_t::size_type start = 0;
+    for (unsigned int part = 1; part <= max && start < m.size1(); part++) {
+        csr_matrix_t::size_type target_cost = total_cost * part / max;
+        csr_matrix_t::size_type end = start + 1;
+        while (end < m.size1() && m.row_begin(end) + end < target_cost) {
+            end++;
+        }
+        if (part == max) {
+            end = m.size1();
+        }
+        result.push_back(range_t(start, end));
+        start = end;
+    }
+
+    return result;
+}
+
+thread_pool::thread_pool(unsigned int num_threads):
+next_task(0)
+{
+    for (unsigned int i = 1; i < num_threads; i++) {
+        workers.push_back(std::thread(&thread_pool::work, this));
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    task_ready.notify_all();
+    for (auto& worker: workers) {
+        worker.join();
+    }
+}
+
+void thread_pool::run(unsigned int num_tasks, const std::function<void(unsigned int)>& task)
+{
+    if (workers.empty() || num_tasks <= 1) {
+        for (unsigned int i = 0; i < num_tasks; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        current_task = &task;
+        task_count = num_tasks;
+        next_task = 0;
+        busy_workers = workers.size();
+        generation++;
+    }
+    task_ready.notify_all();
+
+    run_tasks();
+
+    std::unique_lock<std::mutex> guard(lock);
+    task_done.wait(guard, [this]() { return busy_workers == 0; });
+    current_task = nullptr;
+}
+
+void thread_pool::work()
+{
+    uint64_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            task_ready.wait(guard, [&]() { return stopping || generation != seen_generation; });
+            if (stopping) {
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        run_tasks();
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--busy_workers == 0) {
+            task_done.notify_all();
+        }
+    }
+}
+
+void thread_pool::run_tasks()
+{
+    for (unsigned int i = next_task++; i < task_count; i = next_task++) {
+        (*current_task)(i);
+    }
+}
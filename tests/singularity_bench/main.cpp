@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * Times the stages of the activity and emission calculations on a synthetic
+ * transfer graph and prints the result as a single JSON object, so runs can
+ * be compared by scripts.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#include <graphene/singularity/activity_window.hpp>
+#include <graphene/singularity/emission.hpp>
+
+#include <boost/program_options.hpp>
+
+using namespace singularity;
+namespace bpo = boost::program_options;
+
+namespace {
+
+typedef std::chrono::steady_clock bench_clock;
+
+double seconds_since( bench_clock::time_point start )
+{
+   return std::chrono::duration<double>( bench_clock::now() - start ).count();
+}
+
+/**
+ * Accounts are drawn as floor(n * u^exponent), so low instances are much
+ * more active than high ones and the degrees follow a power law.
+ */
+std::vector<std::vector<id_transaction_t>> generate_blocks( uint32_t num_accounts, uint32_t num_blocks,
+                                                            uint32_t transfers_per_block, double exponent,
+                                                            uint64_t seed )
+{
+   std::mt19937_64 rng( seed );
+   std::uniform_real_distribution<double> unit( 0, 1 );
+   std::uniform_real_distribution<double> amount( 100, 10000 );
+
+   auto draw_account = [&]() {
+      return std::min<uint32_t>( num_accounts - 1, uint32_t( num_accounts * std::pow( unit(rng), exponent ) ) );
+   };
+
+   std::vector<std::vector<id_transaction_t>> blocks( num_blocks );
+   for( auto& block : blocks )
+   {
+      block.reserve( transfers_per_block );
+      for( uint32_t i = 0; i < transfers_per_block; ++i )
+      {
+         uint32_t source = draw_account();
+         uint32_t target = draw_account();
+         if( source == target )
+            continue;
+         block.push_back( { amount(rng), 0, source, target, 1e9, 1e9, 0 } );
+      }
+   }
+   return blocks;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+   try
+   {
+      bpo::options_description cli_options("Singularity benchmark");
+      cli_options.add_options()
+            ("help,h", "Print this help message and exit.")
+            ("accounts,a", bpo::value<uint32_t>()->default_value(10000), "Number of accounts in the graph")
+            ("blocks,b", bpo::value<uint32_t>()->default_value(20000), "Number of blocks in the activity window")
+            ("transfers,t", bpo::value<uint32_t>()->default_value(20), "Transfers per block")
+            ("exponent,e", bpo::value<double>()->default_value(3.0), "Skew of the account distribution, 1 is uniform")
+            ("decay-period,d", bpo::value<uint32_t>()->default_value(2000), "Blocks per activity decay")
+            ("threads,j", bpo::value<uint32_t>()->default_value(1), "Threads used by the rank calculation")
+            ("seed,s", bpo::value<uint64_t>()->default_value(1), "Seed of the graph generator")
+            ("skip-emission", "Do not time the emission activity period")
+            ("warm-start", "Seed the rank with the result of the window one decay period earlier")
+            ;
+
+      bpo::variables_map options;
+      bpo::store( bpo::parse_command_line( argc, argv, cli_options ), options );
+      bpo::notify( options );
+
+      if( options.count("help") )
+      {
+         std::cout << cli_options << "\n";
+         return 0;
+      }
+
+      uint32_t num_accounts = options["accounts"].as<uint32_t>();
+      uint32_t num_blocks = options["blocks"].as<uint32_t>();
+      uint32_t transfers_per_block = options["transfers"].as<uint32_t>();
+      double exponent = options["exponent"].as<double>();
+      uint64_t seed = options["seed"].as<uint64_t>();
+      if( num_accounts < 2 || num_blocks == 0 )
+      {
+         std::cerr << "singularity_bench: at least 2 accounts and 1 block are needed\n";
+         return 1;
+      }
+
+      parameters_t parameters;
+      parameters.decay_period = options["decay-period"].as<uint32_t>();
+      parameters.num_threads = options["threads"].as<uint32_t>();
+
+      auto start = bench_clock::now();
+      auto blocks = generate_blocks( num_accounts, num_blocks, transfers_per_block, exponent, seed );
+      double generate_seconds = seconds_since( start );
+
+      // the warm start is seeded by the window which ends one decay period earlier
+      bool warm_start = options.count("warm-start") && num_blocks > parameters.decay_period;
+      uint32_t seed_blocks = warm_start ? num_blocks - parameters.decay_period : 0;
+
+      activity_window_calculator window( parameters );
+      window.move_window( 1 );
+      double add_block_seconds = 0;
+      start = bench_clock::now();
+      for( uint32_t i = 0; i < seed_blocks; ++i )
+         window.add_block( i + 1, blocks[i] );
+      add_block_seconds += seconds_since( start );
+      if( warm_start )
+         window.set_initial_index( window.calculate( seed_blocks ) );
+      start = bench_clock::now();
+      for( uint32_t i = seed_blocks; i < num_blocks; ++i )
+         window.add_block( i + 1, blocks[i] );
+      add_block_seconds += seconds_since( start );
+
+      start = bench_clock::now();
+      account_activity_index_vector_t result = window.calculate( num_blocks );
+      double calculate_seconds = seconds_since( start );
+      calculation_statistics_t statistics = window.get_last_statistics();
+
+      uint32_t ranked_accounts = 0;
+      for( double index : result )
+         ranked_accounts += index > 0;
+
+      double period_add_block_seconds = 0;
+      double get_activity_seconds = 0;
+      double activity = 0;
+      if( !options.count("skip-emission") )
+      {
+         activity_period period;
+         start = bench_clock::now();
+         for( const auto& block : blocks )
+            period.add_block( block );
+         period_add_block_seconds = seconds_since( start );
+
+         start = bench_clock::now();
+         activity = period.get_activity();
+         get_activity_seconds = seconds_since( start );
+      }
+
+      std::cout << "{\"accounts\":" << num_accounts
+                << ",\"blocks\":" << num_blocks
+                << ",\"transfers_per_block\":" << transfers_per_block
+                << ",\"exponent\":" << exponent
+                << ",\"decay_period\":" << parameters.decay_period
+                << ",\"threads\":" << parameters.num_threads
+                << ",\"warm_start\":" << ( warm_start ? "true" : "false" )
+                << ",\"seed\":" << seed
+                << ",\"ranked_accounts\":" << ranked_accounts
+                << ",\"rank_iterations\":" << statistics.rank_iterations
+                << ",\"positive_links\":" << activity
+                << ",\"seconds\":{"
+                << "\"generate\":" << generate_seconds
+                << ",\"add_block\":" << add_block_seconds
+                << ",\"calculate\":" << calculate_seconds
+                << ",\"outlink_matrix\":" << statistics.outlink_matrix_seconds
+                << ",\"scan\":" << statistics.clustering_seconds
+                << ",\"rank\":" << statistics.rank_seconds
+                << ",\"period_add_block\":" << period_add_block_seconds
+                << ",\"get_activity\":" << get_activity_seconds
+                << "}}" << std::endl;
+   }
+   catch( const std::exception& e )
+   {
+      std::cerr << "singularity_bench: " << e.what() << "\n";
+      return 1;
+   }
+
+   return 0;
+}
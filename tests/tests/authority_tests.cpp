@@ -26,6 +26,7 @@
 
 #include <graphene/chain/database.hpp>
 #include <graphene/chain/protocol/protocol.hpp>
+#include <graphene/chain/protocol/signature_cache.hpp>
 #include <graphene/chain/exceptions.hpp>
 
 #include <graphene/chain/account_object.hpp>
@@ -1313,4 +1314,45 @@ BOOST_FIXTURE_TEST_CASE( nonminimal_sig_test, database_fixture )
    }
 }
 
+BOOST_AUTO_TEST_CASE( signature_cache_test )
+{ try {
+   fc::ecc::private_key key = fc::ecc::private_key::generate();
+   std::vector<digest_type> digests;
+   std::vector<signature_type> sigs;
+   for( int i = 0; i < 3; ++i )
+   {
+      digests.push_back( fc::sha256::hash( "digest" + fc::to_string( i ) ) );
+      sigs.push_back( key.sign_compact( digests.back() ) );
+   }
+
+   BOOST_TEST_MESSAGE( "The oldest keys are dropped beyond the capacity" );
+   signature_cache cache( 2 );
+   for( int i = 0; i < 3; ++i )
+      BOOST_CHECK( cache.recover( sigs[i], digests[i] ) == public_key_type( key.get_public_key() ) );
+   BOOST_CHECK( cache.recover( sigs[2], digests[2] ) == public_key_type( key.get_public_key() ) );
+   cache.recover( sigs[0], digests[0] );
+   auto stats = cache.statistics();
+   BOOST_CHECK_EQUAL( stats.hits, 1u );
+   BOOST_CHECK_EQUAL( stats.misses, 4u );
+   BOOST_CHECK_EQUAL( stats.entries, 2u );
+
+   BOOST_TEST_MESSAGE( "A pushed transaction is not recovered again when its block is applied" );
+   ACTOR( nathan );
+   fund( nathan );
+   transfer_operation top;
+   top.from = nathan_id;
+   top.to = account_id_type();
+   top.amount = asset( 1000 );
+   trx.operations.push_back( top );
+   set_expiration( db, trx );
+   sign( trx, nathan_private_key );
+   PUSH_TX( db, trx );
+
+   auto before = signature_cache::instance().statistics();
+   generate_block( database::skip_nothing );
+   auto after = signature_cache::instance().statistics();
+   BOOST_CHECK_GT( after.hits, before.hits );
+   BOOST_CHECK_EQUAL( after.misses, before.misses );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -25,6 +25,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <graphene/chain/database.hpp>
+#include <graphene/chain/block_prefetcher.hpp>
 #include <graphene/chain/exceptions.hpp>
 
 #include <graphene/chain/account_object.hpp>
@@ -119,6 +120,409 @@ BOOST_AUTO_TEST_CASE( block_database_test )
          FC_ASSERT( blk->witness == witness_id_type(blk->block_num()) );
       }
 
+      // the entry of a block lost in a crash is dropped from the index on open
+      bdb.close();
+      const fc::path index_file = data_dir.path() / "index";
+      const uint64_t index_size = fc::file_size( index_file );
+      {
+         index_entry lost;
+         lost.block_pos = fc::file_size( data_dir.path() / "blocks" );
+         lost.block_size = 100;
+         lost.block_id = b.id();
+         std::ofstream out( index_file.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::app );
+         out.write( (const char*)&lost, sizeof(lost) );
+      }
+      bdb.open( data_dir.path() );
+      FC_ASSERT( fc::file_size( index_file ) == index_size );
+      FC_ASSERT( bdb.last_id().valid() && *bdb.last_id() == b.id() );
+
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_replay_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      signed_block b;
+      std::vector<block_id_type> ids;
+      for( uint32_t i = 0; i < 20; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+         ids.push_back( b.id() );
+      }
+      bdb.remove( ids[14] );
+      BOOST_CHECK( !bdb.fetch_by_number( 15 ).valid() );
+
+      for( int pass = 0; pass < 2; ++pass )
+      {
+         auto reader = bdb.read_from( 3 );
+         for( uint32_t num = 3; num < 15; ++num )
+         {
+            auto blk = reader.next();
+            BOOST_REQUIRE( blk.valid() );
+            BOOST_CHECK( blk->id() == ids[num-1] );
+         }
+         // the removed block is a gap
+         BOOST_CHECK( !reader.next().valid() );
+         BOOST_CHECK_EQUAL( reader.next_block_num(), 15u );
+
+         bdb.close();
+         bdb.open( data_dir.path() );
+      }
+
+      auto reader = bdb.read_from( 20 );
+      BOOST_CHECK( reader.next().valid() );
+      BOOST_CHECK( !reader.next().valid() );
+      BOOST_CHECK( bdb.last_id().valid() && *bdb.last_id() == ids.back() );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_database_compact_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      signed_block b;
+      std::vector<block_id_type> ids;
+      index_entry first_entry;
+      for( uint32_t i = 0; i < 600; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         index_entry e = bdb.store( b.id(), b );
+         if( i == 0 ) first_entry = e;
+         ids.push_back( b.id() );
+      }
+      // a fork block replaced by the block of the main chain
+      signed_block fork = b;
+      fork.witness = witness_id_type(1000);
+      const index_entry fork_entry = bdb.store( fork.id(), fork );
+      bdb.remove( fork.id() );
+      const index_entry last_entry = bdb.store( b.id(), b );
+      BOOST_CHECK( bdb.fetch_stored( fork_entry ).valid() );
+
+      const fc::path blocks_file = data_dir.path() / "blocks";
+      const uint64_t size_before = fc::file_size( blocks_file );
+
+      // one batch at a time, the blocks file is only rewritten once everything is archived
+      bdb.compact( 550, 1 );
+      BOOST_CHECK( fc::exists( data_dir.path() / "archive" / "blocks-000000" ) );
+      BOOST_CHECK_EQUAL( fc::file_size( blocks_file ), size_before );
+      BOOST_CHECK( bdb.fetch_stored( fork_entry ).valid() );
+      BOOST_CHECK( bdb.fetch_by_number( 1 )->id() == ids.front() );
+
+      // two complete batches of 256 blocks are archived, the rest stays in the blocks file
+      bdb.compact( 550 );
+      BOOST_CHECK_LT( fc::file_size( blocks_file ), size_before );
+
+      // entries from before the compaction are read from where the blocks moved, the replaced block is gone
+      auto moved = bdb.fetch_stored( last_entry );
+      BOOST_REQUIRE( moved.valid() );
+      BOOST_CHECK( moved->id() == ids.back() );
+      moved = bdb.fetch_stored( first_entry );
+      BOOST_REQUIRE( moved.valid() );
+      BOOST_CHECK( moved->id() == ids.front() );
+      BOOST_CHECK( !bdb.fetch_stored( fork_entry ).valid() );
+
+      auto check_blocks = [&]() {
+         for( uint32_t num = 1; num <= ids.size(); ++num )
+         {
+            auto blk = bdb.fetch_by_number( num );
+            BOOST_REQUIRE( blk.valid() );
+            BOOST_CHECK( blk->id() == ids[num-1] );
+            BOOST_CHECK( bdb.contains( ids[num-1] ) );
+         }
+         BOOST_CHECK( !bdb.contains( fork.id() ) );
+         BOOST_CHECK( bdb.last_id().valid() && *bdb.last_id() == ids.back() );
+      };
+      check_blocks();
+
+      auto reader = bdb.read_from( 250 );
+      for( uint32_t num = 250; num <= ids.size(); ++num )
+      {
+         auto blk = reader.next();
+         BOOST_REQUIRE( blk.valid() );
+         BOOST_CHECK( blk->id() == ids[num-1] );
+      }
+      BOOST_CHECK( !reader.next().valid() );
+
+      bdb.close();
+      bdb.open( data_dir.path() );
+      check_blocks();
+
+      // nothing more to archive
+      const uint64_t compacted_size = fc::file_size( blocks_file );
+      bdb.compact( 600 );
+      BOOST_CHECK_EQUAL( fc::file_size( blocks_file ), compacted_size );
+
+      // an archived block stored again is read from the blocks file and archived once more
+      auto stored_again = bdb.fetch_by_number( 10 );
+      BOOST_REQUIRE( stored_again.valid() );
+      bdb.store( stored_again->id(), *stored_again );
+      for( uint32_t i = 0; i < 200; ++i )
+      {
+         b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+         ids.push_back( b.id() );
+      }
+      const fc::path index_file = data_dir.path() / "index";
+      const fc::path old_index_file = data_dir.path() / "index.old";
+      bdb.flush();
+      fc::copy( index_file, old_index_file );
+      bdb.compact( 800 );
+      check_blocks();
+      bdb.close();
+
+      // a compaction cut off before its commit marker leaves the old files
+      auto write_file = []( const fc::path& p, const std::string& content ) {
+         std::ofstream out( p.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+         out.write( content.data(), content.size() );
+      };
+      write_file( data_dir.path() / "blocks.new", "partial" );
+      bdb.open( data_dir.path() );
+      check_blocks();
+      BOOST_CHECK( !fc::exists( data_dir.path() / "blocks.new" ) );
+      bdb.close();
+
+      // with the marker, the new blocks file replaces the old one
+      fc::rename( blocks_file, data_dir.path() / "blocks.new" );
+      write_file( blocks_file, "old blocks" );
+      write_file( data_dir.path() / "compact.commit", "" );
+      bdb.open( data_dir.path() );
+      check_blocks();
+      BOOST_CHECK( !fc::exists( data_dir.path() / "compact.commit" ) );
+      bdb.close();
+
+      // an index of the blocks file before the compaction is refused
+      fc::rename( index_file, data_dir.path() / "index.good" );
+      fc::rename( old_index_file, index_file );
+      BOOST_CHECK_THROW( bdb.open( data_dir.path() ), fc::exception );
+      bdb.close();
+      fc::remove( index_file );
+      fc::rename( data_dir.path() / "index.good", index_file );
+      bdb.open( data_dir.path() );
+      check_blocks();
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( fork_database_window_test )
+{
+   try {
+      fork_database fdb;
+      signed_block b;
+      std::vector<block_id_type> ids;
+      for( uint32_t i = 0; i < 100; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         fdb.push_block( b );
+         ids.push_back( b.id() );
+      }
+      BOOST_CHECK_EQUAL( fdb.head()->num, 100u );
+
+      // a fork from block 90
+      signed_block fork;
+      fork.previous = ids[89];
+      std::vector<block_id_type> fork_ids;
+      for( uint32_t i = 0; i < 12; ++i )
+      {
+         if( i > 0 ) fork.previous = fork.id();
+         fork.witness = witness_id_type(1000+i);
+         fdb.push_block( fork );
+         fork_ids.push_back( fork.id() );
+      }
+      BOOST_CHECK( fdb.head()->id == fork_ids.back() );
+      BOOST_CHECK_EQUAL( fdb.fetch_block_by_number( 95 ).size(), 2u );
+      BOOST_CHECK_EQUAL( fdb.fetch_block_by_number( 102 ).size(), 1u );
+      BOOST_CHECK( fdb.fetch_block_by_number( 103 ).empty() );
+
+      auto branches = fdb.fetch_branch_from( fork_ids.back(), ids.back() );
+      BOOST_CHECK_EQUAL( branches.first.size(), 12u );
+      BOOST_CHECK_EQUAL( branches.second.size(), 10u );
+      BOOST_CHECK( branches.first.back()->previous_id() == ids[89] );
+      BOOST_CHECK( branches.second.back()->previous_id() == ids[89] );
+
+      // a stored block keeps only its header and the entry it was stored at
+      index_entry e;
+      e.block_size = 1;
+      e.block_id = ids[50];
+      fdb.set_stored( ids[50], e );
+      auto item = fdb.fetch_block( ids[50] );
+      BOOST_REQUIRE( item );
+      BOOST_CHECK( !item->data );
+      BOOST_CHECK( item->stored.block_id == ids[50] );
+      BOOST_CHECK( item->header.previous == ids[49] );
+      auto stored = fdb.fetch_stored_blocks();
+      BOOST_REQUIRE_EQUAL( stored.size(), 1u );
+      BOOST_CHECK( stored[0]->id == ids[50] );
+
+      fdb.remove( ids[99] );
+      BOOST_CHECK( !fdb.is_known_block( ids[99] ) );
+      BOOST_CHECK_EQUAL( fdb.fetch_block_by_number( 100 ).size(), 1u );
+
+      // shrinking the window drops the old blocks
+      fdb.set_max_size( 20 );
+      BOOST_CHECK( !fdb.is_known_block( ids[80] ) );
+      BOOST_CHECK( fdb.fetch_block_by_number( 81 ).empty() );
+      BOOST_CHECK( fdb.is_known_block( ids[82] ) );
+      BOOST_CHECK_EQUAL( fdb.fetch_block_by_number( 83 ).size(), 1u );
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_prefetcher_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      block_database bdb;
+      bdb.open( data_dir.path() );
+      signed_block b;
+      std::vector<block_id_type> ids;
+      for( uint32_t i = 0; i < 100; ++i )
+      {
+         if( i > 0 ) b.previous = b.id();
+         b.witness = witness_id_type(i+1);
+         bdb.store( b.id(), b );
+         ids.push_back( b.id() );
+      }
+
+      {
+         // a window smaller than the range, so the workers wait for the apply loop
+         block_prefetcher prefetcher( bdb, 1, 100, 4, 8 );
+         for( uint32_t num = 1; num <= 100; ++num )
+         {
+            auto prefetched = prefetcher.take( num );
+            BOOST_REQUIRE( prefetched.block.valid() );
+            BOOST_CHECK( prefetched.block->id() == ids[num-1] );
+            BOOST_CHECK( prefetched.merkle_checked );
+         }
+         BOOST_CHECK_THROW( prefetcher.take( 101 ), fc::exception );
+      }
+      {
+         // blocks past the end are gaps, stopping early leaves the rest unread
+         block_prefetcher prefetcher( bdb, 95, 110, 2, 4 );
+         for( uint32_t num = 95; num <= 100; ++num )
+            BOOST_CHECK( prefetcher.take( num ).block.valid() );
+         BOOST_CHECK( !prefetcher.take( 101 ).block.valid() );
+         prefetcher.stop();
+      }
+      {
+         block_prefetcher prefetcher( bdb, 10, 5 );
+         BOOST_CHECK_THROW( prefetcher.take( 10 ), fc::exception );
+      }
+   } catch (fc::exception& e) {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( block_history_database_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+
+      auto make_block = []( uint32_t block_num ) {
+         block_history_info info;
+         info.transaction_amount_threshold = block_num;
+         for( uint32_t i = 0; i < block_num % 3; ++i )
+         {
+            block_history_transfer t;
+            t.source_account = block_num;
+            t.target_account = i;
+            t.amount = block_num * 10 + i;
+            info.transfers.push_back( t );
+         }
+         return info;
+      };
+      auto check_range = []( const block_history_database& bhdb, uint32_t first, uint32_t last ) {
+         uint32_t expected = first;
+         bhdb.for_each_block( first, last, [&]( uint32_t block_num, const block_history_info& info ) {
+            FC_ASSERT( block_num == expected++ );
+            FC_ASSERT( info.transaction_amount_threshold == block_num );
+            FC_ASSERT( info.transfers.size() == block_num % 3 );
+            for( uint32_t i = 0; i < info.transfers.size(); ++i )
+               FC_ASSERT( info.transfers[i].amount == block_num * 10 + i );
+         });
+         FC_ASSERT( expected == last + 1 );
+      };
+
+      block_history_database bhdb;
+      bhdb.open( data_dir.path() );
+      FC_ASSERT( bhdb.is_open() );
+      FC_ASSERT( bhdb.last_block_num() == 0 );
+
+      for( uint32_t i = 1; i <= 50; ++i )
+         bhdb.store( i, make_block(i) );
+      check_range( bhdb, 1, 50 );
+
+      // a block from another fork drops everything after it
+      bhdb.store( 40, make_block(40) );
+      FC_ASSERT( bhdb.last_block_num() == 40 );
+      FC_ASSERT( !bhdb.fetch( 41 ).valid() );
+      for( uint32_t i = 41; i <= 50; ++i )
+         bhdb.store( i, make_block(i) );
+
+      bhdb.prune( 10 );
+      FC_ASSERT( bhdb.first_block_num() == 10 );
+      FC_ASSERT( !bhdb.fetch( 9 ).valid() );
+      check_range( bhdb, 10, 50 );
+
+      // most of the files are dead now, they are compacted
+      bhdb.prune( 30 );
+      check_range( bhdb, 30, 50 );
+
+      bhdb.close();
+      FC_ASSERT( !bhdb.is_open() );
+      bhdb.open( data_dir.path() );
+      FC_ASSERT( bhdb.first_block_num() == 30 );
+      FC_ASSERT( bhdb.last_block_num() == 50 );
+      check_range( bhdb, 30, 50 );
+
+      // a fork and a compaction in the middle of a long scan
+      for( uint32_t i = 51; i <= 2000; ++i )
+         bhdb.store( i, make_block(i) );
+      uint32_t expected = 30;
+      bhdb.for_each_block( 30, 2000, [&]( uint32_t block_num, const block_history_info& info ) {
+         FC_ASSERT( block_num == expected++ );
+         FC_ASSERT( info.transaction_amount_threshold == block_num );
+         if( block_num == 100 )
+            bhdb.store( 700, make_block(700) );
+      });
+      FC_ASSERT( expected == 701 );
+      for( uint32_t i = 701; i <= 2000; ++i )
+         bhdb.store( i, make_block(i) );
+      // the blocks already read go on to the visitor, the scan then skips to the first block left
+      uint32_t previous = 29;
+      bhdb.for_each_block( 30, 2000, [&]( uint32_t block_num, const block_history_info& info ) {
+         FC_ASSERT( block_num == previous + 1 || ( previous >= 100 && previous < 1499 && block_num == 1500 ) );
+         FC_ASSERT( info.transaction_amount_threshold == block_num );
+         FC_ASSERT( info.transfers.size() == block_num % 3 );
+         previous = block_num;
+         if( block_num == 100 )
+            bhdb.prune( 1500 );
+      });
+      FC_ASSERT( previous == 2000 );
+      check_range( bhdb, 1500, 2000 );
    } catch (fc::exception& e) {
       edump((e.to_detail_string()));
       throw;
@@ -317,11 +721,11 @@ BOOST_AUTO_TEST_CASE( fork_db_tests )
         prev = b;
      }
      auto head = fdb.head();
-     FC_ASSERT( head && head->data.block_num() == 1799 );
+     FC_ASSERT( head && head->num == 1799 );
 
      fdb.push_block(skipped_block);
      head = fdb.head();
-     FC_ASSERT( head && head->data.block_num() == 2001, "", ("head",head->data.block_num()) );
+     FC_ASSERT( head && head->num == 2001, "", ("head",head->num) );
   } FC_LOG_AND_RETHROW() 
 }
 BOOST_AUTO_TEST_CASE( out_of_order_blocks )
@@ -709,6 +1113,12 @@ BOOST_FIXTURE_TEST_CASE( maintenance_interval, database_fixture )
                         maintenence_time.sec_since_epoch() + new_properties.parameters.maintenance_interval);
       maintenence_time = db.get_dynamic_global_properties().next_maintenance_time;
       BOOST_CHECK_GT(maintenence_time.sec_since_epoch(), db.head_block_time().sec_since_epoch());
+
+      const maintenance_statistics& maintenance = db.get_last_maintenance_statistics();
+      BOOST_CHECK_EQUAL( maintenance.block_num, db.head_block_num() );
+      BOOST_CHECK_EQUAL( maintenance.accounts, db.get_index_type<account_index>().indices().size() );
+      BOOST_CHECK_GE( maintenance.tally_threads, 1u );
+      BOOST_CHECK_GE( maintenance.total_time, maintenance.tally_time + maintenance.fees_time );
       db.close();
    } catch (fc::exception& e) {
       edump((e.to_detail_string()));
@@ -1262,4 +1672,105 @@ BOOST_FIXTURE_TEST_CASE( miss_many_blocks, database_fixture )
    }
 }
 
+BOOST_FIXTURE_TEST_CASE( prevalidate_block_test, database_fixture )
+{
+   try
+   {
+      ACTOR( nathan );
+      fund( nathan );
+      for( int i = 1; i <= 12; ++i )
+      {
+         signed_transaction tx;
+         transfer_operation top;
+         top.from = nathan_id;
+         top.to = account_id_type();
+         top.amount = asset( i * 100 );
+         tx.operations.push_back( top );
+         set_expiration( db, tx );
+         sign( tx, nathan_private_key );
+         PUSH_TX( db, tx );
+      }
+      signed_block b = generate_block( database::skip_nothing );
+      BOOST_REQUIRE_EQUAL( b.transactions.size(), 12u );
+
+      thread_pool pool( 4 );
+      prevalidated_block pre = prevalidate_block( b, db.get_chain_id(), true, true, &pool );
+      BOOST_CHECK( pre.merkle_checked );
+      BOOST_REQUIRE_EQUAL( pre.transactions.size(), 12u );
+      for( size_t i = 0; i < 12; ++i )
+      {
+         BOOST_CHECK( pre.transactions[i].id == b.transactions[i].id() );
+         BOOST_CHECK( !pre.transactions[i].validate_error );
+         BOOST_CHECK( !pre.transactions[i].keys_error );
+         BOOST_CHECK( pre.transactions[i].keys_recovered );
+         BOOST_CHECK( pre.transactions[i].signature_keys == b.transactions[i].get_signature_keys( db.get_chain_id() ) );
+      }
+
+      // the errors stay with their transactions
+      signed_block bad = b;
+      bad.transactions[1].operations.clear();
+      bad.transactions[3].signatures.push_back( bad.transactions[3].signatures.front() );
+      pre = prevalidate_block( bad, db.get_chain_id(), true, true, &pool );
+      BOOST_CHECK( !pre.merkle_checked );
+      BOOST_CHECK( pre.transactions[1].validate_error );
+      BOOST_CHECK( pre.transactions[3].keys_error );
+      BOOST_CHECK( !pre.transactions[0].validate_error && !pre.transactions[0].keys_error );
+      BOOST_CHECK_THROW( std::rethrow_exception( pre.transactions[3].keys_error ), tx_duplicate_sig );
+
+      // without a pool the block is checked on this thread
+      pre = prevalidate_block( b, db.get_chain_id(), false, false );
+      BOOST_CHECK( !pre.merkle_checked );
+      BOOST_CHECK( !pre.transactions[0].keys_recovered );
+      BOOST_CHECK( pre.transactions[11].id == b.transactions[11].id() );
+   }
+   catch (fc::exception& e)
+   {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
+BOOST_FIXTURE_TEST_CASE( precomputed_transaction_test, database_fixture )
+{
+   try
+   {
+      ACTOR( nathan );
+      fund( nathan );
+      signed_transaction tx;
+      transfer_operation top;
+      top.from = nathan_id;
+      top.to = account_id_type();
+      top.amount = asset( 100 );
+      tx.operations.push_back( top );
+      set_expiration( db, tx );
+      sign( tx, nathan_private_key );
+
+      precomputed_transaction ptx( tx, db.get_chain_id() );
+      BOOST_CHECK( ptx.id() == tx.id() );
+      BOOST_CHECK( ptx.sig_digest() == tx.sig_digest( db.get_chain_id() ) );
+      BOOST_CHECK( tx.recover_signature_keys( ptx.sig_digest() ) == tx.get_signature_keys( db.get_chain_id() ) );
+
+      BOOST_CHECK( db.push_transaction( ptx ).id() == tx.id() );
+      // the dupe check sees the precomputed id
+      GRAPHENE_REQUIRE_THROW( db.push_transaction( ptx ), fc::exception );
+
+      // a transaction signed for another chain is refused
+      precomputed_transaction other_chain( tx, fc::sha256::hash( "other chain" ) );
+      GRAPHENE_REQUIRE_THROW( db.push_transaction( other_chain ), fc::exception );
+
+      // an invalid transaction fails the same way as before
+      signed_transaction empty;
+      set_expiration( db, empty );
+      GRAPHENE_REQUIRE_THROW( db.push_transaction( precomputed_transaction( empty, db.get_chain_id() ) ), fc::exception );
+
+      generate_block();
+      BOOST_CHECK_EQUAL( get_balance( nathan_id, asset_id_type() ), 500000 - 100 );
+   }
+   catch (fc::exception& e)
+   {
+      edump((e.to_detail_string()));
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -28,7 +28,12 @@
 
 #include <graphene/chain/account_object.hpp>
 
+#include <graphene/utilities/tempdir.hpp>
+
 #include <fc/crypto/digest.hpp>
+#include <fc/io/fstream.hpp>
+
+#include <fstream>
 
 #include "../common/database_fixture.hpp"
 
@@ -62,6 +67,187 @@ BOOST_AUTO_TEST_CASE( undo_test )
    }
 }
 
+BOOST_AUTO_TEST_CASE( flush_and_open_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      std::vector<account_id_type> accounts;
+      {
+         database db1;
+         db1.object_database::open( data_dir.path() );
+         for( int i = 0; i < 200; ++i )
+         {
+            accounts.push_back( db1.create<account_object>( [&]( account_object& a ) {
+               a.name = "account" + fc::to_string( i );
+            }).id );
+            db1.create<account_balance_object>( [&]( account_balance_object& b ) {
+               b.owner = accounts.back();
+               b.balance = i;
+            });
+         }
+         // the second flush replaces the first one
+         db1.object_database::flush();
+         db1.create<account_object>( [&]( account_object& a ) { a.name = "late"; } );
+         db1.object_database::flush();
+      }
+      BOOST_CHECK( !fc::exists( data_dir.path() / "object_database.tmp" ) );
+
+      database db2;
+      db2.object_database::open( data_dir.path() );
+      const auto& by_name = db2.get_index_type<account_index>().indices().get<by_name>();
+      BOOST_CHECK_EQUAL( by_name.size(), accounts.size() + 1 );
+      for( size_t i = 0; i < accounts.size(); ++i )
+         BOOST_CHECK_EQUAL( accounts[i](db2).name, "account" + fc::to_string( i ) );
+      BOOST_CHECK( by_name.find( "late" ) != by_name.end() );
+      const auto& balances = db2.get_index_type<account_balance_index>().indices();
+      BOOST_CHECK_EQUAL( balances.size(), accounts.size() );
+      for( const auto& b : balances )
+         BOOST_CHECK_EQUAL( b.balance.value, int64_t( b.owner.instance.value ) );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( open_legacy_index_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      fc::path dir = data_dir.path() / "object_database" / fc::to_string( account_object::space_id );
+      fc::create_directories( dir );
+      {
+         // the layout written before the snapshot format, each object packed into a vector
+         std::ofstream out( ( dir / fc::to_string( account_object::type_id ) ).generic_string(), std::ofstream::binary );
+         fc::raw::pack( out, object_id_type( account_object::space_id, account_object::type_id, 3 ) );
+         fc::raw::pack( out, fc::sha256::hash( std::string( "1.0" ) ) );
+         for( int i = 0; i < 3; ++i )
+         {
+            account_object a;
+            a.id = account_id_type( i );
+            a.name = "legacy" + fc::to_string( i );
+            fc::raw::pack( out, fc::raw::pack( a ) );
+         }
+      }
+
+      database db;
+      db.object_database::open( data_dir.path() );
+      for( int i = 0; i < 3; ++i )
+         BOOST_CHECK_EQUAL( account_id_type( i )(db).name, "legacy" + fc::to_string( i ) );
+      BOOST_CHECK( db.get_index_type<account_index>().get_next_id() == account_id_type( 3 ) );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( checkpoint_test )
+{
+   try {
+      fc::temp_directory data_dir( graphene::utilities::temp_directory_path() );
+      const fc::path log = data_dir.path() / "object_database" / "delta.log";
+      {
+         database db1;
+         db1.object_database::open( data_dir.path() );
+         for( int i = 0; i < 100; ++i )
+            db1.create<account_object>( [&]( account_object& a ) { a.name = "account" + fc::to_string( i ); } );
+         // there is nothing saved yet, so this is a full flush
+         db1.object_database::checkpoint();
+         BOOST_CHECK( !fc::exists( log ) );
+
+         db1.modify( account_id_type( 5 )(db1), []( account_object& a ) { a.name = "renamed"; } );
+         db1.remove( account_id_type( 7 )(db1) );
+         db1.create<account_object>( [&]( account_object& a ) { a.name = "late"; } );
+         db1.object_database::checkpoint();
+         BOOST_REQUIRE( fc::exists( log ) );
+
+         // nothing changed, nothing is appended
+         const auto log_size = fc::file_size( log );
+         db1.object_database::checkpoint();
+         BOOST_CHECK_EQUAL( fc::file_size( log ), log_size );
+
+         db1.modify( account_id_type( 6 )(db1), []( account_object& a ) { a.name = "renamed again"; } );
+         db1.object_database::checkpoint();
+      }
+      const auto log_size = fc::file_size( log );
+      {
+         // a torn batch at the end of the log
+         std::ofstream out( log.generic_string(), std::ofstream::binary | std::ofstream::app );
+         fc::raw::pack( out, uint64_t( 1000 ) );
+         out.write( "torn", 4 );
+      }
+
+      database db2;
+      db2.object_database::open( data_dir.path() );
+      BOOST_CHECK_EQUAL( fc::file_size( log ), log_size );
+      const auto& by_name = db2.get_index_type<account_index>().indices().get<by_name>();
+      BOOST_CHECK_EQUAL( by_name.size(), 100u );
+      BOOST_CHECK_EQUAL( account_id_type( 5 )(db2).name, "renamed" );
+      BOOST_CHECK_EQUAL( account_id_type( 6 )(db2).name, "renamed again" );
+      BOOST_CHECK( db2.find( account_id_type( 7 ) ) == nullptr );
+      BOOST_CHECK_EQUAL( account_id_type( 100 )(db2).name, "late" );
+      BOOST_CHECK( db2.get_index_type<account_index>().get_next_id() == account_id_type( 101 ) );
+
+      // a change made while nothing is tracked is saved by a full flush, which drops the log
+      db2.track_changes( false );
+      db2.modify( account_id_type( 8 )(db2), []( account_object& a ) { a.name = "untracked"; } );
+      db2.track_changes( true );
+      db2.object_database::checkpoint();
+      BOOST_CHECK( !fc::exists( log ) );
+      db2.object_database::close();
+
+      database db3;
+      db3.object_database::open( data_dir.path() );
+      BOOST_CHECK_EQUAL( account_id_type( 8 )(db3).name, "untracked" );
+      BOOST_CHECK_EQUAL( account_id_type( 6 )(db3).name, "renamed again" );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( undo_merge_many_test )
+{
+   try {
+      database db;
+      std::vector<account_balance_id_type> ids;
+      {
+         auto ses = db._undo_db.start_undo_session( true );
+         for( int i = 0; i < 100; ++i )
+            ids.push_back( db.create<account_balance_object>( [&]( account_balance_object& b ) { b.balance = i; } ).id );
+         ses.commit();
+      }
+
+      auto outer = db._undo_db.start_undo_session( true );
+      for( int round = 0; round < 3; ++round )
+      {
+         // enough entries in one state for its table to grow several times
+         auto inner = db._undo_db.start_undo_session();
+         for( int i = 3; i < 100; ++i )
+            db.modify( ids[i](db), [&]( account_balance_object& b ) { b.balance += 1000; } );
+         for( int i = 0; i < 200; ++i )
+            db.create<account_balance_object>( [&]( account_balance_object& b ) { b.balance = -1; } );
+         db.remove( ids[round](db) );
+         inner.merge();
+      }
+      BOOST_CHECK( db.find( ids[0] ) == nullptr );
+      BOOST_CHECK_EQUAL( ids[50](db).balance.value, 3050 );
+      BOOST_CHECK_EQUAL( db._undo_db.head().entries().size(), 700u );
+
+      outer.undo();
+      const auto& balances = db.get_index_type<account_balance_index>().indices();
+      BOOST_CHECK_EQUAL( balances.size(), ids.size() );
+      for( int i = 0; i < 100; ++i )
+         BOOST_CHECK_EQUAL( ids[i](db).balance.value, i );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( flat_index_test )
 {
    ACTORS((sam));
@@ -92,6 +278,250 @@ BOOST_AUTO_TEST_CASE( flat_index_test )
    FC_ASSERT( !(*bitusd_id(db).bitasset_data_id)(db).current_feed.settlement_price.is_null() );
 }
 
+BOOST_AUTO_TEST_CASE( allocation_statistics_test )
+{
+   try {
+      database db;
+      auto balance_statistics = []( const database& d ) {
+         for( const auto& statistics : d.get_allocation_statistics() )
+            if( statistics.space_id == account_balance_object::space_id && statistics.type_id == account_balance_object::type_id )
+               return statistics;
+         return graphene::db::allocation_statistics();
+      };
+
+      // the container allocates its header node from the pool already
+      const auto before = balance_statistics( db );
+      std::vector<const account_balance_object*> balances;
+      for( int i = 0; i < 1000; ++i )
+         balances.push_back( &db.create<account_balance_object>( [&]( account_balance_object& b ) {
+            b.owner = account_id_type( i );
+         }) );
+      for( int i = 0; i < 500; ++i )
+         db.remove( *balances[i] );
+      const auto after = balance_statistics( db );
+
+      BOOST_CHECK_GT( after.node_size, sizeof(account_balance_object) );
+      BOOST_CHECK_EQUAL( after.allocated_nodes - before.allocated_nodes, 1000u );
+      BOOST_CHECK_EQUAL( after.freed_nodes - before.freed_nodes, 500u );
+      BOOST_CHECK_GE( after.slab_bytes, ( after.allocated_nodes - after.freed_nodes ) * after.node_size );
+
+      // the freed nodes are handed out again before the pool grows
+      for( int i = 0; i < 500; ++i )
+         db.create<account_balance_object>( [&]( account_balance_object& b ) {
+            b.owner = account_id_type( 1000 + i );
+         });
+      BOOST_CHECK_EQUAL( balance_statistics( db ).slabs, after.slabs );
+
+      // every index has a pool of its own
+      database other;
+      BOOST_CHECK_EQUAL( balance_statistics( other ).allocated_nodes, before.allocated_nodes );
+      BOOST_CHECK_EQUAL( balance_statistics( other ).freed_nodes, 0u );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( dense_index_test )
+{
+   try {
+      database db;
+      std::vector<const account_statistics_object*> stats;
+      // more than a chunk of objects
+      for( int i = 0; i < 2500; ++i )
+         stats.push_back( &db.create<account_statistics_object>( [&]( account_statistics_object& s ) {
+            s.owner = account_id_type( i );
+         }) );
+
+      const auto& stats_index = db.get_index_type<dense_index<account_statistics_object>>();
+      BOOST_CHECK_EQUAL( stats_index.size(), 2500u );
+      for( int i = 0; i < 2500; ++i )
+      {
+         BOOST_CHECK( db.find( stats[i]->id ) == stats[i] );
+         BOOST_CHECK( stats[i]->owner == account_id_type( i ) );
+      }
+      BOOST_CHECK( db.find_object( account_statistics_id_type( 2500 ) ) == nullptr );
+
+      {
+         auto session = db._undo_db.start_undo_session();
+         for( int i = 1000; i < 1100; ++i )
+            db.remove( *stats[i] );
+         db.modify( *stats[5], []( account_statistics_object& s ) { s.total_core_in_orders = 17; } );
+         BOOST_CHECK_EQUAL( stats_index.size(), 2400u );
+         BOOST_CHECK( db.find_object( account_statistics_id_type( 1050 ) ) == nullptr );
+
+         // iteration skips the removed objects and keeps the instance order
+         int64_t previous = -1;
+         size_t count = 0;
+         for( const account_statistics_object& s : stats_index )
+         {
+            BOOST_CHECK_GT( int64_t( s.id.instance() ), previous );
+            previous = s.id.instance();
+            ++count;
+         }
+         BOOST_CHECK_EQUAL( count, 2400u );
+         session.undo();
+      }
+
+      BOOST_CHECK_EQUAL( stats_index.size(), 2500u );
+      const account_statistics_object* restored = db.find( account_statistics_id_type( 1050 ) );
+      BOOST_REQUIRE( restored != nullptr );
+      BOOST_CHECK( restored->owner == account_id_type( 1050 ) );
+      BOOST_CHECK_EQUAL( stats[5]->total_core_in_orders.value, 0 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( ordered_secondary_index_test )
+{
+   try {
+      database db;
+      typedef ordered_secondary_index< account_statistics_object,
+                                       member< account_statistics_object, share_type,
+                                               &account_statistics_object::total_core_in_orders > > by_orders_index;
+      typedef primary_index< dense_index<account_statistics_object> > stats_index_type;
+      auto& stats_index = const_cast<stats_index_type&>( db.get_index_type<stats_index_type>() );
+      const auto& by_orders = stats_index.add_secondary_index<by_orders_index>()->indices();
+
+      std::vector<const account_statistics_object*> stats;
+      for( int i = 0; i < 10; ++i )
+         stats.push_back( &db.create<account_statistics_object>( [&]( account_statistics_object& s ) {
+            s.owner = account_id_type( i );
+            s.total_core_in_orders = ( i * 7 ) % 10;
+         }) );
+      auto check_order = [&]() {
+         BOOST_REQUIRE_EQUAL( by_orders.size(), stats_index.size() );
+         share_type previous = -1;
+         for( const auto& item : by_orders )
+         {
+            BOOST_CHECK( item.first == item.second->total_core_in_orders );
+            BOOST_CHECK( db.find( item.second->id ) == item.second );
+            BOOST_CHECK( item.first >= previous );
+            previous = item.first;
+         }
+      };
+      check_order();
+      BOOST_CHECK( by_orders.begin()->second == stats[0] );
+
+      {
+         auto session = db._undo_db.start_undo_session();
+         db.modify( *stats[3], []( account_statistics_object& s ) { s.total_core_in_orders = 100; } );
+         db.remove( *stats[0] );
+         db.create<account_statistics_object>( []( account_statistics_object& s ) { s.total_core_in_orders = -5; } );
+         check_order();
+         BOOST_CHECK( by_orders.rbegin()->second == stats[3] );
+         BOOST_CHECK_EQUAL( by_orders.begin()->first.value, -5 );
+         // the undo modifies, removes and inserts through the primary index as well
+         session.undo();
+      }
+      check_order();
+      BOOST_CHECK_EQUAL( by_orders.size(), 10u );
+      BOOST_CHECK( by_orders.begin()->second == db.find( account_statistics_id_type( 0 ) ) );
+      BOOST_CHECK_EQUAL( by_orders.rbegin()->first.value, 9 );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
+BOOST_AUTO_TEST_CASE( async_log_test )
+{
+   try {
+      fc::temp_directory log_dir( graphene::utilities::temp_directory_path() );
+      async_log log;
+      async_log_options options;
+      options.directory = log_dir.path();
+      options.max_file_size = 64;
+      options.max_rotated_files = 2;
+      log.open( options );
+
+      log.write_text( "text.log", "block ", 5, " params (", 1, ";", 2, ")" );
+      for( int i = 0; i < 20; ++i )
+         log.write( "fields.log", "account", i, 1.5 );
+      log.flush();
+      BOOST_CHECK_EQUAL( log.dropped(), 0u );
+
+      std::string text;
+      fc::read_file_contents( log_dir.path() / "text.log", text );
+      BOOST_CHECK_EQUAL( text, "block 5 params (1;2)\n" );
+
+      // the records beyond the size limit went to the rotated files, the oldest are gone
+      BOOST_CHECK( fc::exists( log_dir.path() / "fields.log.1" ) );
+      BOOST_CHECK( fc::exists( log_dir.path() / "fields.log.2" ) );
+      BOOST_CHECK( !fc::exists( log_dir.path() / "fields.log.3" ) );
+      BOOST_CHECK_LE( fc::file_size( log_dir.path() / "fields.log" ), 64u );
+      std::string last;
+      fc::read_file_contents( log_dir.path() / "fields.log", last );
+      BOOST_CHECK( last.find( "account;19;1.5\n" ) != std::string::npos );
+      log.close();
+
+      // nothing is written when the logs are disabled
+      options.enabled = false;
+      log.open( options );
+      BOOST_CHECK( !log.enabled() );
+      log.write( "disabled.log", 1 );
+      log.flush();
+      log.close();
+      BOOST_CHECK( !fc::exists( log_dir.path() / "disabled.log" ) );
+
+      options.enabled = true;
+      options.format = async_log_format::binary;
+      log.open( options );
+      log.write( "binary.log", "ab", 7 );
+      log.close();
+      std::string binary;
+      fc::read_file_contents( log_dir.path() / "binary.log", binary );
+      // time, field count, then each field with its length
+      BOOST_REQUIRE_EQUAL( binary.size(), 8u + 4u + 4u + 2u + 4u + 1u );
+      uint32_t field_count;
+      memcpy( &field_count, binary.data() + 8, sizeof(field_count) );
+      BOOST_CHECK_EQUAL( field_count, 2u );
+      BOOST_CHECK_EQUAL( binary.substr( 16, 2 ), "ab" );
+      BOOST_CHECK_EQUAL( binary.substr( 22, 1 ), "7" );
+      log.close();
+
+      // the records of the lossless files wait for a full ring instead of being dropped
+      options.format = async_log_format::csv;
+      options.capacity = 2;
+      options.max_file_size = 0;
+      options.lossless_files = { "lossless.log" };
+      log.open( options );
+      std::thread other( [&]() {
+         for( int i = 0; i < 1000; ++i )
+            log.write( "lossy.log", i );
+      } );
+      for( int i = 0; i < 1000; ++i )
+         log.write( "lossless.log", i );
+      other.join();
+      log.flush();
+      std::string lossless;
+      fc::read_file_contents( log_dir.path() / "lossless.log", lossless );
+      BOOST_CHECK_EQUAL( std::count( lossless.begin(), lossless.end(), '\n' ), 1000 );
+      BOOST_CHECK( lossless.find( "\n999\n" ) != std::string::npos );
+
+      // closing while records are written
+      std::atomic<bool> stop( false );
+      std::thread writer( [&]() {
+         while( !stop.load() )
+            log.write( "lossy.log", 1 );
+      } );
+      std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+      log.close();
+      stop.store( true );
+      writer.join();
+      BOOST_CHECK( !log.enabled() );
+   } catch ( const fc::exception& e )
+   {
+      edump( (e.to_detail_string()) );
+      throw;
+   }
+}
+
 BOOST_AUTO_TEST_CASE( merge_test )
 {
    try {
@@ -29,10 +29,12 @@
 
 #include <graphene/chain/fba_accumulator_id.hpp>
 
+#include <graphene/chain/committee_member_object.hpp>
 #include <graphene/chain/fba_object.hpp>
 #include <graphene/chain/market_object.hpp>
 #include <graphene/chain/proposal_object.hpp>
 #include <graphene/chain/vesting_balance_object.hpp>
+#include <graphene/chain/witness_object.hpp>
 #include <graphene/chain/exceptions.hpp>
 
 #include <boost/test/unit_test.hpp>
@@ -573,6 +575,84 @@ REG : net' ltm' ref'
 
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE( parallel_vote_tally_test )
+{ try {
+   ACTOR(life);
+   ACTOR(rog);
+   transfer( account_id_type(), life_id, asset(100000000) );
+   transfer( account_id_type(), rog_id, asset(100000000) );
+   upgrade_to_lifetime_member( life_id );
+   upgrade_to_lifetime_member( rog_id );
+   generate_block();
+   enable_fees();
+
+   // every account is registered by the last lifetime member before it, each pays a fee which goes to
+   // its referrer and registrar at the maintenance, and votes with the stake the cashback changes
+   const auto& witnesses = db.get_global_properties().active_witnesses;
+   const auto& committee_members = db.get_global_properties().active_committee_members;
+   vector<account_id_type> accounts{ life_id, rog_id };
+   account_id_type registrar = life_id;
+   for( int i = 0; i < 24; ++i )
+   {
+      const account_object& a = create_account( "chain" + fc::to_string( i ), registrar( db ),
+                                                ( i % 2 ? rog_id : registrar )( db ), 50 );
+      accounts.push_back( a.id );
+      transfer( life_id, a.id, asset( 1000000 ) );
+      if( i % 3 == 0 )
+      {
+         upgrade_to_lifetime_member( a.id );
+         registrar = a.id;
+      }
+      transfer( a.id, rog_id, asset( 1000 ) );
+   }
+   for( size_t i = 0; i < accounts.size(); ++i )
+   {
+      account_update_operation op;
+      op.account = accounts[i];
+      op.new_options = accounts[i]( db ).options;
+      op.new_options->votes.insert( ( *std::next( witnesses.begin(), i % witnesses.size() ) )( db ).vote_id );
+      op.new_options->votes.insert( ( *std::next( committee_members.begin(), i % committee_members.size() ) )( db ).vote_id );
+      trx.operations.push_back( op );
+      PUSH_TX( db, trx, ~0 );
+      trx.operations.clear();
+   }
+   generate_block();
+
+   auto maintenance_results = [&]() {
+      vector<int64_t> results;
+      for( const witness_object& w : db.get_index_type<witness_index>().indices() )
+         results.push_back( w.total_votes );
+      for( const committee_member_object& c : db.get_index_type<committee_member_index>().indices() )
+         results.push_back( c.total_votes );
+      for( account_id_type id : accounts )
+      {
+         const account_object& a = id( db );
+         results.push_back( db.get_balance( id, asset_id_type() ).amount.value );
+         results.push_back( a.cashback_vb.valid() ? (*a.cashback_vb)( db ).balance.amount.value : 0 );
+         results.push_back( a.statistics( db ).pending_fees.value );
+      }
+      return results;
+   };
+
+   // the same maintenance tallied on one thread and on several
+   const uint32_t head = db.head_block_num();
+   db.set_maintenance_tally_threads( 1, 1 );
+   generate_blocks( db.get_dynamic_global_properties().next_maintenance_time );
+   BOOST_CHECK_EQUAL( db.get_last_maintenance_statistics().tally_threads, 1u );
+   const vector<int64_t> sequential = maintenance_results();
+   while( db.head_block_num() > head )
+      db.pop_block();
+
+   db.set_maintenance_tally_threads( 4, 1 );
+   generate_blocks( db.get_dynamic_global_properties().next_maintenance_time );
+   BOOST_CHECK_EQUAL( db.get_last_maintenance_statistics().tally_threads, 4u );
+   const vector<int64_t> parallel = maintenance_results();
+   BOOST_CHECK( parallel == sequential );
+   const account_object& rog_account = rog_id( db );
+   BOOST_REQUIRE( rog_account.cashback_vb.valid() );
+   BOOST_CHECK_GT( (*rog_account.cashback_vb)( db ).balance.amount.value, 0 );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE( account_create_fee_scaling )
 { try {
    auto accounts_per_scale = db.get_global_properties().parameters.accounts_per_fee_scale;
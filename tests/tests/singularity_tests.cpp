@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2015 Cryptonomex, Inc., and contributors.
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <boost/test/unit_test.hpp>
+
+#include <set>
+
+#include <graphene/singularity/activity_index_calculator.hpp>
+#include <graphene/singularity/activity_window.hpp>
+#include <graphene/singularity/emission.hpp>
+#include <graphene/singularity/ncd_aware_rank.hpp>
+
+using namespace singularity;
+
+namespace {
+
+std::vector<transaction_t> make_test_block( unsigned int block_num, unsigned int num_accounts )
+{
+   std::vector<transaction_t> block;
+   for( unsigned int t = 0; t < block_num % 4; ++t )
+   {
+      std::string source = "a" + std::to_string((block_num * 7 + t * 13) % num_accounts);
+      std::string target = "a" + std::to_string((block_num * block_num + t * 5) % num_accounts);
+      block.push_back(transaction_t(1 + (block_num * 31 + t) % 50, 0, source, target, 0, 100, 100));
+   }
+   return block;
+}
+
+/** make_test_block with the accounts "a<n>" given as instance n */
+std::vector<id_transaction_t> make_test_id_block( unsigned int block_num, unsigned int num_accounts )
+{
+   std::vector<id_transaction_t> block;
+   for( auto& t : make_test_block(block_num, num_accounts) )
+      block.push_back({ t.amount, t.comission,
+                        uint32_t(std::stoul(t.source_account.substr(1))),
+                        uint32_t(std::stoul(t.target_account.substr(1))),
+                        t.source_account_balance, t.target_account_balance, t.timestamp });
+   return block;
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(singularity_tests)
+
+BOOST_AUTO_TEST_CASE( csr_matrix_test )
+{
+   triplet_vector_t triplets;
+   triplets.push_back(triplet_t(2, 1, 3));
+   triplets.push_back(triplet_t(0, 2, 1));
+   triplets.push_back(triplet_t(2, 0, -4));
+   triplets.push_back(triplet_t(0, 2, 2));
+   triplets.push_back(triplet_t(2, 1, -1));
+
+   csr_matrix_t m(3, 3, triplets);
+   BOOST_CHECK_EQUAL( m.size1(), 3u );
+   BOOST_CHECK_EQUAL( m.size2(), 3u );
+   BOOST_CHECK_EQUAL( m.nnz(), 3u );
+
+   BOOST_CHECK_EQUAL( m.row_end(0) - m.row_begin(0), 1u );
+   BOOST_CHECK_EQUAL( m.column(m.row_begin(0)), 2u );
+   BOOST_CHECK_EQUAL( m.value(m.row_begin(0)), 3 );
+   BOOST_CHECK_EQUAL( m.row_begin(1), m.row_end(1) );
+   BOOST_CHECK_EQUAL( m.column(m.row_begin(2)), 0u );
+   BOOST_CHECK_EQUAL( m.value(m.row_begin(2)), -4 );
+   BOOST_CHECK_EQUAL( m.column(m.row_begin(2) + 1), 1u );
+   BOOST_CHECK_EQUAL( m.value(m.row_begin(2) + 1), 2 );
+
+   m.prune_non_positive();
+   BOOST_CHECK_EQUAL( m.nnz(), 2u );
+   BOOST_CHECK_EQUAL( m.row_end(2) - m.row_begin(2), 1u );
+
+   matrix_tools::normalize_columns(m);
+   BOOST_CHECK_EQUAL( m.value(m.row_begin(0)), 1 );
+   BOOST_CHECK_EQUAL( m.value(m.row_begin(2)), 1 );
+
+   vector_t v(3, 1), out(3, 0);
+   thread_pool pool(2);
+   matrix_tools::prod(out, m, v, pool, matrix_tools::split_rows(m, pool.size()));
+   BOOST_CHECK_EQUAL( out[0], 1 );
+   BOOST_CHECK_EQUAL( out[1], 0 );
+   BOOST_CHECK_EQUAL( out[2], 1 );
+
+   triplets.push_back(triplet_t(3, 0, 1));
+   BOOST_CHECK_THROW( csr_matrix_t(3, 3, triplets), runtime_exception );
+}
+
+BOOST_AUTO_TEST_CASE( split_rows_test )
+{
+   // the first row holds half of the nonzeros
+   triplet_vector_t triplets;
+   for( unsigned int j = 0; j < 100; ++j )
+      triplets.push_back(triplet_t(0, j, 1));
+   for( unsigned int i = 1; i < 100; ++i )
+      triplets.push_back(triplet_t(i, i, 1));
+   csr_matrix_t m(100, 100, triplets);
+
+   std::vector<range_t> ranges = matrix_tools::split_rows(m, 4);
+   BOOST_REQUIRE_EQUAL( ranges.size(), 4u );
+   BOOST_CHECK_EQUAL( ranges[0].start(), 0u );
+   BOOST_CHECK_EQUAL( ranges[0].size(), 1u );
+   for( unsigned int i = 1; i < ranges.size(); ++i )
+      BOOST_CHECK_EQUAL( ranges[i].start(), ranges[i - 1].start() + ranges[i - 1].size() );
+   BOOST_CHECK_EQUAL( ranges.back().start() + ranges.back().size(), 100u );
+
+   thread_pool pool(4);
+   vector_t v(100, 1), out(100, 0);
+   for( unsigned int n = 0; n < 50; ++n )
+      matrix_tools::prod(out, m, v, pool, ranges);
+   BOOST_CHECK_EQUAL( out[0], 100 );
+   for( unsigned int i = 1; i < 100; ++i )
+      BOOST_CHECK_EQUAL( out[i], 1 );
+}
+
+BOOST_AUTO_TEST_CASE( activity_index_sum_test )
+{
+   parameters_t parameters;
+   parameters.account_amount_threshold = 10;
+   parameters.transaction_amount_threshold = 1;
+   activity_index_calculator aic(parameters);
+
+   for( unsigned int b = 0; b < 100; ++b )
+   {
+      std::vector<transaction_t> block;
+      for( unsigned int t = 0; t < 5; ++t )
+      {
+         std::string source = "a" + std::to_string((b * 7 + t) % 30);
+         std::string target = "a" + std::to_string((b * 3 + t * 11) % 30);
+         block.push_back(transaction_t(10 + t, 0, source, target, 0, 100, 100));
+      }
+      aic.add_block(block);
+   }
+
+   account_activity_index_map_t result = aic.calculate();
+   BOOST_CHECK_EQUAL( result.size(), 30u );
+   for( auto& r: result )
+      BOOST_CHECK( r.second > 0 );
+}
+
+BOOST_AUTO_TEST_CASE( activity_index_warm_start_test )
+{
+   parameters_t parameters;
+   parameters.account_amount_threshold = 10;
+   parameters.transaction_amount_threshold = 1;
+   activity_index_calculator aic(parameters);
+
+   for( unsigned int b = 0; b < 400; ++b )
+      aic.add_block(make_test_block(b, 60));
+
+   account_activity_index_map_t cold = aic.calculate();
+   unsigned int cold_iterations = aic.get_last_iteration_count();
+   BOOST_CHECK( cold_iterations > 1 );
+
+   // a new account which is missing from the seed gets the uniform value
+   std::vector<transaction_t> block;
+   block.push_back(transaction_t(20, 0, "a1", "new", 0, 100, 100));
+   aic.add_block(block);
+   account_activity_index_map_t seed = cold;
+   aic.set_initial_index(seed);
+   account_activity_index_map_t warm = aic.calculate();
+   BOOST_CHECK( aic.get_last_iteration_count() < cold_iterations );
+   BOOST_CHECK_EQUAL( warm.size(), cold.size() + 1 );
+
+   aic.set_initial_index(account_activity_index_map_t());
+   account_activity_index_map_t reference = aic.calculate();
+   double difference = 0;
+   for( auto& r: reference )
+      difference += std::abs(r.second - warm[r.first]);
+   BOOST_CHECK( difference < 0.05 );
+}
+
+BOOST_AUTO_TEST_CASE( activity_window_test )
+{
+   parameters_t parameters;
+   parameters.account_amount_threshold = 10;
+   parameters.transaction_amount_threshold = 5;
+   parameters.decay_period = 10;
+   parameters.decay_koefficient = 0.5;
+
+   const uint32_t window = 45;
+   activity_window_calculator awc(parameters);
+
+   for( uint32_t window_end = 10; window_end <= 150; window_end += 20 )
+   {
+      uint32_t window_start = window_end > window ? window_end - window + 1 : 1;
+
+      activity_index_calculator aic(parameters);
+      for( uint32_t i = window_start; i <= window_end; ++i )
+         aic.add_block(make_test_block(i, 40));
+      account_activity_index_map_t expected = aic.calculate();
+
+      awc.move_window(window_start);
+      for( uint32_t i = awc.get_next_block(); i <= window_end; ++i )
+         awc.add_block(i, make_test_id_block(i, 40));
+      account_activity_index_vector_t result = awc.calculate(window_end);
+
+      BOOST_REQUIRE( result.size() <= 40u );
+      unsigned int found = 0;
+      for( unsigned int account = 0; account < result.size(); ++account )
+      {
+         auto r = expected.find("a" + std::to_string(account));
+         if( r == expected.end() )
+         {
+            BOOST_CHECK_EQUAL( result[account], 0 );
+            continue;
+         }
+         BOOST_CHECK_EQUAL( result[account], r->second );
+         found++;
+      }
+      BOOST_CHECK_EQUAL( found, expected.size() );
+   }
+
+   BOOST_CHECK_THROW( awc.add_block(1, make_test_id_block(1, 40)), runtime_exception );
+}
+
+BOOST_AUTO_TEST_CASE( activity_window_replay_test )
+{
+   parameters_t parameters;
+   parameters.account_amount_threshold = 10;
+   parameters.transaction_amount_threshold = 5;
+   parameters.decay_period = 7;
+   parameters.decay_koefficient = 0.9;
+
+   // accounts which first appear in the middle of the window and of a block
+   auto make_block = []( uint32_t block_num ) {
+      std::vector<transaction_t> block = make_test_block(block_num, 40);
+      if( block_num % 5 == 0 )
+      {
+         std::string account = "a" + std::to_string(40 + block_num % 11);
+         block.insert(block.begin() + block.size() / 2,
+                      transaction_t(20, 0, "a" + std::to_string(block_num % 40), account, 0, 100, 100));
+         block.push_back(transaction_t(30, 0, account, "a" + std::to_string((block_num + 1) % 40), 0, 100, 100));
+      }
+      return block;
+   };
+
+   const uint32_t window = 50;
+   activity_window_calculator awc(parameters);
+
+   for( uint32_t window_end = 12; window_end <= 200; window_end += 14 )
+   {
+      uint32_t window_start = window_end > window ? window_end - window + 1 : 1;
+
+      activity_index_calculator aic(parameters);
+      for( uint32_t i = window_start; i <= window_end; ++i )
+         aic.add_block(make_block(i));
+      account_activity_index_map_t expected = aic.calculate();
+
+      awc.move_window(window_start);
+      for( uint32_t i = awc.get_next_block(); i <= window_end; ++i )
+      {
+         std::vector<id_transaction_t> block;
+         for( auto& t : make_block(i) )
+            block.push_back({ t.amount, t.comission,
+                              uint32_t(std::stoul(t.source_account.substr(1))),
+                              uint32_t(std::stoul(t.target_account.substr(1))),
+                              t.source_account_balance, t.target_account_balance, t.timestamp });
+         awc.add_block(i, block);
+      }
+      account_activity_index_vector_t result = awc.calculate(window_end);
+
+      // the window gives the replay's values to the last bit
+      unsigned int ranked = 0;
+      for( auto& r : expected )
+      {
+         uint32_t account = std::stoul(r.first.substr(1));
+         BOOST_CHECK_EQUAL( account < result.size() ? result[account] : 0, r.second );
+         ranked += r.second != 0;
+      }
+      unsigned int result_ranked = 0;
+      for( double index : result )
+         result_ranked += index != 0;
+      BOOST_CHECK_EQUAL( result_ranked, ranked );
+   }
+}
+
+BOOST_AUTO_TEST_CASE( activity_period_test )
+{
+   activity_period period;
+   std::vector<transaction_t> block;
+   block.push_back(transaction_t(10, 0, "a", "b", 0, 100, 100));
+   block.push_back(transaction_t(10, 0, "b", "a", 0, 100, 100));
+   block.push_back(transaction_t(5, 0, "a", "a", 0, 100, 100));
+   period.add_block(block);
+   BOOST_CHECK_EQUAL( period.get_activity(), 0 );
+
+   block.clear();
+   block.push_back(transaction_t(3, 0, "a", "c", 0, 100, 100));
+   block.push_back(transaction_t(4, 0, "c", "a", 0, 100, 100));
+   block.push_back(transaction_t(1, 0, "b", "a", 0, 100, 100));
+   period.add_block(block);
+   BOOST_CHECK_EQUAL( period.get_activity(), 2 );
+
+   block.clear();
+   block.push_back(transaction_t(1, 0, "a", "b", 0, 100, 100));
+   period.add_block(block);
+   BOOST_CHECK_EQUAL( period.get_activity(), 1 );
+
+   period.clear();
+   BOOST_CHECK_EQUAL( period.get_activity(), 0 );
+
+   // the names and the instances of the same accounts give the same count
+   activity_period by_name, by_id;
+   for( unsigned int b = 0; b < 300; ++b )
+   {
+      by_name.add_block(make_test_block(b, 50));
+      by_id.add_block(make_test_id_block(b, 50));
+   }
+   BOOST_CHECK( by_name.get_activity() > 0 );
+   BOOST_CHECK_EQUAL( by_name.get_activity(), by_id.get_activity() );
+}
+
+BOOST_AUTO_TEST_CASE( scan_csr_test )
+{
+   const unsigned int num_vertices = 300;
+
+   // dense groups joined by a few random links
+   std::vector<edge_t> edges;
+   std::set<edge_t> known;
+   auto add = [&]( unsigned int a, unsigned int b ) {
+      if( a != b && known.insert(edge_t(std::min(a, b), std::max(a, b))).second )
+         edges.push_back(edge_t(a, b));
+   };
+   for( unsigned int group = 0; group < num_vertices; group += 10 )
+      for( unsigned int a = group; a < group + 10; ++a )
+         for( unsigned int b = a + 1; b < group + 10; ++b )
+            if( (a * b + group) % 5 != 0 )
+               add(a, b);
+   for( unsigned int i = 0; i < 400; ++i )
+      add((i * 7919) % num_vertices, (i * 104729 + 17) % num_vertices);
+
+   Graph g(num_vertices);
+   unsigned int id = 0;
+   for( auto& e : edges )
+      put(boost::edge_index, g, add_edge(e.first, e.second, g).first, id++);
+   scan(0.5, 3).process(g);
+
+   unsigned int num_members = 0;
+   for( unsigned int v = 0; v < num_vertices; ++v )
+      num_members += get(vertex_status, g, v) == node_status_member;
+   BOOST_CHECK( num_members > 0 );
+   BOOST_CHECK( num_members < num_vertices );
+
+   for( unsigned int num_threads : {1, 4} )
+   {
+      scan_result_t result = scan(0.5, 3, num_threads).process(csr_graph_t(num_vertices, edges));
+      BOOST_CHECK_EQUAL( result.num_clusters, get_property(g, graph_num_clusters) );
+      for( unsigned int v = 0; v < num_vertices; ++v )
+      {
+         BOOST_CHECK_EQUAL( result.cluster_ids[v], get(vertex_cluster_id, g, v) );
+         BOOST_CHECK_EQUAL( result.statuses[v], get(vertex_status, g, v) );
+      }
+   }
+}
+
+BOOST_AUTO_TEST_SUITE_END()